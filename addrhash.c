@@ -0,0 +1,106 @@
+#include "addrhash.h"
+#include "state.h"
+#include "tx.h"
+#include "txhash.h"
+#include <ccan/hash/hash.h>
+#include <ccan/structeq/structeq.h>
+
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae)
+{
+	return &ae->addr;
+}
+
+size_t addrhash_hashfn(const struct protocol_address *addr)
+{
+	return hash_any(addr, sizeof(*addr), 0);
+}
+
+bool addrhash_eq(const struct addrhash_elem *ae,
+		 const struct protocol_address *addr)
+{
+	return structeq(&ae->addr, addr);
+}
+
+static struct addrhash_elem *addrhash_i(struct htable *ht,
+					const struct protocol_address *addr,
+					struct addrhash_elem *ae,
+					struct addrhash_iter *i,
+					size_t h)
+{
+	while (ae) {
+		if (addrhash_eq(ae, addr))
+			break;
+		ae = htable_nextval(ht, &i->i, h);
+	}
+	return ae;
+}
+
+struct addrhash_elem *addrhash_firstval(struct addrhash *addrhash,
+					const struct protocol_address *addr,
+					struct addrhash_iter *i)
+{
+	size_t h = addrhash_hashfn(addr);
+
+	return addrhash_i(&addrhash->raw, addr,
+			  htable_firstval(&addrhash->raw, &i->i, h), i, h);
+}
+
+struct addrhash_elem *addrhash_nextval(struct addrhash *addrhash,
+				       const struct protocol_address *addr,
+				       struct addrhash_iter *i)
+{
+	size_t h = addrhash_hashfn(addr);
+
+	return addrhash_i(&addrhash->raw, addr,
+			  htable_nextval(&addrhash->raw, &i->i, h), i, h);
+}
+
+void addrhash_add_tx(struct state *state,
+		     struct txhash_elem *te, const union protocol_tx *tx)
+{
+	struct protocol_address *addrs;
+	unsigned int i;
+
+	if (!state->index_addresses)
+		return;
+
+	addrs = tx_addresses(state, tx);
+	for (i = 0; i < tal_count(addrs); i++) {
+		/* Like inputhash, we allocate off state. */
+		struct addrhash_elem *ae = tal(state, struct addrhash_elem);
+
+		ae->addr = addrs[i];
+		ae->te = te;
+		addrhash_add(&state->addrhash, ae);
+	}
+	tal_free(addrs);
+}
+
+void addrhash_del_tx(struct state *state,
+		     const struct txhash_elem *te, const union protocol_tx *tx)
+{
+	struct protocol_address *addrs;
+	unsigned int i;
+
+	if (!state->index_addresses)
+		return;
+
+	addrs = tx_addresses(state, tx);
+	for (i = 0; i < tal_count(addrs); i++) {
+		struct addrhash_iter it;
+		struct addrhash_elem *ae;
+
+		/* This is linear in the address' activity, which is what
+		 * a lookup costs anyway. */
+		for (ae = addrhash_firstval(&state->addrhash, &addrs[i], &it);
+		     ae;
+		     ae = addrhash_nextval(&state->addrhash, &addrs[i], &it)) {
+			if (ae->te == te) {
+				htable_delval(&state->addrhash.raw, &it.i);
+				tal_free(ae);
+				break;
+			}
+		}
+	}
+	tal_free(addrs);
+}
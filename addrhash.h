@@ -0,0 +1,41 @@
+#ifndef PETTYCOIN_ADDRHASH_H
+#define PETTYCOIN_ADDRHASH_H
+#include "config.h"
+#include "protocol.h"
+#include <ccan/htable/htable_type.h>
+#include <ccan/tal/tal.h>
+
+struct state;
+struct txhash_elem;
+union protocol_tx;
+
+/* Every known (full) transaction, indexed by each address it touches. */
+struct addrhash_elem {
+	struct protocol_address addr;
+
+	/* ...is touched by this tx (block or pending). */
+	struct txhash_elem *te;
+};
+
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae);
+size_t addrhash_hashfn(const struct protocol_address *addr);
+bool addrhash_eq(const struct addrhash_elem *ae,
+		 const struct protocol_address *addr);
+
+HTABLE_DEFINE_TYPE(struct addrhash_elem,
+		   addrhash_keyof, addrhash_hashfn, addrhash_eq, addrhash);
+
+/* Since an address can be touched by many transactions... */
+struct addrhash_elem *addrhash_firstval(struct addrhash *addrhash,
+					const struct protocol_address *addr,
+					struct addrhash_iter *i);
+struct addrhash_elem *addrhash_nextval(struct addrhash *addrhash,
+				       const struct protocol_address *addr,
+				       struct addrhash_iter *i);
+
+/* These do nothing unless state->index_addresses. */
+void addrhash_add_tx(struct state *state,
+		     struct txhash_elem *te, const union protocol_tx *tx);
+void addrhash_del_tx(struct state *state,
+		     const struct txhash_elem *te, const union protocol_tx *tx);
+#endif /* PETTYCOIN_ADDRHASH_H */
@@ -0,0 +1,150 @@
+#include "binrpc.h"
+#include "check_tx.h"
+#include "hash_tx.h"
+#include "log.h"
+#include "marshal.h"
+#include "packet_io.h"
+#include "peer.h"
+#include "pending.h"
+#include "protocol_net.h"
+#include "sendrawtransaction.h"
+#include "state.h"
+#include "sync.h"
+#include "tal_packet.h"
+#include <ccan/tal/tal.h>
+#include <errno.h>
+#include <string.h>
+
+struct binrpc {
+	struct state *state;
+	struct log *log;
+	void *incoming;
+	void *reply;
+};
+
+static struct protocol_pkt_err *err_pkt(tal_t *ctx, enum protocol_ecode e)
+{
+	struct protocol_pkt_err *pkt;
+
+	pkt = tal_packet(ctx, struct protocol_pkt_err, PROTOCOL_PKT_ERR);
+	pkt->error = cpu_to_le32(e);
+
+	return pkt;
+}
+
+static enum protocol_ecode recv_tx(struct binrpc *b,
+				   const struct protocol_pkt_tx *pkt)
+{
+	union protocol_tx *tx;
+	struct protocol_tx_id sha;
+	enum protocol_ecode e;
+	unsigned int bad_input_num;
+	bool old, already_known;
+
+	if (le32_to_cpu(pkt->len) < sizeof(*pkt))
+		return PROTOCOL_ECODE_INVALID_LEN;
+	if (le32_to_cpu(pkt->err) != PROTOCOL_ECODE_NONE)
+		return PROTOCOL_ECODE_UNKNOWN_ERRCODE;
+
+	tx = (void *)(pkt + 1);
+	e = unmarshal_tx(tx, le32_to_cpu(pkt->len) - sizeof(*pkt), NULL);
+	if (e)
+		return e;
+
+	e = check_tx(b->state, tx, NULL);
+	if (e)
+		return e;
+
+	hash_tx(tx, &sha);
+	switch (submit_tx(b->state, tx, &sha, &bad_input_num, &old,
+			  &already_known)) {
+	case ECODE_INPUT_OK:
+	case ECODE_INPUT_UNKNOWN:
+		/* Resubmitting is harmless: it's pending either way. */
+		return PROTOCOL_ECODE_NONE;
+	case ECODE_INPUT_BAD:
+	case ECODE_INPUT_BAD_AMOUNT:
+	case ECODE_INPUT_DOUBLESPEND:
+	case ECODE_INPUT_CLAIM_BAD:
+		break;
+	}
+	return PROTOCOL_ECODE_BAD_INPUT;
+}
+
+static void *handle_pkt(struct binrpc *b)
+{
+	const struct protocol_net_hdr *hdr = b->incoming;
+	u32 len = le32_to_cpu(hdr->len);
+
+	switch (le32_to_cpu(hdr->type)) {
+	case PROTOCOL_PKT_TX:
+		return err_pkt(b, recv_tx(b, b->incoming));
+	case PROTOCOL_PKT_GET_TX: {
+		const struct protocol_pkt_get_tx *pkt = b->incoming;
+
+		if (len != sizeof(*pkt))
+			break;
+		return tx_reply(b, b->state, &pkt->tx);
+	}
+	case PROTOCOL_PKT_GET_BLOCK: {
+		const struct protocol_pkt_get_block *pkt = b->incoming;
+
+		if (len != sizeof(*pkt))
+			break;
+		return block_reply(b, b->state, &pkt->block);
+	}
+	default:
+		return err_pkt(b, PROTOCOL_ECODE_UNKNOWN_COMMAND);
+	}
+	return err_pkt(b, PROTOCOL_ECODE_INVALID_LEN);
+}
+
+static struct io_plan *read_request(struct io_conn *conn, struct binrpc *b);
+
+static struct io_plan *reply_written(struct io_conn *conn, struct binrpc *b)
+{
+	b->reply = tal_free(b->reply);
+	return read_request(conn, b);
+}
+
+static struct io_plan *request_in(struct io_conn *conn, struct binrpc *b)
+{
+	const struct protocol_net_hdr *hdr = b->incoming;
+
+	log_debug(b->log, "request ");
+	log_add_enum(b->log, enum protocol_pkt_type, le32_to_cpu(hdr->type));
+
+	tal_steal(b, b->incoming);
+	b->reply = handle_pkt(b);
+	b->incoming = tal_free(b->incoming);
+
+	/* Submitting a tx may have changed things. */
+	recheck_pending_txs(b->state);
+
+	return io_write(conn, b->reply, le32_to_cpu(*(le32 *)b->reply),
+			reply_written, b);
+}
+
+static struct io_plan *read_request(struct io_conn *conn, struct binrpc *b)
+{
+	return io_read_packet(conn, &b->incoming, request_in, b);
+}
+
+static void finish_binrpc(struct io_conn *conn, struct binrpc *b)
+{
+	log_info(b->log, "Closing (%s)", strerror(errno));
+	tal_free(b);
+}
+
+struct io_plan *binrpc_connected(struct io_conn *conn, struct state *state)
+{
+	struct binrpc *b = tal(state, struct binrpc);
+
+	b->state = state;
+	b->incoming = b->reply = NULL;
+	b->log = new_log(b, state->lr, "%sbinrpc fd %i:",
+			 log_prefix(state->log), io_conn_fd(conn));
+	io_set_finish(conn, finish_binrpc, b);
+
+	return read_request(conn, b);
+}
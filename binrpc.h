@@ -0,0 +1,20 @@
+#ifndef PETTYCOIN_BINRPC_H
+#define PETTYCOIN_BINRPC_H
+#include "config.h"
+#include <ccan/io/io.h>
+
+struct state;
+
+/* A client which opens the rpc socket with a single NUL byte speaks
+ * packets, as peers do, rather than JSON.  We answer one at a time:
+ *
+ *  PROTOCOL_PKT_TX => PROTOCOL_PKT_ERR (NONE if it's now pending,
+ *                     BAD_INPUT if add_pending_tx() didn't like it).
+ *  PROTOCOL_PKT_GET_TX => PROTOCOL_PKT_TX or PROTOCOL_PKT_TX_IN_BLOCK.
+ *  PROTOCOL_PKT_GET_BLOCK => PROTOCOL_PKT_BLOCK.
+ *
+ * Anything else gets PROTOCOL_PKT_ERR with PROTOCOL_ECODE_UNKNOWN_COMMAND.
+ */
+struct io_plan *binrpc_connected(struct io_conn *conn, struct state *state);
+
+#endif /* PETTYCOIN_BINRPC_H */
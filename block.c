@@ -17,6 +17,7 @@
 #include "tal_arr.h"
 #include "tal_packet.h"
 #include "tx.h"
+#include "utxo.h"
 #include <ccan/structeq/structeq.h>
 #include <string.h>
 
@@ -25,6 +26,7 @@ static void destroy_block(struct block *b)
 	BN_free(&b->total_work);
 	if (b->prev) {
 		list_del_from(&b->prev->children, &b->sibling);
+		block_invalidate_descendents(b->prev);
 		list_del(&b->list);
 	}
 }
@@ -45,6 +47,7 @@ static struct block *new_block(const tal_t *ctx,
 	block->known_in_a_row = 0;
 	list_head_init(&block->children);
 	block->sha = *sha;
+	block->descendents_valid = false;
 	block->shard = tal_arr(block, struct block_shard *,
 			       num_shards(bi->hdr));
 	for (i = 0; i < num_shards(bi->hdr); i++)
@@ -92,6 +95,8 @@ struct block *block_add(struct state *state,
 
 	/* Link us into parent's children list. */
 	list_add_tail(&block->prev->children, &block->sibling);
+	block_invalidate_descendents(block->prev);
+	utxo_add_block(state, block);
 
 	/* Save it to disk for future use. */ 
 	save_block(state, block);
@@ -43,6 +43,11 @@ struct block {
 
 	/* Cache double SHA of block */
 	struct protocol_block_id sha;
+
+	/* Cache of hash of all descendents (see sync.c), if valid. */
+	bool descendents_valid;
+	struct protocol_double_sha descendents;
+
 	/* Transactions: may not be fully populated. */
 	struct block_shard **shard;
 };
@@ -70,6 +75,16 @@ struct block *block_add(struct state *state,
 			const struct protocol_block_id *sha,
 			const struct block_info *bi);
 
+/* Descendents changed: forget cached hashes of block and its ancestors. */
+static inline void block_invalidate_descendents(struct block *block)
+{
+	/* If one's invalid, so are all its ancestors. */
+	while (block && block->descendents_valid) {
+		block->descendents_valid = false;
+		block = block->prev;
+	}
+}
+
 /* Get tx_idx'th tx inside shard shardnum inside block. */
 union protocol_tx *block_get_tx(const struct block *block, u16 shardnum,
 				u8 txoff);
@@ -1,6 +1,7 @@
 #include "block.h"
 #include "block_shard.h"
 #include "check_tx.h"
+#include "hash_tx.h"
 #include "merkle_txs.h"
 #include "proof.h"
 #include "shard.h"
@@ -20,9 +21,12 @@ struct txptr_with_ref txptr_with_ref(const tal_t *ctx,
 	txlen = tx_len(tx);
 	reflen = num_inputs(tx) * sizeof(struct protocol_input_ref);
 
-	p = tal_alloc_(ctx, txlen + reflen, false, "txptr_with_ref");
+	p = tal_alloc_(ctx, txlen + reflen + sizeof(struct protocol_txrefhash),
+		       false, "txptr_with_ref");
 	memcpy(p, tx, txlen);
 	memcpy(p + txlen, refs, reflen);
+	hash_tx_and_refs(tx, refs,
+			 (struct protocol_txrefhash *)(p + txlen + reflen));
 
 	txp.tx = (union protocol_tx *)p;
 	return txp;
@@ -40,20 +44,16 @@ struct block_shard *new_block_shard(const tal_t *ctx, u16 shardnum, u8 num)
 	return s;
 }
 
-/* If we have the tx, hash it, otherwise return hash. */
+/* Returns the hash, whether we have the tx or just the hash. */
 const struct protocol_txrefhash *
-txrefhash_in_shard(const struct block_shard *s,
-		   u8 txoff,
-		   struct protocol_txrefhash *scratch)
+txrefhash_in_shard(const struct block_shard *s, u8 txoff)
 {
 	assert(txoff < s->size);
 	
 	if (shard_is_tx(s, txoff)) {
-		const union protocol_tx *tx = tx_for(s, txoff);
-		if (!tx)
+		if (!tx_for(s, txoff))
 			return NULL;
-		hash_tx_and_refs(tx, refs_for(s->u[txoff].txp), scratch);
-		return scratch;
+		return txrefhash_for(s->u[txoff].txp);
 	} else
 		return s->u[txoff].hash;
 }
@@ -10,6 +10,7 @@ struct state;
 
 /* Each of these is followed by:
    struct protocol_input_ref ref[num_inputs(tx)];
+   struct protocol_txrefhash hash;
 */
 struct txptr_with_ref {
 	union protocol_tx *tx;
@@ -38,6 +39,15 @@ struct block_shard {
 	/* FIXME: We actually only need the protocol_proof_merkles. */
 	struct protocol_proof **proof;
 
+	/* Merkle tree, once we have all hashes and someone wants it
+	 * (see merkle_txs.c). */
+	struct protocol_double_sha *merkles;
+
+	/* Last prev_txhash() answer, and the address it was for. */
+	bool prev_txhash_valid;
+	u8 prev_txhash;
+	struct protocol_address prev_txhash_addr;
+
 	/* Bits to discriminate the union: 0 = txp, 1 == hash */
 	BITMAP_DECLARE(txp_or_hash, 255);
 
@@ -57,6 +67,14 @@ static inline const struct protocol_input_ref *refs_for(struct txptr_with_ref t)
 	return (struct protocol_input_ref *)p;
 }
 
+/* hash_tx_and_refs() of tx and refs, done once by txptr_with_ref(). */
+static inline const struct protocol_txrefhash *
+txrefhash_for(struct txptr_with_ref t)
+{
+	return (const struct protocol_txrefhash *)
+		(refs_for(t) + num_inputs(t.tx));
+}
+
 static inline const union protocol_tx *tx_for(const struct block_shard *s,
 					      u8 txoff)
 {
@@ -66,7 +84,8 @@ static inline const union protocol_tx *tx_for(const struct block_shard *s,
 		return NULL;
 }
 
-/* Convenient routine to allocate adjacent copied of tx and refs */
+/* Convenient routine to allocate adjacent copied of tx and refs (and
+ * their hash) */
 struct txptr_with_ref txptr_with_ref(const tal_t *ctx,
 				     const union protocol_tx *tx,
 				     const struct protocol_input_ref *refs);
@@ -74,9 +93,7 @@ struct txptr_with_ref txptr_with_ref(const tal_t *ctx,
 
 /* Returns NULL if it we don't have this tx. */
 const struct protocol_txrefhash *
-txrefhash_in_shard(const struct block_shard *shard,
-		   u8 txoff,
-		   struct protocol_txrefhash *scratch);
+txrefhash_in_shard(const struct block_shard *shard, u8 txoff);
 
 /* Do we have every tx in this shard? */
 bool shard_all_known(const struct block_shard *shard);
@@ -37,6 +37,7 @@ static bool load_block(struct state *state, struct protocol_net_hdr *pkt)
 		return false;
 
 	block = block_add(state, prev, &sha, &bi);
+	state->metrics.blocks_loaded++;
 
 	/* Now new block owns the packet. */
 	tal_steal(block, pkt);
@@ -117,6 +118,7 @@ void load_blocks(struct state *state)
 	int fd;
 	struct load_state ls;
 	off_t len;
+	struct timemono start = time_mono();
 
 	fd = open("blockfile", O_RDWR|O_CREAT, 0600);
 	if (fd < 0)
@@ -155,6 +157,8 @@ void load_blocks(struct state *state)
 		log_add(state->log, " ...completed");
 	}
 
+	metric_latency_since(&state->metrics.blockfile_load, start);
+
 	/* If there are any txs we want to know and don't, ask. */
 	get_unknown_contents(state);
 }
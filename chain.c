@@ -12,6 +12,7 @@
 #include "tal_arr.h"
 #include "todo.h"
 #include "tx.h"
+#include "utxo.h"
 #include <ccan/cast/cast.h>
 #include <ccan/structeq/structeq.h>
 #include <ccan/tal/str/str.h>
@@ -221,6 +222,7 @@ static bool update_preferred_chain(struct state *state)
 		return false;
 	}
 	state->preferred_chain = arr[0];
+	utxo_set_tip(state, state->preferred_chain);
 	tal_free(arr);
 	return true;
 }
@@ -372,22 +374,29 @@ static void new_longest(struct state *state, const struct block *block)
 	update_preferred_chain(state);
 }
 
-static void recheck_merkles(struct state *state, struct block *block)
+/* Only the blocks 1, 2, 4 ... 2^(PROTOCOL_PREV_BLOCK_TXHASHES-1) after a
+ * block have a prev_txhash for its shards, so that's as far as we look.
+ * That bounds this walk, so unlike recheck_pending_txs() it's not sliced. */
+static void recheck_merkles(struct state *state, struct block *block,
+			    unsigned int dist)
 {
 	const struct block *bad_prev;
 	u16 bad_prev_shard;
+	struct block *b;
 
-	if (!check_prev_txhashes(state, block, &bad_prev, &bad_prev_shard))
+	/* Power of 2? */
+	if ((dist & (dist - 1)) == 0
+	    && !check_prev_txhashes(state, block, &bad_prev, &bad_prev_shard)) {
 		complain_bad_prev_txhashes(state, block,
 					   bad_prev, bad_prev_shard);
-	else {
-		struct block *b;
-
-		/* FIXME: SLOW: We actually only need to check one byte of
-		 * every 2^N-distance block */
-		list_for_each(&block->children, b, sibling)
-			recheck_merkles(state, b);
+		return;
 	}
+
+	if (dist == 1U << (PROTOCOL_PREV_BLOCK_TXHASHES - 1))
+		return;
+
+	list_for_each(&block->children, b, sibling)
+		recheck_merkles(state, b, dist + 1);
 }
 
 static void update_block_ptrs_new_shard_or_empty(struct state *state,
@@ -397,7 +406,7 @@ static void update_block_ptrs_new_shard_or_empty(struct state *state,
 	struct block *b;
 
 	list_for_each(&block->children, b, sibling)
-		recheck_merkles(state, block);
+		recheck_merkles(state, b, 1);
 }
 
 /* We've added a new block; update state->longest_chains, state->longest_knowns,
@@ -471,6 +480,9 @@ void update_block_ptrs_invalidated(struct state *state,
 	find_longest_descendents(g, &state->longest_chains);
 	update_known(state, cast_const(struct block *, g));
 
+	/* In case preferred_chain is still genesis. */
+	utxo_set_tip(state, state->preferred_chain);
+
 	check_chains(state, false);
 
 	/* We don't need to know anything about this or any decendents. */
@@ -480,9 +492,9 @@ void update_block_ptrs_invalidated(struct state *state,
 	wake_peers(state);
 }
 
-static void json_add_tx(struct json_result *response,
-			const struct block_shard *s,
-			unsigned int txoff)
+static void json_add_shard_tx(struct json_result *response,
+			      const struct block_shard *s,
+			      unsigned int txoff)
 {
 	if (shard_is_tx(s, txoff)) {
 		const union protocol_tx *tx = s->u[txoff].txp.tx;
@@ -577,7 +589,7 @@ static char *json_getblock(struct json_connection *jcon,
 		json_array_start(response, NULL);
 		for (i = 0; i < s->size; i++) {
 			json_object_start(response, NULL);
-			json_add_tx(response, s, i);
+			json_add_shard_tx(response, s, i);
 			json_object_end(response);
 		}
 		json_array_end(response);
@@ -591,7 +603,8 @@ const struct json_command getblock_command = {
 	"getblock",
 	json_getblock,
 	"Get a description of a given block",
-	"hash, version, features_vote, shard_order, nonce1, nonce2, height, fees_to, timestamp, difficulty, prev, next[], merkles[], shards[ [{tx,refs[]}|{}|{txhash,refhash} ] ]"
+	"hash, version, features_vote, shard_order, nonce1, nonce2, height, fees_to, timestamp, difficulty, prev, next[], merkles[], shards[ [{tx,refs[]}|{}|{txhash,refhash} ] ]",
+	true
 };
 
 static char *json_getblockhash(struct json_connection *jcon,
@@ -36,13 +36,11 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* Returns error if bad.  Not sufficient by itself: see check_tx_order,
- * shard_validate_transactions and check_prev_txhashes! */
-enum protocol_ecode
-check_block_header(struct state *state,
-		   const struct block_info *bi,
-		   struct block **prev,
-		   struct protocol_double_sha *sha)
+static enum protocol_ecode
+check_header(struct state *state,
+	     const struct block_info *bi,
+	     struct block **prev,
+	     struct protocol_double_sha *sha)
 {
 	struct protocol_block_id prevs[PROTOCOL_NUM_PREV_IDS];
 
@@ -91,6 +89,22 @@ check_block_header(struct state *state,
 	return PROTOCOL_ECODE_NONE;
 }
 
+/* Returns error if bad.  Not sufficient by itself: see check_tx_order,
+ * shard_validate_transactions and check_prev_txhashes! */
+enum protocol_ecode
+check_block_header(struct state *state,
+		   const struct block_info *bi,
+		   struct block **prev,
+		   struct protocol_double_sha *sha)
+{
+	struct timemono start = time_mono();
+	enum protocol_ecode e;
+
+	e = check_header(state, bi, prev, sha);
+	metric_latency_since(&state->metrics.block_check, start);
+	return e;
+}
+
 bool shard_belongs_in_block(const struct block *block,
 			    const struct block_shard *shard)
 {
@@ -205,13 +219,13 @@ static void check_resolved_txs(struct state *state,
 	}
 }
 
-void put_tx_in_shard(struct state *state,
-		     const struct peer *source,
-		     struct block *block,
-		     struct block_shard *shard, u8 txoff,
-		     struct txptr_with_ref txp)
+/* Caller does check_block_shard() afterwards. */
+static void add_tx_to_shard(struct state *state,
+			    const struct peer *source,
+			    struct block *block,
+			    struct block_shard *shard, u8 txoff,
+			    struct txptr_with_ref txp)
 {
-
 	if (shard_is_tx(shard, txoff)) {
 		if (tx_for(shard, txoff)) {
 			/* It's already there?  Leave it alone. */
@@ -224,14 +238,17 @@ void put_tx_in_shard(struct state *state,
 		add_tx_to_hashes(state, shard, block, shard->shardnum, txoff,
 				 txp.tx);
 	} else {
-		struct protocol_txrefhash hashes;
+		const struct protocol_txrefhash *hashes = txrefhash_for(txp);
 
 		/* We knew hash: tx must match hash. */
-		hash_tx_and_refs(txp.tx, refs_for(txp), &hashes);
-		assert(structeq(shard->u[txoff].hash, &hashes));
+		assert(structeq(shard->u[txoff].hash, hashes));
 		shard->hashcount--;
 
-		upgrade_tx_in_hashes(state, &hashes.txhash, txp.tx);
+		upgrade_tx_in_hashes(state, block, shard->shardnum, txoff,
+				     &hashes->txhash, txp.tx);
+
+		/* txp has its own copy. */
+		tal_free(shard->u[txoff].hash);
 	}
 
 	/* Now it's a transaction. */
@@ -258,21 +275,30 @@ void put_tx_in_shard(struct state *state,
 
 	/* Tell peers about the new tx in block. */
 	send_tx_in_block_to_peers(state, source, block, shard->shardnum, txoff);
+}
+
+void put_tx_in_shard(struct state *state,
+		     const struct peer *source,
+		     struct block *block,
+		     struct block_shard *shard, u8 txoff,
+		     struct txptr_with_ref txp)
+{
+	add_tx_to_shard(state, source, block, shard, txoff, txp);
 
 	/* Debugging check */
 	check_block_shard(state, block, shard);
 }
 
-bool put_txhash_in_shard(struct state *state,
-			 struct block *block, u16 shardnum, u8 txoff,
-			 const struct protocol_txrefhash *txrefhash)
+/* Caller does check_block_shard() afterwards. */
+static bool add_txhash_to_shard(struct state *state,
+				struct block *block, u16 shardnum, u8 txoff,
+				const struct protocol_txrefhash *txrefhash)
 {
 	struct block_shard *shard = block->shard[shardnum];
-	struct protocol_txrefhash scratch;
 	const struct protocol_txrefhash *p;
 
 	/* If we already have it, it must be the same. */
-	p = txrefhash_in_shard(shard, txoff, &scratch);
+	p = txrefhash_in_shard(shard, txoff);
 	if (p) {
 		assert(structeq(p, txrefhash));
 		return false;
@@ -280,7 +306,7 @@ bool put_txhash_in_shard(struct state *state,
 
 	/* Now it's a hash. */
 	bitmap_set_bit(shard->txp_or_hash, txoff);
-	/* FIXME: Free this if we resolve it! */
+	/* Freed by put_tx_in_shard if we resolve it. */
 	shard->u[txoff].hash
 		= tal_dup(shard, struct protocol_txrefhash, txrefhash, 1, 0);
 	shard->hashcount++;
@@ -295,10 +321,43 @@ bool put_txhash_in_shard(struct state *state,
 	/* This could eliminate a pending tx. */
 	state->pending->needs_recheck = true;
 
+	return true;
+}
+
+bool put_txhash_in_shard(struct state *state,
+			 struct block *block, u16 shardnum, u8 txoff,
+			 const struct protocol_txrefhash *txrefhash)
+{
+	bool added;
+
+	added = add_txhash_to_shard(state, block, shardnum, txoff, txrefhash);
+
 	/* Debugging check */
-	check_block_shard(state, block, shard);
+	check_block_shard(state, block, block->shard[shardnum]);
 
-	return true;
+	return added;
+}
+
+void put_shard_in_block(struct state *state,
+			const struct peer *source,
+			struct block *block, u16 shardnum,
+			const struct protocol_txrefhash *hashes,
+			const struct txptr_with_ref *txp, unsigned int num)
+{
+	struct block_shard *shard = block->shard[shardnum];
+	unsigned int i;
+
+	for (i = 0; i < shard->size; i++)
+		add_txhash_to_shard(state, block, shardnum, i, &hashes[i]);
+
+	/* Adding a tx can find a bad input elsewhere in this block. */
+	for (i = 0; i < num && !block->complaint; i++) {
+		if (txp[i].tx)
+			add_tx_to_shard(state, source, block, shard, i, txp[i]);
+	}
+
+	/* Debugging check, once rather than per tx. */
+	check_block_shard(state, block, shard);
 }
 
 void put_proof_in_shard(struct state *state,
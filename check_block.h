@@ -47,6 +47,14 @@ bool put_txhash_in_shard(struct state *state,
 			 struct block *block, u16 shardnum, u8 txoff,
 			 const struct protocol_txrefhash *txrefhash);
 
+/* Put all of a shard's hashes in, then txp[0] to txp[num-1] (where
+ * txp.tx is non-NULL).  You normally check ordering of those first! */
+void put_shard_in_block(struct state *state,
+			const struct peer *source,
+			struct block *block, u16 shardnum,
+			const struct protocol_txrefhash *hashes,
+			const struct txptr_with_ref *txp, unsigned int num);
+
 /* After you've put in tx, you put in proof. */
 void put_proof_in_shard(struct state *state,
 			struct block *block,
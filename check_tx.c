@@ -13,6 +13,7 @@
 #include "state.h"
 #include "tx.h"
 #include "tx_in_hashes.h"
+#include "utxo.h"
 #include "version.h"
 #include <assert.h>
 #include <ccan/endian/endian.h>
@@ -108,6 +109,11 @@ struct txhash_elem *tx_find_doublespend(struct state *state,
 {
 	struct inputhash_elem *ie;
 	struct inputhash_iter iter;
+	struct txhash_elem *spend;
+
+	/* Usually block is in preferred chain: that's a single lookup. */
+	if (utxo_find_spend(&state->utxo, block, me, inp, &spend))
+		return spend;
 
 	/* Check it wasn't already spent. */
 	for (ie = inputhash_firstval(&state->inputhash, &inp->input,
@@ -396,7 +402,9 @@ enum protocol_ecode check_tx(struct state *state,
 		break;
 	}
 
+	state->metrics.txs_checked++;
 	if (e) {
+		state->metrics.txs_bad++;
 		log_debug(state->log, "It was bad: ");
 		log_add_enum(state->log, enum protocol_ecode, e);
 	}
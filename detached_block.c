@@ -1,54 +1,54 @@
 #include "block.h"
 #include "detached_block.h"
 #include "jsonrpc.h"
+#include "log.h"
 #include "protocol_net.h"
 #include "recv_block.h"
 #include "state.h"
 #include <ccan/list/list.h>
 
-/* Blocks which are not fully linked in. */
-struct detached_block {
-	/* Off state->detached_blocks */
-	struct list_node list;
-	struct protocol_block_id sha;
-
-	struct block_info bi;
-	const tal_t *pkt_ctx;	
-};
+/* Each holds a whole block packet; don't let peers fill memory with them. */
+#define MAX_DETACHED_BLOCKS 4096
 
+static void unindex_detached_block(struct state *state,
+				   struct detached_block *bd)
+{
+	detached_sha_hash_del(&state->detached_by_sha, bd);
+	detached_prev_hash_del(&state->detached_by_prev, bd);
+	list_del_from(&state->detached_blocks, &bd->list);
+	state->num_detached--;
+}
 
-/* We got a new block: seek detached blocks which need it (may recurse!) */
+/* We got a new block: reinject detached blocks which need it. */
 void seek_detached_blocks(struct state *state, const struct block *block)
 {
 	struct detached_block *bd;
+	bool draining = !list_empty(&state->detached_queue);
 
-again:
-	list_for_each(&state->detached_blocks, bd, list) {
-		if (structeq(block_prev(&bd->bi, 0), &block->sha)) {
-			list_del_from(&state->detached_blocks, &bd->list);
+	while ((bd = detached_prev_hash_get(&state->detached_by_prev,
+					    &block->sha)) != NULL) {
+		unindex_detached_block(state, bd);
+		list_add_tail(&state->detached_queue, &bd->list);
+	}
 
-			log_debug(state->log, "Reinjecting detatched block");
-			/* Inject it through normal path. */
-			recv_block_reinject(state, bd->pkt_ctx,
-					    &bd->bi);
-			tal_free(bd);
+	/* Reinjecting adds blocks, which calls us: the outermost drains. */
+	if (draining)
+		return;
 
-			/* Since that may recurse, we can't trust list. */
-			goto again;
-		}
+	while ((bd = list_top(&state->detached_queue,
+			      struct detached_block, list)) != NULL) {
+		log_debug(state->log, "Reinjecting detatched block");
+		/* Inject it through normal path. */
+		recv_block_reinject(state, bd->pkt_ctx, &bd->bi);
+		list_del_from(&state->detached_queue, &bd->list);
+		tal_free(bd);
 	}
 }
 
 bool have_detached_block(const struct state *state, 
 			 const struct protocol_block_id *sha)
 {
-	struct detached_block *bd;
-
-	list_for_each(&state->detached_blocks, bd, list) {
-		if (structeq(&bd->sha, sha))
-			return true;
-	}
-	return false;
+	return detached_sha_hash_get(&state->detached_by_sha, sha) != NULL;
 }
 
 void add_detached_block(struct state *state,
@@ -58,12 +58,26 @@ void add_detached_block(struct state *state,
 {
 	struct detached_block *bd;
 
+	/* Throw out the oldest if we're full. */
+	if (state->num_detached == MAX_DETACHED_BLOCKS) {
+		bd = list_top(&state->detached_blocks,
+			      struct detached_block, list);
+		log_debug(state->log, "Evicting detached block ");
+		log_add_struct(state->log, struct protocol_block_id, &bd->sha);
+		unindex_detached_block(state, bd);
+		tal_free(bd);
+		state->metrics.detached_evicted++;
+	}
+
 	/* Add it to list of detached blocks. */
 	bd = tal(state, struct detached_block);
 	bd->sha = *sha;
 	bd->bi = *bi;
 	bd->pkt_ctx = tal_steal(bd, pkt_ctx);
-	list_add(&state->detached_blocks, &bd->list);
+	list_add_tail(&state->detached_blocks, &bd->list);
+	detached_sha_hash_add(&state->detached_by_sha, bd);
+	detached_prev_hash_add(&state->detached_by_prev, bd);
+	state->num_detached++;
 }
 
 static char *json_detachedblocks(struct json_connection *jcon,
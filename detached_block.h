@@ -1,17 +1,70 @@
 #ifndef PETTYCOIN_DETACHED_BLOCK_H
 #define PETTYCOIN_DETACHED_BLOCK_H
 #include "config.h"
+#include "block_info.h"
+#include "protocol.h"
+#include <ccan/hash/hash.h>
+#include <ccan/htable/htable_type.h>
+#include <ccan/list/list.h>
+#include <ccan/structeq/structeq.h>
 #include <stdbool.h>
 
 struct block;
 struct state;
-struct protocol_block_id;
-struct block_info;
 struct protocol_pkt_block;
 
+/* Blocks which are not fully linked in. */
+struct detached_block {
+	/* Off state->detached_blocks (oldest first), or the queue. */
+	struct list_node list;
+	struct protocol_block_id sha;
+
+	struct block_info bi;
+	const tal_t *pkt_ctx;
+};
+
+static inline const struct protocol_block_id *
+detached_sha_keyof(const struct detached_block *bd)
+{
+	return &bd->sha;
+}
+
+static inline const struct protocol_block_id *
+detached_prev_keyof(const struct detached_block *bd)
+{
+	return block_prev(&bd->bi, 0);
+}
+
+static inline size_t detached_hashfn(const struct protocol_block_id *sha)
+{
+	return hash_any(sha, sizeof(*sha), 0);
+}
+
+static inline bool detached_sha_eq(const struct detached_block *bd,
+				   const struct protocol_block_id *sha)
+{
+	return structeq(&bd->sha, sha);
+}
+
+static inline bool detached_prev_eq(const struct detached_block *bd,
+				    const struct protocol_block_id *sha)
+{
+	return structeq(block_prev(&bd->bi, 0), sha);
+}
+
+/* Each detached block by its own id... */
+HTABLE_DEFINE_TYPE(struct detached_block,
+		   detached_sha_keyof, detached_hashfn, detached_sha_eq,
+		   detached_sha_hash);
+
+/* ...and by the prev it's waiting for (many can wait for one). */
+HTABLE_DEFINE_TYPE(struct detached_block,
+		   detached_prev_keyof, detached_hashfn, detached_prev_eq,
+		   detached_prev_hash);
+
 void seek_detached_blocks(struct state *state, const struct block *block);
 
-bool have_detached_block(const struct state *state, 
+bool have_detached_block(const struct state *state,
 			 const struct protocol_block_id *sha);
 
 void add_detached_block(struct state *state,
@@ -92,6 +92,8 @@ static char *json_getpeerinfo(struct json_connection *jcon,
 		json_add_string(response, "last-output-type",
 				pkt_name(peer->last_type_out));
 		json_add_num(response, "last-output-length", peer->last_len_out);
+		json_add_u64(response, "bytessent", peer->bytes_out);
+		json_add_u64(response, "bytesrecv", peer->bytes_in);
 		json_add_bool(response, "output-pending", peer->out_pending);
 
 		pkt = peer->outgoing;
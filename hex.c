@@ -38,18 +38,10 @@ bool from_hex(const char *str, size_t slen, void *buf, size_t bufsize)
 	return slen == 0 && bufsize == 0;
 }
 
-static char hexchar(unsigned int val)
-{
-	if (val < 10)
-		return '0' + val;
-	if (val < 16)
-		return 'a' + val - 10;
-	abort();
-}
-
 size_t to_hex_direct(char *dest, size_t destlen,
 		     const void *buf, size_t bufsize)
 {
+	static const char hexchar[] = "0123456789abcdef";
 	size_t used = 0;
 
 	/* Need room for nul terminator */
@@ -57,8 +49,8 @@ size_t to_hex_direct(char *dest, size_t destlen,
 
 	while (destlen >= 3 && used < bufsize) {
 		unsigned int c = ((const unsigned char *)buf)[used];
-		*(dest++) = hexchar(c >> 4);
-		*(dest++) = hexchar(c & 0xF);
+		*(dest++) = hexchar[c >> 4];
+		*(dest++) = hexchar[c & 0xF];
 		destlen -= 2;
 		used++;
 	}
@@ -59,12 +59,11 @@ enum ref_ecode check_tx_refs(struct state *state,
 	assert(check_refs(state, block, refs, num) == PROTOCOL_ECODE_NONE);
 	for (i = 0; i < num; i++) {
 		struct block *b;
-		struct protocol_txrefhash scratch;
 		const struct protocol_txrefhash *txp;
 
 		b = block_ancestor(block, le32_to_cpu(refs[i].blocks_ago));
 		txp = txrefhash_in_shard(b->shard[le16_to_cpu(refs[i].shard)],
-					 refs[i].txoff, &scratch);
+					 refs[i].txoff);
 		if (!txp) {
 			*bad_ref = i;
 			*block_referred_to = b;
@@ -7,6 +7,7 @@
 #include <ccan/tal/str/str.h>
 #include <ccan/tal/tal.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -15,7 +16,8 @@
 
 struct json_result {
 	unsigned int indent;
-	/* tal_count() of this is strlen() + 1 */
+	/* strlen(s); tal_count(s) is how much room we have. */
+	size_t len;
 	char *s;
 };
 
@@ -226,37 +228,58 @@ again:
 	return toks;
 }
 
-static void result_append(struct json_result *res, const char *str)
+/* Double the buffer as needed, so big results don't realloc every time. */
+static void result_reserve(struct json_result *res, size_t extra)
 {
-	size_t len = tal_count(res->s) - 1;
+	size_t room = tal_count(res->s);
+
+	if (res->len + extra + 1 <= room)
+		return;
 
-	tal_resize(&res->s, len + strlen(str) + 1);
-	strcpy(res->s + len, str);
+	while (res->len + extra + 1 > room)
+		room *= 2;
+	tal_resize(&res->s, room);
+}
+
+static void result_append_len(struct json_result *res,
+			      const char *str, size_t len)
+{
+	result_reserve(res, len);
+	memcpy(res->s + res->len, str, len);
+	res->len += len;
+	res->s[res->len] = '\0';
+}
+
+static void result_append(struct json_result *res, const char *str)
+{
+	result_append_len(res, str, strlen(str));
 }
 
 static void PRINTF_FMT(2,3)
 result_append_fmt(struct json_result *res, const char *fmt, ...)
 {
-	size_t len = tal_count(res->s) - 1, fmtlen;
+	size_t room = tal_count(res->s) - res->len, fmtlen;
 	va_list ap;
 
+	/* Usually it fits in what's left, so we only format once. */
 	va_start(ap, fmt);
-	fmtlen = vsnprintf(NULL, 0, fmt, ap);
+	fmtlen = vsnprintf(res->s + res->len, room, fmt, ap);
 	va_end(ap);
 
-	tal_resize(&res->s, len + fmtlen + 1);
-	va_start(ap, fmt);
-	vsprintf(res->s + len, fmt, ap);
-	va_end(ap);
+	if (fmtlen >= room) {
+		result_reserve(res, fmtlen);
+		va_start(ap, fmt);
+		vsprintf(res->s + res->len, fmt, ap);
+		va_end(ap);
+	}
+	res->len += fmtlen;
 }
 
 static bool result_ends_with(struct json_result *res, const char *str)
 {
-	size_t len = tal_count(res->s) - 1;
-
-	if (strlen(str) > len)
+	if (strlen(str) > res->len)
 		return false;
-	return streq(res->s + len - strlen(str), str);
+	return streq(res->s + res->len - strlen(str), str);
 }
 
 static void json_start_member(struct json_result *result, const char *fieldname)
@@ -316,11 +339,18 @@ void json_add_num(struct json_result *result, const char *fieldname, unsigned in
 	result_append_fmt(result, "%u", value);
 }
 
+void json_add_u64(struct json_result *result, const char *fieldname,
+		  u64 value)
+{
+	json_start_member(result, fieldname);
+	result_append_fmt(result, "%"PRIu64, value);
+}
+
 void json_add_literal(struct json_result *result, const char *fieldname,
 		      const char *literal, int len)
 {
 	json_start_member(result, fieldname);
-	result_append_fmt(result, "%.*s", len, literal);
+	result_append_len(result, literal, len);
 }
 
 void json_add_string(struct json_result *result, const char *fieldname, const char *value)
@@ -413,7 +443,8 @@ struct json_result *new_json_result(const tal_t *ctx)
 	struct json_result *r = tal(ctx, struct json_result);
 
 	/* Using tal_arr means that it has a valid count. */
-	r->s = tal_arrz(r, char, 1);
+	r->s = tal_arrz(r, char, 64);
+	r->len = 0;
 	r->indent = 0;
 	return r;
 }
@@ -421,6 +452,6 @@ struct json_result *new_json_result(const tal_t *ctx)
 const char *json_result_string(const struct json_result *result)
 {
 	assert(!result->indent);
-	assert(tal_count(result->s) == strlen(result->s) + 1);
+	assert(result->len == strlen(result->s));
 	return result->s;
 }
@@ -3,8 +3,11 @@
 #include "config.h"
 #include "stdbool.h"
 #include "stdlib.h"
+#include <ccan/short_types/short_types.h>
 #include <ccan/tal/tal.h>
 
+/* Strict also means a primitive cut off by the end of the buffer is
+ * JSMN_ERROR_PART, not a short token: read_json() relies on that. */
 #define JSMN_STRICT 1
 # include "jsmn/jsmn.h"
 
@@ -79,6 +82,9 @@ void json_add_literal(struct json_result *result, const char *fieldname,
 /* '"fieldname" : value' or 'value' if fieldname is NULL */
 void json_add_num(struct json_result *result, const char *fieldname,
 		  unsigned int value);
+/* '"fieldname" : value' or 'value' if fieldname is NULL */
+void json_add_u64(struct json_result *result, const char *fieldname,
+		  u64 value);
 /* '"fieldname" : true|false' or 'true|false' if fieldname is NULL */
 void json_add_bool(struct json_result *result, const char *fieldname,
 		   bool value);
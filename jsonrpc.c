@@ -1,31 +1,40 @@
 /* Code for JSON_RPC API */
 /* eg: { "method" : "echo", "params" : [ "hello", "Arabella!" ], "id" : "1" } */
+#include "binrpc.h"
 #include "hex.h"
 #include "json.h"
 #include "jsonrpc.h"
 #include "log.h"
+#include "peer.h"
 #include "state.h"
 #include <ccan/array_size/array_size.h>
+#include <ccan/endian/endian.h>
 #include <ccan/err/err.h>
 #include <ccan/io/io.h>
 #include <ccan/read_write_all/read_write_all.h>
 #include <ccan/tal/str/str.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 struct json_output {
 	struct list_node list;
+	/* NULL while a snapshot child is still working on it. */
 	const char *json;
 };
 
 static void finish_jcon(struct io_conn *conn, struct json_connection *jcon)
 {
 	log_info(jcon->log, "Closing (%s)", strerror(errno));
+	/* This also removes any watches. */
+	tal_free(jcon);
 }
 
 static char *json_help(struct json_connection *jcon,
@@ -186,11 +195,55 @@ static const struct json_command getlog_command = {
 	"Returns log array"
 };
 
+static char *json_setlogio(struct json_connection *jcon,
+			   const jsmntok_t *params,
+			   struct json_result *response)
+{
+	struct state *state = jcon->state;
+	jsmntok_t *every, *peernum;
+	unsigned int n, num;
+	struct peer *peer;
+
+	json_get_params(jcon->buffer, params, "every", &every,
+			"peer", &peernum, NULL);
+	if (!every)
+		return "Need every param";
+	if (!json_tok_number(jcon->buffer, every, &n))
+		return "every must be a number";
+
+	if (peernum) {
+		if (!json_tok_number(jcon->buffer, peernum, &num))
+			return "peer must be a number";
+		list_for_each(&state->peers, peer, list) {
+			if (peer->peer_num == num) {
+				set_log_io(peer->log, n);
+				return NULL;
+			}
+		}
+		return "Unknown peer";
+	}
+
+	/* Everyone, including those yet to come. */
+	set_log_io_default(state->lr, n);
+	list_for_each(&state->peers, peer, list)
+		set_log_io(peer->log, n);
+	return NULL;
+}
+
+static const struct json_command setlogio_command = {
+	"setlogio",
+	json_setlogio,
+	"Keep one in <every> packets in the log (0 for none)",
+	"[<peer>] limits it to that peer (see getpeerinfo)"
+};
+
 static const struct json_command *cmdlist[] = {
 	&help_command, &getinfo_command, &sendrawtransaction_command,
 	&stop_command, &listtransactions_command, &getblock_command,
 	&getblockhash_command, &submitblock_command, &gettransaction_command,
-	&getpeerinfo_command, &getlog_command,
+	&getpeerinfo_command, &getlog_command, &setlogio_command,
+	&getmetrics_command,
+	&watchaddress_command, &unwatchaddress_command,
 	/* Developer/debugging options. */
 	&echo_command, &listtodo_command, &detachedblocks_command
 };
@@ -227,17 +280,204 @@ static const struct json_command *find_cmd(const char *buffer,
 	return NULL;
 }
 
-/* Returns NULL if it's a fatal error. */
-static char *parse_request(struct json_connection *jcon, const jsmntok_t tok[])
+static char *run_command(struct json_connection *jcon,
+			 const struct json_command *cmd,
+			 const jsmntok_t *params,
+			 const jsmntok_t *id)
+{
+	struct json_result *result;
+	char *error;
+
+	result = new_json_result(jcon);
+	error = cmd->dispatch(jcon, params, result);
+	if (error) {
+		char *quote;
+
+		/* Remove " */
+		while ((quote = strchr(error, '"')) != NULL)
+			*quote = '\'';
+
+		return tal_fmt(jcon,
+			      "{ \"result\" : null,"
+			      " \"error\" : \"%s\","
+			      " \"id\" : %.*s }\n",
+			      error,
+			      json_tok_len(id),
+			      json_tok_contents(jcon->buffer, id));
+	}
+	return tal_fmt(jcon,
+		       "{ \"result\" : %s,"
+		       " \"error\" : null,"
+		       " \"id\" : %.*s }\n",
+		       json_result_string(result),
+		       json_tok_len(id),
+		       json_tok_contents(jcon->buffer, id));
+}
+
+
+/* Read-only commands which take a while run in a child: fork() gives
+ * it a consistent snapshot of state, and we keep handling packets.
+ * Each child costs a copy of every page we write meanwhile, so beyond
+ * these we just run the command ourselves. */
+#define MAX_SNAPSHOTS_PER_JCON 2
+#define MAX_SNAPSHOTS 8
+
+static unsigned int num_snapshots;
+
+struct json_snapshot {
+	/* Both NULL if jcon went away first. */
+	struct json_connection *jcon;
+	struct json_output *out;
+	/* Off out, so we hear if it's freed. */
+	struct json_snapshot **link;
+	pid_t pid;
+	le32 len;
+	char *reply;
+	const char *failed;
+};
+
+/* The conn isn't ours to free, so just stop talking to jcon. */
+static void detach_snapshot(struct json_snapshot **link)
+{
+	struct json_snapshot *snap = *link;
+
+	snap->jcon->num_snapshots--;
+	snap->jcon = NULL;
+	snap->out = NULL;
+}
+
+static void finish_snapshot(struct io_conn *conn, struct json_snapshot *snap)
+{
+	/* It's harmless if it's already exited. */
+	kill(snap->pid, SIGKILL);
+	waitpid(snap->pid, NULL, 0);
+	num_snapshots--;
+
+	if (snap->out) {
+		if (!snap->out->json) {
+			log_unusual(snap->jcon->log, "Snapshot child %i failed",
+				    (int)snap->pid);
+			snap->out->json = snap->failed;
+			io_wake(snap->jcon);
+		}
+		snap->jcon->num_snapshots--;
+		tal_del_destructor(snap->link, detach_snapshot);
+	}
+	tal_free(snap);
+}
+
+static struct io_plan *snapshot_done(struct io_conn *conn,
+				     struct json_snapshot *snap)
+{
+	if (snap->out) {
+		snap->out->json = tal_steal(snap->out, snap->reply);
+		io_wake(snap->jcon);
+	}
+	return io_close(conn);
+}
+
+static struct io_plan *snapshot_read_reply(struct io_conn *conn,
+					   struct json_snapshot *snap)
+{
+	snap->reply = tal_arrz(snap, char, le32_to_cpu(snap->len) + 1);
+	return io_read(conn, snap->reply, le32_to_cpu(snap->len),
+		       snapshot_done, snap);
+}
+
+static struct io_plan *snapshot_read_len(struct io_conn *conn,
+					 struct json_snapshot *snap)
+{
+	io_set_finish(conn, finish_snapshot, snap);
+	return io_read(conn, &snap->len, sizeof(snap->len),
+		       snapshot_read_reply, snap);
+}
+
+/* Returns false if we couldn't (or shouldn't) fork: just run it
+ * ourselves. */
+static bool start_snapshot(struct json_connection *jcon,
+			   const struct json_command *cmd,
+			   const jsmntok_t *params,
+			   const jsmntok_t *id,
+			   struct json_output *out)
+{
+	struct json_snapshot *snap;
+	int fds[2];
+
+	if (num_snapshots >= MAX_SNAPSHOTS
+	    || jcon->num_snapshots >= MAX_SNAPSHOTS_PER_JCON) {
+		log_debug(jcon->log, "Too many snapshots: running %s directly",
+			  cmd->name);
+		return false;
+	}
+
+	if (pipe(fds) != 0) {
+		log_unusual(jcon->log, "Creating snapshot pipe: %s",
+			    strerror(errno));
+		return false;
+	}
+
+	/* The conn can outlive jcon: it has to reap the child. */
+	snap = tal(jcon->state, struct json_snapshot);
+	snap->jcon = jcon;
+	snap->out = out;
+	snap->failed = tal_fmt(out,
+			       "{ \"result\" : null,"
+			       " \"error\" : \"%s failed\","
+			       " \"id\" : %.*s }\n",
+			       cmd->name,
+			       json_tok_len(id),
+			       json_tok_contents(jcon->buffer, id));
+
+	fflush(stdout);
+	snap->pid = fork();
+	switch (snap->pid) {
+	case -1:
+		log_unusual(jcon->log, "Forking for %s: %s",
+			    cmd->name, strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		tal_free(snap);
+		return false;
+	case 0: {
+		const char *reply;
+		le32 len;
+
+		log_record_private(jcon->state->lr);
+		reply = run_command(jcon, cmd, params, id);
+		len = cpu_to_le32(strlen(reply));
+
+		close(fds[0]);
+		if (!write_all(fds[1], &len, sizeof(len))
+		    || !write_all(fds[1], reply, strlen(reply)))
+			_exit(1);
+		/* Don't run atexit handlers, or flush stdio we inherited. */
+		_exit(0);
+	}
+	}
+
+	close(fds[1]);
+	num_snapshots++;
+	jcon->num_snapshots++;
+	snap->link = tal(out, struct json_snapshot *);
+	*snap->link = snap;
+	tal_add_destructor(snap->link, detach_snapshot);
+	/* Reply stays pending (json NULL) until the child is done. */
+	out->json = NULL;
+	io_new_conn(jcon->state, fds[0], snapshot_read_len, snap);
+	return true;
+}
+
+/* Returns false if it's a fatal error.  Inside a batch we want the
+ * answer now, so no snapshot children. */
+static bool parse_request(struct json_connection *jcon, const jsmntok_t tok[],
+			  struct json_output *out, bool in_batch)
 {
 	const jsmntok_t *method, *id, *params;
 	const struct json_command *cmd;
-	char *error;
-	struct json_result *result;
 
 	if (tok[0].type != JSMN_OBJECT) {
 		log_unusual(jcon->log, "Expected {} for json command");
-		return NULL;
+		return false;
 	}
 
 	method = json_get_member(jcon->buffer, tok, "method");
@@ -247,60 +487,91 @@ static char *parse_request(struct json_connection *jcon, const jsmntok_t tok[])
 	if (!id || !method || !params) {
 		log_unusual(jcon->log, "json: No %s",
 			    !id ? "id" : (!method ? "method" : "params"));
-		return NULL;
+		return false;
 	}
 
 	if (id->type != JSMN_STRING && id->type != JSMN_PRIMITIVE) {
 		log_unusual(jcon->log, "Expected string/primitive for id");
-		return NULL;
+		return false;
 	}
 
 	if (method->type != JSMN_STRING) {
 		log_unusual(jcon->log, "Expected string for method");
-		return NULL;
+		return false;
 	}
 
 	cmd = find_cmd(jcon->buffer, method);
 	if (!cmd) {
-		return tal_fmt(jcon,
-			      "{ \"result\" : null,"
-			      " \"error\" : \"Unknown command '%.*s'\","
-			      " \"id\" : %.*s }\n",
-			      (int)(method->end - method->start),
-			      jcon->buffer + method->start,
-			      json_tok_len(id),
-			      json_tok_contents(jcon->buffer, id));
+		out->json = tal_fmt(out,
+				    "{ \"result\" : null,"
+				    " \"error\" : \"Unknown command '%.*s'\","
+				    " \"id\" : %.*s }\n",
+				    (int)(method->end - method->start),
+				    jcon->buffer + method->start,
+				    json_tok_len(id),
+				    json_tok_contents(jcon->buffer, id));
+		return true;
 	}
 
 	if (params->type != JSMN_ARRAY && params->type != JSMN_OBJECT) {
 		log_unusual(jcon->log, "Expected array or object for params");
-		return NULL;
+		return false;
 	}
 
-	result = new_json_result(jcon);
-	error = cmd->dispatch(jcon, params, result);
-	if (error) {
-		char *quote;
+	if (cmd->snapshot && !in_batch
+	    && start_snapshot(jcon, cmd, params, id, out))
+		return true;
 
-		/* Remove " */
-		while ((quote = strchr(error, '"')) != NULL)
-			*quote = '\'';
+	out->json = run_command(jcon, cmd, params, id);
+	return true;
+}
 
-		return tal_fmt(jcon,
-			      "{ \"result\" : null,"
-			      " \"error\" : \"%s\","
-			      " \"id\" : %.*s }\n",
-			      error,
-			      json_tok_len(id),
-			      json_tok_contents(jcon->buffer, id));
+/* [ req, req... ] gets [ reply, reply... ] */
+static bool parse_batch(struct json_connection *jcon, const jsmntok_t tok[],
+			struct json_output *out)
+{
+	const jsmntok_t *t, *end = json_next(tok);
+	char *reply;
+
+	if (tok->size == 0) {
+		log_unusual(jcon->log, "Empty json batch");
+		return false;
 	}
-	return tal_fmt(jcon,
-		       "{ \"result\" : %s,"
-		       " \"error\" : null,"
-		       " \"id\" : %.*s }\n",
-		       json_result_string(result),
-		       json_tok_len(id),
-		       json_tok_contents(jcon->buffer, id));
+
+	reply = tal_strdup(out, "[ ");
+	for (t = tok + 1; t < end; t = json_next(t)) {
+		struct json_output *one = tal(out, struct json_output);
+
+		/* A bad one only spoils its own reply. */
+		if (!parse_request(jcon, t, one, true))
+			one->json = "{ \"result\" : null,"
+				" \"error\" : \"Invalid request\","
+				" \"id\" : null }\n";
+
+		/* Drop each one's trailing \n. */
+		tal_append_fmt(&reply, "%s%.*s", t == tok + 1 ? "" : ", ",
+			       (int)strlen(one->json) - 1, one->json);
+		tal_free(one);
+	}
+	tal_append_fmt(&reply, " ]\n");
+	out->json = reply;
+	return true;
+}
+
+void json_notify(struct json_connection *jcon, const char *result)
+{
+	struct json_output *out = tal(jcon, struct json_output);
+
+	/* Like a request from us: id is null, so no reply expected. */
+	out->json = tal_fmt(out,
+			    "{ \"method\" : \"notify\","
+			    " \"params\" : %s,"
+			    " \"id\" : null }\n",
+			    result);
+
+	/* Queue for writing, and wake writer. */
+	list_add_tail(&jcon->output, &out->list);
+	io_wake(jcon);
 }
 
 static struct io_plan *write_json(struct io_conn *conn,
@@ -308,7 +579,11 @@ static struct io_plan *write_json(struct io_conn *conn,
 {
 	struct json_output *out;
 	
-	out = list_pop(&jcon->output, struct json_output, list);
+	/* Replies go in order, so wait if the next one isn't ready. */
+	out = list_top(&jcon->output, struct json_output, list);
+	if (out && !out->json)
+		return io_out_wait(conn, jcon, write_json, jcon);
+
 	if (!out) {
 		if (jcon->stop) {
 			log_unusual(jcon->log, "JSON-RPC shutdown");
@@ -322,6 +597,7 @@ static struct io_plan *write_json(struct io_conn *conn,
 		return io_out_wait(conn, jcon, write_json, jcon);
 	}
 
+	list_del_from(&jcon->output, &out->list);
 	jcon->outbuf = tal_steal(jcon, out->json);
 	tal_free(out);
 
@@ -330,64 +606,122 @@ static struct io_plan *write_json(struct io_conn *conn,
 			jcon->outbuf, strlen(jcon->outbuf), write_json, jcon);
 }
 
+static void init_json_parse(struct json_connection *jcon)
+{
+	jsmn_init(&jcon->parser);
+	jcon->toks = tal_arr(jcon, jsmntok_t, 10);
+}
+
+/* Forget the first toknum tokens and len bytes: they're done. */
+static void consume_json(struct json_connection *jcon,
+			 size_t toknum, size_t len)
+{
+	size_t i, remaining = jcon->parser.toknext - toknum;
+
+	memmove(jcon->toks, jcon->toks + toknum, remaining * sizeof(jsmntok_t));
+	for (i = 0; i < remaining; i++) {
+		jcon->toks[i].start -= len;
+		/* Still open? */
+		if (jcon->toks[i].end != -1)
+			jcon->toks[i].end -= len;
+	}
+	jcon->parser.toknext = remaining;
+	if (jcon->parser.toksuper != -1)
+		jcon->parser.toksuper -= toknum;
+	jcon->parser.pos -= len;
+
+	memmove(jcon->buffer, jcon->buffer + len, jcon->used - len);
+	jcon->used -= len;
+}
+
 static struct io_plan *read_json(struct io_conn *conn,
 				 struct json_connection *jcon)
 {
-	jsmntok_t *toks;
-	bool valid;
-	struct json_output *out;
+	jsmnerr_t ret;
+	size_t done = 0, consumed = 0;
 
 	log_io(jcon->log, true, jcon->buffer + jcon->used, jcon->len_read);
-
-	/* Resize larger if we're full. */
 	jcon->used += jcon->len_read;
-	if (jcon->used == tal_count(jcon->buffer))
-		tal_resize(&jcon->buffer, jcon->used * 2);
 
-again:
-	toks = json_parse_input(jcon->buffer, jcon->used, &valid);
-	if (!toks) {
-		if (!valid) {
-			log_unusual(jcon->state->log,
-				    "Invalid token in json input: '%.*s'",
-				    (int)jcon->used, jcon->buffer);
-			return io_close(conn);
-		}
-		/* We need more. */
-		goto read_more;
-	}
+	/* Only parses the new part. */
+	while ((ret = jsmn_parse(&jcon->parser, jcon->buffer, jcon->used,
+				 jcon->toks, tal_count(jcon->toks) - 1))
+	       == JSMN_ERROR_NOMEM)
+		tal_resize(&jcon->toks, tal_count(jcon->toks) * 2);
 
-	/* Empty buffer? (eg. just whitespace). */
-	if (tal_count(toks) == 1) {
-		jcon->used = 0;
-		goto read_more;
+	if (ret == JSMN_ERROR_INVAL) {
+		log_unusual(jcon->state->log,
+			    "Invalid token in json input: '%.*s'",
+			    (int)jcon->used, jcon->buffer);
+		return io_close(conn);
 	}
 
-	out = tal(jcon, struct json_output);
-	out->json = parse_request(jcon, toks);
-	if (!out->json)
-		return io_close(conn);
+	/* Handle every request which is complete so far. */
+	while (done < jcon->parser.toknext && jcon->toks[done].end != -1) {
+		const jsmntok_t *tok = jcon->toks + done;
+		size_t num = json_next(tok) - tok;
+		struct json_output *out = tal(jcon, struct json_output);
+		bool ok;
+
+		/* Make sure next one is always referencable. */
+		if (done + num == jcon->parser.toknext) {
+			jcon->toks[done + num].type = -1;
+			jcon->toks[done + num].start = jcon->toks[done + num].end
+				= jcon->toks[done + num].size = 0;
+		}
 
-	/* Remove first {}. */
-	memmove(jcon->buffer, jcon->buffer + toks[0].end,
-		tal_count(jcon->buffer) - toks[0].end);
-	jcon->used -= toks[0].end;
-	tal_free(toks);
+		if (tok->type == JSMN_ARRAY)
+			ok = parse_batch(jcon, tok, out);
+		else
+			ok = parse_request(jcon, tok, out, false);
+		if (!ok)
+			return io_close(conn);
 
-	/* Queue for writing, and wake writer. */
-	list_add_tail(&jcon->output, &out->list);
-	io_wake(jcon);
+		/* Queue for writing, and wake writer. */
+		list_add_tail(&jcon->output, &out->list);
+		io_wake(jcon);
+
+		done += num;
+		consumed = tok->end;
+	}
+
+	/* Nothing half-parsed?  Then we're done with everything so far
+	 * (eg. whitespace). */
+	if (done == jcon->parser.toknext)
+		consumed = jcon->parser.pos;
+	consume_json(jcon, done, consumed);
 
-	/* See if we can parse the rest. */
-	goto again;
+	/* Resize larger if we're full. */
+	if (jcon->used == tal_count(jcon->buffer))
+		tal_resize(&jcon->buffer, jcon->used * 2);
 
-read_more:
-	tal_free(toks);
 	return io_read_partial(conn, jcon->buffer + jcon->used,
 			       tal_count(jcon->buffer) - jcon->used,
 			       &jcon->len_read, read_json, jcon);
 }
 
+static struct io_plan *first_byte(struct io_conn *conn,
+				  struct json_connection *jcon)
+{
+	/* JSON never starts with a NUL: that means binary. */
+	if (jcon->buffer[0] == '\0') {
+		struct state *state = jcon->state;
+
+		log_debug(jcon->log, "Switching to binary");
+		tal_free(jcon);
+		/* This replaces our finish_jcon. */
+		return binrpc_connected(conn, state);
+	}
+
+	log_io(jcon->log, true, jcon->buffer, 1);
+	jcon->used = 1;
+	return io_duplex(conn,
+			 io_read_partial(conn, jcon->buffer + jcon->used,
+					 tal_count(jcon->buffer) - jcon->used,
+					 &jcon->len_read, read_json, jcon),
+			 write_json(conn, jcon));
+}
+
 static struct io_plan *jcon_connected(struct io_conn *conn, struct state *state)
 {
 	struct json_connection *jcon;
@@ -398,17 +732,16 @@ static struct io_plan *jcon_connected(struct io_conn *conn, struct state *state)
 	jcon->len_read = 64;
 	jcon->buffer = tal_arr(jcon, char, jcon->len_read);
 	jcon->stop = false;
+	jcon->num_snapshots = 0;
+	init_json_parse(jcon);
 	jcon->log = new_log(jcon, state->lr, "%sjcon fd %i:",
 			    log_prefix(state->log), io_conn_fd(conn));
 	list_head_init(&jcon->output);
 
 	io_set_finish(conn, finish_jcon, jcon);
 
-	return io_duplex(conn,
-			 io_read_partial(conn, jcon->buffer,
-					 tal_count(jcon->buffer),
-					 &jcon->len_read, read_json, jcon),
-			 write_json(conn, jcon));
+	/* Peek at the first byte to see which protocol they speak. */
+	return io_read(conn, jcon->buffer, 1, first_byte, jcon);
 }
 
 static struct io_plan *rpc_connected(struct io_conn *conn, struct state *state)
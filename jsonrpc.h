@@ -19,10 +19,16 @@ struct json_connection {
 	size_t used;
 	/* How much has just been filled. */
 	size_t len_read;
+	/* jsmn carries on from where it got to last time. */
+	jsmn_parser parser;
+	jsmntok_t *toks;
 
 	/* We've been told to stop. */
 	bool stop;
 
+	/* Snapshot children still running for us. */
+	unsigned int num_snapshots;
+
 	struct list_head output;
 	const char *outbuf;
 };
@@ -34,6 +40,8 @@ struct json_command {
 			  struct json_result *result);
 	const char *description;
 	const char *help;
+	/* Read-only and slow: run it in a child against a snapshot. */
+	bool snapshot;
 };
 
 /* Add notification about something. */
@@ -52,6 +60,9 @@ extern const struct json_command getblockhash_command;
 extern const struct json_command submitblock_command;
 extern const struct json_command gettransaction_command;
 extern const struct json_command getpeerinfo_command;
+extern const struct json_command getmetrics_command;
 extern const struct json_command detachedblocks_command;
+extern const struct json_command watchaddress_command;
+extern const struct json_command unwatchaddress_command;
 
 #endif /* PETTYCOIN_JSONRPC_H */
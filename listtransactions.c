@@ -1,5 +1,7 @@
+#include "addrhash.h"
 #include "base58.h"
 #include "block.h"
+#include "chain.h"
 #include "check_tx.h"
 #include "horizon.h"
 #include "json_add_tx.h"
@@ -11,6 +13,8 @@
 #include "tal_arr.h"
 #include "timestamp.h"
 #include "tx.h"
+#include "tx_in_hashes.h"
+#include <ccan/asort/asort.h>
 #include <ccan/structeq/structeq.h>
 #include <ccan/take/take.h>
 #include <ccan/tal/str/str.h>
@@ -127,6 +131,78 @@ static void add_pending_txs(struct json_connection *jcon,
 
 		json_add_tx(response, NULL, jcon->state, utx->tx, NULL, 0);
 	}
+
+	/* And any waiting to be rechecked. */
+	for (txoff = pend->num_rechecked;
+	     pend->recheck && txoff < tal_count(pend->recheck);
+	     txoff++) {
+		const union protocol_tx *tx = pend->recheck[txoff];
+
+		if (!tx || !unspent_output_affects(jcon, tx, address))
+			continue;
+
+		json_add_tx(response, NULL, jcon->state, tx, NULL, 0);
+	}
+}
+
+/* Same order as add_existing_txs(): oldest block first, but since that
+ * reverses the whole array, each block's txs come out last first. */
+static int te_cmp(struct txhash_elem *const *a,
+		  struct txhash_elem *const *b,
+		  void *unused)
+{
+	const struct txhash_elem *ta = *a, *tb = *b;
+
+	if (ta->u.block != tb->u.block)
+		return block_height(&ta->u.block->bi)
+			< block_height(&tb->u.block->bi) ? -1 : 1;
+	if (ta->shardnum != tb->shardnum)
+		return (int)tb->shardnum - (int)ta->shardnum;
+	return (int)tb->txoff - (int)ta->txoff;
+}
+
+/* Same answer as add_existing_txs, but only looks at transactions
+ * which touch the address. */
+static void add_indexed_txs(struct json_connection *jcon,
+			    const struct protocol_address *address,
+			    struct json_result *response)
+{
+	struct state *state = jcon->state;
+	struct addrhash_iter it;
+	struct addrhash_elem *ae;
+	struct txhash_elem **tes = tal_arr(jcon, struct txhash_elem *, 0);
+	u32 top = block_height(&state->preferred_chain->bi);
+	unsigned int i;
+
+	for (ae = addrhash_firstval(&state->addrhash, address, &it);
+	     ae;
+	     ae = addrhash_nextval(&state->addrhash, address, &it)) {
+		const struct block *b = ae->te->u.block;
+
+		/* add_pending_txs() does those, in pending order. */
+		if (ae->te->status == TX_PENDING)
+			continue;
+
+		if (!block_preceeds(b, state->preferred_chain))
+			continue;
+		/* Once block is past horizon, we can't spend it */
+		if (block_expired_by(block_expiry(state, &b->bi),
+				     current_time()))
+			continue;
+
+		if (!unspent_output_affects(jcon, txhash_tx(ae->te), address))
+			continue;
+
+		tal_arr_append(&tes, ae->te);
+	}
+
+	asort(tes, tal_count(tes), te_cmp, NULL);
+
+	for (i = 0; i < tal_count(tes); i++)
+		json_add_tx(response, NULL, state, txhash_tx(tes[i]),
+			    tes[i]->u.block,
+			    top - block_height(&tes[i]->u.block->bi) + 1);
+	tal_free(tes);
 }
 
 static char *json_list_transactions(struct json_connection *jcon,
@@ -171,7 +247,10 @@ static char *json_list_transactions(struct json_connection *jcon,
 	}
 
 	json_array_start(response, NULL);
-	add_existing_txs(jcon, &address, response);
+	if (jcon->state->index_addresses)
+		add_indexed_txs(jcon, &address, response);
+	else
+		add_existing_txs(jcon, &address, response);
 	if (minimum_confirms == 0)
 		add_pending_txs(jcon, &address, response);
 	json_array_end(response);
@@ -182,5 +261,6 @@ static char *json_list_transactions(struct json_connection *jcon,
 const struct json_command listtransactions_command = {
 	"listtransactions", json_list_transactions,
 	"show transactions to/from a given address",
-	"<address> <minconf> - list all the transactions to/from a specific address as they appear in a block on the preferred chain, if they are >= <minconf> confirmations.  minconf defaults to 1; if 0, shows pending transactions."
+	"<address> <minconf> - list all the transactions to/from a specific address as they appear in a block on the preferred chain, if they are >= <minconf> confirmations.  minconf defaults to 1; if 0, shows pending transactions.",
+	true
 };
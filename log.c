@@ -1,69 +1,486 @@
 #include "hex.h"
 #include "log.h"
-#include "pseudorand.h"
-#include <ccan/list/list.h>
+#include <assert.h>
+#include <ccan/noerr/noerr.h>
 #include <ccan/read_write_all/read_write_all.h>
+#include <ccan/short_types/short_types.h>
+#include <ccan/str/str.h>
+#include <ccan/tal/grab_file/grab_file.h>
 #include <ccan/tal/str/str.h>
 #include <ccan/time/time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
 
-struct log_entry {
-	struct list_node list;
+/* Each entry in the ring is one of these, followed by the prefix
+ * (unless it's a continuation), then its arguments (or for LOG_IO,
+ * the in flag and data). */
+struct log_hdr {
+	/* Total length including this header: 0 means wrap to start. */
+	u32 len;
+	u8 level;
+	/* Added by log_add() onto the entry before. */
+	bool cont;
+	/* Length of prefix which follows, including its nul. */
+	u8 prefixlen;
 	struct timeabs time;
-	enum log_level level;
-	unsigned int skipped;
-	const char *prefix;
-	char *log;
+	/* Kept, not copied: must be a literal.  NULL for LOG_IO. */
+	const char *fmt;
+};
+
+#define LOG_MAGIC "PETTYLOG"
+
+/* This is all that's in a log file: it's what we map. */
+struct log_ring {
+	char magic[8];
+	/* Formats are only meaningful to the binary which wrote them. */
+	char version[64];
+	/* Where log_anchor was, so we can find formats again. */
+	u64 anchor;
+	struct timeabs init_time;
+	/* Ring of struct log_hdr: oldest at head, next goes at tail. */
+	u64 head, tail, used;
+	/* Entries we've overwritten. */
+	u32 skipped;
+	u32 unused;
+	char data[];
 };
 
 struct log_record {
-	size_t mem_used;
 	size_t max_mem;
 	enum log_level print;
-	struct timeabs init_time;
-
-	struct list_head log;
+	struct log_ring *r;
+	/* Non-zero if r is mapped from a file. */
+	size_t map_len;
+	/* If we loaded this, formats have moved by this much. */
+	bool loaded;
+	ptrdiff_t fmt_delta;
+	/* Level of the last entry, for log_add(). */
+	enum log_level last_level;
+	/* What new logs start with for set_log_io(). */
+	unsigned int io_every;
 };
 
 struct log {
 	struct log_record *lr;
-	const char *prefix;
+	/* We copy this into every entry, so keep it short. */
+	char prefix[128];
+	size_t prefixlen;
+	/* We keep one in io_every packets (none if 0). */
+	unsigned int io_every, io_count;
 };
 
-static size_t log_bufsize(const struct log_entry *e)
+/* Formats are literals: we note where this one is so a later run of
+ * the same binary can find them again. */
+static const char log_anchor[] = "";
+
+/* Provided by the linker. */
+extern const char __executable_start[], _end[];
+
+#define LOG_ALIGN(len) (((len) + 7) & ~(size_t)7)
+
+/* No entry may take more than this, so we never lap ourselves. */
+static size_t max_entry(const struct log_record *lr)
+{
+	return (lr->max_mem / 2) & ~(size_t)7;
+}
+
+static struct log_hdr *hdr_at(const struct log_record *lr, size_t off)
 {
-	if (e->level == LOG_IO)
-		return tal_count(e->log);
-	else
-		return strlen(e->log) + 1;
+	return (struct log_hdr *)(lr->r->data + off);
 }
 
-static size_t prune_log(struct log_record *log)
+/* Head may be sitting on a wrap marker, or at the end. */
+static void normalize_head(struct log_record *lr)
 {
-	struct log_entry *i, *next, *tail;
-	size_t skipped = 0, deleted = 0;
+	if (!lr->r->used)
+		lr->r->head = lr->r->tail = 0;
+	else if (lr->r->head == lr->max_mem || hdr_at(lr, lr->r->head)->len == 0)
+		lr->r->head = 0;
+}
 
-	/* Never delete the last one. */
-	tail = list_tail(&log->log, struct log_entry, list);
+static void evict_head(struct log_record *lr)
+{
+	const struct log_hdr *h;
 
-	list_for_each_safe(&log->log, i, next, list) {
-		/* 50% chance of deleting debug, 25% inform, 12.5% unusual. */
-		if (i == tail || !isaac64_next_uint(isaac64, 2 << i->level)) {
-			i->skipped += skipped;
-			skipped = 0;
-			continue;
+	/* Continuations go with the entry they belong to. */
+	do {
+		h = hdr_at(lr, lr->r->head);
+		if (!h->cont)
+			lr->r->skipped++;
+		lr->r->head += h->len;
+		lr->r->used -= h->len;
+		normalize_head(lr);
+	} while (lr->r->used && hdr_at(lr, lr->r->head)->cont);
+}
+
+/* Room for len bytes at the tail, evicting the oldest as needed. */
+static struct log_hdr *ring_alloc(struct log_record *lr, size_t len)
+{
+	struct log_hdr *h;
+
+	assert(len <= max_entry(lr));
+	for (;;) {
+		if (!lr->r->used)
+			lr->r->head = lr->r->tail = 0;
+
+		if (lr->r->tail > lr->r->head || !lr->r->used) {
+			/* Free space is from tail to end, and before head. */
+			if (lr->max_mem - lr->r->tail >= len)
+				break;
+			if (lr->r->tail != lr->max_mem)
+				hdr_at(lr, lr->r->tail)->len = 0;
+			lr->r->tail = 0;
+		} else if (lr->r->head - lr->r->tail >= len)
+			break;
+		else
+			evict_head(lr);
+	}
+
+	h = hdr_at(lr, lr->r->tail);
+	h->len = len;
+	lr->r->tail += len;
+	lr->r->used += len;
+	return h;
+}
+
+/* What a printf conversion looks like, after the %. */
+struct conv {
+	char flags[8];
+	bool width_star, prec_star;
+	int width, prec;
+	/* Length modifier: 'H' for hh, 'q' for ll. */
+	char mod;
+	char c;
+};
+
+static int parse_num(const char **p)
+{
+	int n = 0;
+
+	while (cisdigit(**p))
+		n = n * 10 + *(*p)++ - '0';
+	return n;
+}
+
+static const char *parse_conv(const char *p, struct conv *conv)
+{
+	size_t n = 0;
+
+	while (*p && strchr("-+ #0", *p)) {
+		/* Leave room for format_args() to add a -. */
+		if (n < sizeof(conv->flags) - 2)
+			conv->flags[n++] = *p;
+		p++;
+	}
+	conv->flags[n] = '\0';
+
+	conv->width_star = conv->prec_star = false;
+	conv->width = conv->prec = -1;
+	if (*p == '*') {
+		conv->width_star = true;
+		p++;
+	} else if (cisdigit(*p))
+		conv->width = parse_num(&p);
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			conv->prec_star = true;
+			p++;
+		} else
+			conv->prec = parse_num(&p);
+	}
+
+	conv->mod = '\0';
+	if (p[0] == 'h' && p[1] == 'h') {
+		conv->mod = 'H';
+		p += 2;
+	} else if (p[0] == 'l' && p[1] == 'l') {
+		conv->mod = 'q';
+		p += 2;
+	} else if (*p && strchr("hlLqjzt", *p))
+		conv->mod = *p++;
+
+	conv->c = *p;
+	return *p ? p + 1 : p;
+}
+
+static s64 signed_arg(char mod, va_list *ap)
+{
+	switch (mod) {
+	case 'H': return (signed char)va_arg(*ap, int);
+	case 'h': return (short)va_arg(*ap, int);
+	case 'l': return va_arg(*ap, long);
+	case 'q': return va_arg(*ap, long long);
+	case 'j': return va_arg(*ap, intmax_t);
+	case 'z': return va_arg(*ap, ssize_t);
+	case 't': return va_arg(*ap, ptrdiff_t);
+	}
+	return va_arg(*ap, int);
+}
+
+static u64 unsigned_arg(char mod, va_list *ap)
+{
+	switch (mod) {
+	case 'H': return (unsigned char)va_arg(*ap, unsigned int);
+	case 'h': return (unsigned short)va_arg(*ap, unsigned int);
+	case 'l': return va_arg(*ap, unsigned long);
+	case 'q': return va_arg(*ap, unsigned long long);
+	case 'j': return va_arg(*ap, uintmax_t);
+	case 'z': return va_arg(*ap, size_t);
+	case 't': return va_arg(*ap, ptrdiff_t);
+	}
+	return va_arg(*ap, unsigned int);
+}
+
+/* Appends to args if there's room: if not, it stops saving, and
+ * formatting will stop there too. */
+static bool save(char *args, size_t *off, size_t max,
+		 const void *val, size_t len)
+{
+	if (*off + len > max)
+		return false;
+	if (args)
+		memcpy(args + *off, val, len);
+	*off += len;
+	return true;
+}
+
+/* Save the raw arguments for fmt; with args NULL, just measure. */
+static size_t save_args(char *args, size_t max, const char *fmt, va_list *ap)
+{
+	size_t off = 0;
+	const char *p;
+	struct conv conv;
+
+	for (p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+		int i;
+		s64 s;
+		u64 u;
+		double d;
+		const char *str;
+		u32 len;
+
+		p = parse_conv(p + 1, &conv);
+		if (conv.width_star) {
+			i = va_arg(*ap, int);
+			if (!save(args, &off, max, &i, sizeof(i)))
+				break;
+		}
+		if (conv.prec_star) {
+			i = va_arg(*ap, int);
+			if (!save(args, &off, max, &i, sizeof(i)))
+				break;
+			conv.prec = i;
 		}
 
-		list_del_from(&log->log, &i->list);
-		log->mem_used -= sizeof(*i) + log_bufsize(i);
-		tal_free(i);
-		skipped++;
-		deleted++;
+		switch (conv.c) {
+		case 'd':
+		case 'i':
+		case 'c':
+			s = signed_arg(conv.mod, ap);
+			if (!save(args, &off, max, &s, sizeof(s)))
+				return off;
+			continue;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			u = unsigned_arg(conv.mod, ap);
+			if (!save(args, &off, max, &u, sizeof(u)))
+				return off;
+			continue;
+		case 'p':
+			u = (uintptr_t)va_arg(*ap, void *);
+			if (!save(args, &off, max, &u, sizeof(u)))
+				return off;
+			continue;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (conv.mod == 'L')
+				d = va_arg(*ap, long double);
+			else
+				d = va_arg(*ap, double);
+			if (!save(args, &off, max, &d, sizeof(d)))
+				return off;
+			continue;
+		case 's':
+			str = va_arg(*ap, const char *);
+			if (!str)
+				str = "(null)";
+			/* It needn't be terminated if there's a precision. */
+			if (conv.prec >= 0)
+				len = strnlen(str, conv.prec);
+			else
+				len = strlen(str);
+			if (off + sizeof(len) > max)
+				return off;
+			if (len > max - off - sizeof(len))
+				len = max - off - sizeof(len);
+			save(args, &off, max, &len, sizeof(len));
+			save(args, &off, max, str, len);
+			continue;
+		case 'n':
+			va_arg(*ap, void *);
+			continue;
+		case '%':
+			continue;
+		}
+		/* Unknown: we can't know what to pull off the stack. */
+		break;
 	}
+	return off;
+}
+
+typedef void (*log_put_fn)(const char *str, size_t len, void *arg);
 
-	assert(!skipped);
-	return deleted;
+static bool load(const char **args, const char *end, void *val, size_t len)
+{
+	if (*args + len > end)
+		return false;
+	memcpy(val, *args, len);
+	*args += len;
+	return true;
+}
+
+static void put_pad(log_put_fn put, void *arg, int num)
+{
+	while (num-- > 0)
+		put(" ", 1, arg);
+}
+
+/* Turn the saved arguments back into text.  No allocations: this is
+ * called from the crash handler. */
+static void format_args(const char *fmt, const char *args, const char *end,
+			log_put_fn put, void *arg)
+{
+	const char *p, *start;
+	struct conv conv;
+
+	for (p = fmt; *p; ) {
+		char spec[64], buf[128];
+		int i, n;
+		s64 s;
+		u64 u;
+		double d;
+		u32 len;
+
+		start = p;
+		p = strchr(start, '%');
+		if (!p) {
+			put(start, strlen(start), arg);
+			break;
+		}
+		put(start, p - start, arg);
+
+		start = p;
+		p = parse_conv(p + 1, &conv);
+		if (conv.width_star) {
+			if (!load(&args, end, &i, sizeof(i)))
+				return;
+			conv.width = i;
+		}
+		if (conv.prec_star) {
+			if (!load(&args, end, &i, sizeof(i)))
+				return;
+			conv.prec = i;
+		}
+		/* A negative width means left-justify. */
+		if (conv.width < -1) {
+			strcat(conv.flags, "-");
+			conv.width = -conv.width;
+		}
+
+		n = sprintf(spec, "%%%s", conv.flags);
+		if (conv.width >= 0)
+			n += sprintf(spec + n, "%i", conv.width);
+		if (conv.prec >= 0)
+			n += sprintf(spec + n, ".%i", conv.prec);
+
+		switch (conv.c) {
+		case 'd':
+		case 'i':
+		case 'c':
+			if (!load(&args, end, &s, sizeof(s)))
+				return;
+			if (conv.c == 'c') {
+				sprintf(spec + n, "c");
+				n = snprintf(buf, sizeof(buf), spec, (int)s);
+			} else {
+				sprintf(spec + n, "ll%c", conv.c);
+				n = snprintf(buf, sizeof(buf), spec,
+					     (long long)s);
+			}
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			if (!load(&args, end, &u, sizeof(u)))
+				return;
+			sprintf(spec + n, "ll%c", conv.c);
+			n = snprintf(buf, sizeof(buf), spec,
+				     (unsigned long long)u);
+			break;
+		case 'p':
+			if (!load(&args, end, &u, sizeof(u)))
+				return;
+			sprintf(spec + n, "p");
+			n = snprintf(buf, sizeof(buf), spec, (void *)(uintptr_t)u);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (!load(&args, end, &d, sizeof(d)))
+				return;
+			sprintf(spec + n, "%c", conv.c);
+			n = snprintf(buf, sizeof(buf), spec, d);
+			break;
+		case 's':
+			if (!load(&args, end, &len, sizeof(len))
+			    || args + len > end)
+				return;
+			if (strchr(conv.flags, '-')) {
+				put(args, len, arg);
+				put_pad(put, arg, conv.width - (int)len);
+			} else {
+				put_pad(put, arg, conv.width - (int)len);
+				put(args, len, arg);
+			}
+			args += len;
+			continue;
+		case 'n':
+			continue;
+		case '%':
+			put("%", 1, arg);
+			continue;
+		default:
+			/* save_args() stopped here, so we do too. */
+			put(start, strlen(start), arg);
+			return;
+		}
+		if (n >= (int)sizeof(buf))
+			n = sizeof(buf) - 1;
+		if (n > 0)
+			put(buf, n, arg);
+	}
 }
 
 struct log_record *new_log_record(const tal_t *ctx,
@@ -73,16 +490,135 @@ struct log_record *new_log_record(const tal_t *ctx,
 	struct log_record *lr = tal(ctx, struct log_record);
 
 	/* Give a reasonable size for memory limit! */
-	assert(max_mem > sizeof(struct log) * 2);
-	lr->mem_used = 0;
-	lr->max_mem = max_mem;
+	assert(max_mem >= 2048);
+	lr->max_mem = max_mem & ~(size_t)7;
 	lr->print = printlevel;
-	lr->init_time = time_now();
-	list_head_init(&lr->log);
+	lr->r = (struct log_ring *)tal_arrz(lr, char,
+					    sizeof(*lr->r) + lr->max_mem);
+	memcpy(lr->r->magic, LOG_MAGIC, sizeof(lr->r->magic));
+	strncpy(lr->r->version, VERSION, sizeof(lr->r->version) - 1);
+	lr->r->anchor = (uintptr_t)log_anchor;
+	lr->r->init_time = time_now();
+	lr->r->head = lr->r->tail = lr->r->used = 0;
+	lr->r->skipped = 0;
+	lr->map_len = 0;
+	lr->loaded = false;
+	lr->fmt_delta = 0;
+	lr->last_level = LOG_BROKEN;
+	lr->io_every = 0;
 
 	return lr;
 }
 
+static void unmap_log(struct log_record *lr)
+{
+	munmap(lr->r, lr->map_len);
+}
+
+bool set_log_file(struct log_record *lr, const char *filename)
+{
+	size_t len = sizeof(*lr->r) + lr->max_mem;
+	struct log_ring *r;
+	char *old;
+	int fd;
+
+	/* Don't clobber the last run's log: that's the one you want! */
+	old = tal_fmt(lr, "%s.old", filename);
+	if (rename(filename, old) != 0 && errno != ENOENT) {
+		tal_free(old);
+		return false;
+	}
+	tal_free(old);
+
+	fd = open(filename, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, len) != 0) {
+		close_noerr(fd);
+		return false;
+	}
+	r = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close_noerr(fd);
+	if (r == MAP_FAILED)
+		return false;
+
+	/* Pages are written back by the kernel even if we die. */
+	memcpy(r, lr->r, len);
+	if (lr->map_len) {
+		tal_del_destructor(lr, unmap_log);
+		unmap_log(lr);
+	} else
+		tal_free(lr->r);
+	lr->r = r;
+	lr->map_len = len;
+	tal_add_destructor(lr, unmap_log);
+	return true;
+}
+
+void log_record_private(struct log_record *lr)
+{
+	struct log_ring *r;
+
+	if (!lr->map_len)
+		return;
+
+	/* The parent is still writing to the old one: start afresh. */
+	r = (struct log_ring *)tal_arrz(lr, char, sizeof(*r) + lr->max_mem);
+	memcpy(r, lr->r, sizeof(*r));
+	r->head = r->tail = r->used = 0;
+	r->skipped = 0;
+
+	tal_del_destructor(lr, unmap_log);
+	unmap_log(lr);
+	lr->r = r;
+	lr->map_len = 0;
+}
+
+struct log_record *load_log_record(const tal_t *ctx, const char *filename)
+{
+	struct log_record *lr;
+	struct log_ring *r;
+	char *contents;
+	size_t len;
+
+	contents = grab_file(ctx, filename);
+	if (!contents)
+		return NULL;
+
+	/* grab_file() adds a nul terminator. */
+	len = tal_count(contents) - 1;
+	r = (struct log_ring *)contents;
+	if (len < sizeof(*r) + 2048
+	    || memcmp(r->magic, LOG_MAGIC, sizeof(r->magic)) != 0
+	    || r->head > len - sizeof(*r)
+	    || r->tail > len - sizeof(*r)
+	    || r->used > len - sizeof(*r)) {
+		tal_free(contents);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* We can't find the formats without the same binary. */
+	r->version[sizeof(r->version) - 1] = '\0';
+	if (!streq(r->version, VERSION)) {
+		tal_free(contents);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	lr = tal(ctx, struct log_record);
+	lr->max_mem = (len - sizeof(*r)) & ~(size_t)7;
+	lr->print = LOG_BROKEN + 1;
+	lr->r = r;
+	tal_steal(lr, contents);
+	lr->map_len = 0;
+	lr->loaded = true;
+	lr->fmt_delta = (uintptr_t)log_anchor - r->anchor;
+	lr->last_level = LOG_BROKEN;
+	lr->io_every = 0;
+	return lr;
+}
+
 /* With different entry points */
 struct log *PRINTF_FMT(3,4)
 new_log(const tal_t *ctx, struct log_record *record, const char *fmt, ...)
@@ -91,10 +627,12 @@ new_log(const tal_t *ctx, struct log_record *record, const char *fmt, ...)
 	va_list ap;
 
 	log->lr = record;
+	log->io_every = record->io_every;
+	log->io_count = 0;
 	va_start(ap, fmt);
-	/* log->lr owns this, since its entries keep a pointer to it. */
-	log->prefix = tal_vfmt(log->lr, fmt, ap);
+	vsnprintf(log->prefix, sizeof(log->prefix), fmt, ap);
 	va_end(ap);
+	log->prefixlen = strlen(log->prefix) + 1;
 
 	return log;
 }
@@ -104,10 +642,21 @@ void set_log_level(struct log_record *lr, enum log_level level)
 	lr->print = level;
 }
 
+void set_log_io_default(struct log_record *lr, unsigned int every)
+{
+	lr->io_every = every;
+}
+
+void set_log_io(struct log *log, unsigned int every)
+{
+	log->io_every = every;
+	log->io_count = 0;
+}
+
 void set_log_prefix(struct log *log, const char *prefix)
 {
-	/* log->lr owns this, since it keeps a pointer to it. */
-	log->prefix = tal_strdup(log->lr, prefix);
+	snprintf(log->prefix, sizeof(log->prefix), "%s", prefix);
+	log->prefixlen = strlen(log->prefix) + 1;
 }
 
 const char *log_prefix(const struct log *log)
@@ -122,83 +671,122 @@ size_t log_max_mem(const struct log_record *lr)
 
 size_t log_used(const struct log_record *lr)
 {
-	return lr->mem_used;
+	return lr->r->used;
 }
 
 const struct timeabs *log_init_time(const struct log_record *lr)
 {
-	return &lr->init_time;
+	return &lr->r->init_time;
 }
 
-static void add_entry(struct log *log, struct log_entry *l)
+/* Continuations print with the entry before, so don't need a prefix. */
+static size_t entry_prefixlen(const struct log *log, bool cont)
 {
-	log->lr->mem_used += sizeof(*l) + log_bufsize(l);
-	list_add_tail(&log->lr->log, &l->list);
+	return cont ? 0 : log->prefixlen;
+}
 
-	if (log->lr->mem_used > log->lr->max_mem) {
-		size_t old_mem = log->lr->mem_used, deleted;
-		deleted = prune_log(log->lr);
-		log_debug(log, "Log pruned %zu entries (mem %zu -> %zu)",
-			  deleted, old_mem, log->lr->mem_used);
-	}
+/* Most we can put after the header and prefix. */
+static size_t max_body(const struct log *log, bool cont)
+{
+	return max_entry(log->lr) - LOG_ALIGN(sizeof(struct log_hdr))
+		- entry_prefixlen(log, cont);
 }
 
-static struct log_entry *new_log_entry(struct log *log, enum log_level level)
+/* Returns where the body goes. */
+static char *new_entry(struct log *log, enum log_level level, bool cont,
+		       const char *fmt, size_t bodylen)
 {
-	struct log_entry *l = tal(log->lr, struct log_entry);
+	size_t hdrlen = LOG_ALIGN(sizeof(struct log_hdr));
+	size_t prefixlen = entry_prefixlen(log, cont);
+	struct log_hdr *h;
 
-	l->time = time_now();
-	l->level = level;
-	l->skipped = 0;
-	l->prefix = log->prefix;
+	h = ring_alloc(log->lr, hdrlen + LOG_ALIGN(prefixlen + bodylen));
+	h->level = level;
+	h->cont = cont;
+	h->prefixlen = prefixlen;
+	h->time = time_now();
+	h->fmt = fmt;
+	memcpy((char *)h + hdrlen, log->prefix, prefixlen);
+	return (char *)h + hdrlen + prefixlen;
+}
+
+/* We only store the arguments: formatting waits until someone looks. */
+static void add_entry(struct log *log, enum log_level level, bool cont,
+		      const char *fmt, va_list ap)
+{
+	size_t len;
+	char *body;
+	va_list ap2;
+
+	va_copy(ap2, ap);
+	len = save_args(NULL, max_body(log, cont), fmt, &ap2);
+	va_end(ap2);
 
-	return l;
+	body = new_entry(log, level, cont, fmt, len);
+
+	va_copy(ap2, ap);
+	save_args(body, len, fmt, &ap2);
+	va_end(ap2);
 }
 
 void logv(struct log *log, enum log_level level, const char *fmt, va_list ap)
 {
-	struct log_entry *l = new_log_entry(log, level);
-
-	l->log = tal_vfmt(l, fmt, ap);
+	if (level >= log->lr->print) {
+		va_list ap2;
 
-	if (level >= log->lr->print)
-		printf("%s %s\n", log->prefix, l->log);
+		va_copy(ap2, ap);
+		printf("%s ", log->prefix);
+		vprintf(fmt, ap2);
+		printf("\n");
+		va_end(ap2);
+	}
 
-	add_entry(log, l);
+	log->lr->last_level = level;
+	add_entry(log, level, false, fmt, ap);
 }
 
 void log_io(struct log *log, bool in, const void *data, size_t len)
 {
 	int save_errno = errno;
-	struct log_entry *l = new_log_entry(log, LOG_IO);
+	struct log_record *lr = log->lr;
+	u32 datalen = len;
+	char *p;
 
-	l->log = tal_arr(l, char, 1 + len);
-	l->log[0] = in;
-	memcpy(l->log + 1, data, len);
-
-	if (LOG_IO >= log->lr->print) {
-		char *hex = to_hex(l, data, len);
+	if (LOG_IO >= lr->print) {
+		char *hex = to_hex(log, data, len);
 		printf("%s[%s] %s\n", log->prefix, in ? "IN" : "OUT", hex);
 		tal_free(hex);
-	}
-	add_entry(log, l);
+	} else if (!log->io_every || ++log->io_count % log->io_every)
+		return;
+
+	/* We keep the start of huge packets. */
+	if (1 + sizeof(datalen) + datalen > max_body(log, false))
+		datalen = max_body(log, false) - 1 - sizeof(datalen);
+
+	p = new_entry(log, LOG_IO, false, NULL, 1 + sizeof(datalen) + datalen);
+	p[0] = in;
+	memcpy(p + 1, &datalen, sizeof(datalen));
+	memcpy(p + 1 + sizeof(datalen), data, datalen);
+
+	lr->last_level = LOG_IO;
 	errno = save_errno;
 }
 
 static void do_log_add(struct log *log, const char *fmt, va_list ap)
 {
-	struct log_entry *l = list_tail(&log->lr->log, struct log_entry, list);
-	size_t oldlen = strlen(l->log);
+	enum log_level level = log->lr->last_level;
 
-	/* Remove from list, so it doesn't get pruned. */
-	log->lr->mem_used -= sizeof(*l) + oldlen + 1;
-	list_del_from(&log->lr->log, &l->list);
+	if (level >= log->lr->print) {
+		va_list ap2;
 
-	tal_append_vfmt(&l->log, fmt, ap);
-	add_entry(log, l);
+		va_copy(ap2, ap);
+		printf("%s \t", log->prefix);
+		vprintf(fmt, ap2);
+		printf("\n");
+		va_end(ap2);
+	}
 
-	if (l->level >= log->lr->print)
-		printf("%s \t%s\n", log->prefix, l->log + oldlen);
+	add_entry(log, level, true, fmt, ap);
 }
 
 void log_(struct log *log, enum log_level level, const char *fmt, ...)
@@ -219,6 +807,154 @@ void log_add(struct log *log, const char *fmt, ...)
 	va_end(ap);
 }
 
+static bool entry_ok(const struct log_record *lr, size_t off, size_t left)
+{
+	const struct log_hdr *h = hdr_at(lr, off);
+	size_t hdrlen = LOG_ALIGN(sizeof(*h));
+
+	if (h->len < hdrlen || h->len > left || h->len > lr->max_mem - off)
+		return false;
+	if (h->len < hdrlen + h->prefixlen)
+		return false;
+	if (h->prefixlen && ((const char *)h)[hdrlen + h->prefixlen - 1])
+		return false;
+	return h->level <= LOG_BROKEN;
+}
+
+/* Calls fn on each entry in the ring, oldest first. */
+static void log_each_entry(const struct log_record *lr,
+			   void (*fn)(const struct log_hdr *h, void *arg),
+			   void *arg)
+{
+	size_t off = lr->r->head, left = lr->r->used;
+
+	while (left) {
+		const struct log_hdr *h;
+
+		if (off == lr->max_mem || hdr_at(lr, off)->len == 0) {
+			off = 0;
+			continue;
+		}
+		h = hdr_at(lr, off);
+		/* A log from a crashed process might be torn. */
+		if (!entry_ok(lr, off, left))
+			break;
+		fn(h, arg);
+		off += h->len;
+		left -= h->len;
+	}
+}
+
+static const char *entry_prefix(const struct log_hdr *h)
+{
+	if (!h->prefixlen)
+		return "";
+	return (const char *)h + LOG_ALIGN(sizeof(*h));
+}
+
+static const char *entry_args(const struct log_hdr *h)
+{
+	return (const char *)h + LOG_ALIGN(sizeof(*h)) + h->prefixlen;
+}
+
+/* Formats in a loaded log point into the binary which wrote it. */
+static const char *entry_fmt(const struct log_record *lr,
+			     const struct log_hdr *h)
+{
+	const char *fmt = h->fmt + lr->fmt_delta;
+
+	if (lr->loaded && (fmt < __executable_start || fmt >= _end))
+		return "(bad format)";
+	return fmt;
+}
+
+static const char *entry_end(const struct log_hdr *h)
+{
+	return (const char *)h + h->len;
+}
+
+/* For LOG_IO entries. */
+static const char *entry_io(const struct log_hdr *h, bool *in, u32 *len)
+{
+	const char *p = entry_args(h);
+
+	*in = p[0];
+	memcpy(len, p + 1, sizeof(*len));
+	p += 1 + sizeof(*len);
+	if (*len > entry_end(h) - p)
+		*len = entry_end(h) - p;
+	return p;
+}
+
+struct line_data {
+	const struct log_record *lr;
+	unsigned int skipped;
+	/* The line we're building up. */
+	const struct log_hdr *first;
+	char *line;
+	size_t len;
+	void (*func)(unsigned int skipped,
+		     struct timerel time,
+		     enum log_level level,
+		     const char *prefix,
+		     const char *log,
+		     void *arg);
+	void *arg;
+};
+
+static void append_line(const char *str, size_t len, void *arg)
+{
+	struct line_data *data = arg;
+
+	tal_resize(&data->line, data->len + len + 1);
+	memcpy(data->line + data->len, str, len);
+	data->len += len;
+	data->line[data->len] = '\0';
+}
+
+static void flush_line(struct line_data *data)
+{
+	if (!data->first)
+		return;
+
+	data->func(data->skipped,
+		   time_between(data->first->time, data->lr->r->init_time),
+		   data->first->level, entry_prefix(data->first), data->line,
+		   data->arg);
+	data->skipped = 0;
+	data->first = NULL;
+	data->line = tal_free(data->line);
+}
+
+static void line_entry(const struct log_hdr *h, void *arg)
+{
+	struct line_data *data = arg;
+
+	if (h->level == LOG_IO) {
+		bool in;
+		u32 len;
+		const char *io = entry_io(h, &in, &len);
+
+		flush_line(data);
+		/* Callers expect a tal array: the in flag, then the data. */
+		data->first = h;
+		data->line = tal_arr(NULL, char, 1 + len);
+		data->line[0] = in;
+		memcpy(data->line + 1, io, len);
+		flush_line(data);
+		return;
+	}
+
+	if (!h->cont || !data->first) {
+		flush_line(data);
+		data->first = h;
+		data->line = tal_arrz(NULL, char, 1);
+		data->len = 0;
+	}
+	format_args(entry_fmt(data->lr, h), entry_args(h), entry_end(h),
+		    append_line, data);
+}
+
 void log_each_line_(const struct log_record *lr,
 		    void (*func)(unsigned int skipped,
 				 struct timerel time,
@@ -228,84 +964,106 @@ void log_each_line_(const struct log_record *lr,
 				 void *arg),
 		    void *arg)
 {
-	const struct log_entry *i;
+	struct line_data data;
 
-	list_for_each(&lr->log, i, list) {
-		func(i->skipped, time_between(i->time, lr->init_time),
-		     i->level, i->prefix, i->log, arg);
-	}
+	data.lr = lr;
+	data.skipped = lr->r->skipped;
+	data.first = NULL;
+	data.line = NULL;
+	data.func = func;
+	data.arg = arg;
+
+	log_each_entry(lr, line_entry, &data);
+	flush_line(&data);
 }
 
 struct log_data {
 	int fd;
+	const struct log_record *lr;
 	const char *prefix;
 };
 
-static void log_one_line(unsigned int skipped,
-			 struct timerel diff,
-			 enum log_level level,
-			 const char *prefix,
-			 const char *log,
-			 struct log_data *data)
+static void write_str(const char *str, size_t len, void *arg)
+{
+	struct log_data *data = arg;
+
+	write_all(data->fd, str, len);
+}
+
+static void log_one_entry(const struct log_hdr *h, void *arg)
 {
+	struct log_data *data = arg;
 	char buf[100];
+	struct timerel diff;
+
+	if (h->cont && data->prefix[0]) {
+		format_args(entry_fmt(data->lr, h), entry_args(h), entry_end(h),
+			    write_str, data);
+		return;
+	}
 
-	if (skipped) {
-		sprintf(buf, "%s... %u skipped...", data->prefix, skipped);
+	if (data->lr->r->skipped && !data->prefix[0]) {
+		sprintf(buf, "... %u skipped...", data->lr->r->skipped);
 		write_all(data->fd, buf, strlen(buf));
 		data->prefix = "\n";
 	}
 
-	sprintf(buf, "%s+%lu.%09u %s%s: ",
+	diff = time_between(h->time, data->lr->r->init_time);
+	sprintf(buf, "%s+%lu.%09u ",
 		data->prefix,
 		(unsigned long)diff.ts.tv_sec,
-		(unsigned)diff.ts.tv_nsec,
-		prefix,
-		level == LOG_IO ? (log[0] ? "IO-IN" : "IO-OUT")
-		: level == LOG_DBG ? "DEBUG"
-		: level == LOG_INFORM ? "INFO"
-		: level == LOG_UNUSUAL ? "UNUSUAL"
-		: level == LOG_BROKEN ? "BROKEN"
+		(unsigned)diff.ts.tv_nsec);
+	write_all(data->fd, buf, strlen(buf));
+	write_all(data->fd, entry_prefix(h), strlen(entry_prefix(h)));
+
+	sprintf(buf, "%s: ",
+		h->level == LOG_IO ? (entry_args(h)[0] ? "IO-IN" : "IO-OUT")
+		: h->level == LOG_DBG ? "DEBUG"
+		: h->level == LOG_INFORM ? "INFO"
+		: h->level == LOG_UNUSUAL ? "UNUSUAL"
+		: h->level == LOG_BROKEN ? "BROKEN"
 		: "**INVALID**");
 
 	write_all(data->fd, buf, strlen(buf));
-	if (level == LOG_IO) {
-		size_t off, used, len = tal_count(log)-1;
+	if (h->level == LOG_IO) {
+		bool in;
+		u32 len;
+		const char *io = entry_io(h, &in, &len);
+		size_t off, used;
 
-		/* No allocations, may be in signal handler. */
 		for (off = 0; off < len; off += used) {
 			used = to_hex_direct(buf, sizeof(buf),
-					     log + 1 + off,
-					     len - off);
+					     io + off, len - off);
 			write_all(data->fd, buf, strlen(buf));
 		}
 	} else {
-		write_all(data->fd, log, strlen(log));
+		format_args(entry_fmt(data->lr, h), entry_args(h), entry_end(h),
+			    write_str, data);
 	}
 
 	data->prefix = "\n";
 }
 
+/* No allocations, may be in signal handler. */
 void log_to_file(int fd, const struct log_record *lr)
 {
-	const struct log_entry *i;
 	char buf[100];
 	struct log_data data;
 	time_t start;
 
-	i = list_top(&lr->log, const struct log_entry, list);
-	if (!i) {
+	if (!lr->r->used) {
 		write_all(fd, "0 bytes:\n\n", strlen("0 bytes:\n\n"));
 		return;
 	}
 
-	start = lr->init_time.ts.tv_sec;
-	sprintf(buf, "%zu bytes, %s", lr->mem_used, ctime(&start));
+	start = lr->r->init_time.ts.tv_sec;
+	sprintf(buf, "%zu bytes, %s", lr->r->used, ctime(&start));
 	write_all(fd, buf, strlen(buf));
 
 	/* ctime includes \n... WTF? */
 	data.prefix = "";
 	data.fd = fd;
-	log_each_line(lr, log_one_line, &data);
+	data.lr = lr;
+	log_each_entry(lr, log_one_entry, &data);
 	write_all(fd, "\n\n", strlen("\n\n"));
 }
@@ -20,11 +20,23 @@ enum log_level {
 	LOG_BROKEN
 };
 
-/* We have a single record. */
+/* We have a single record: a fixed ring of max_mem bytes, which only
+ * keeps each entry's format and arguments until someone asks for the
+ * text.  So formats must be literals! */
 struct log_record *new_log_record(const tal_t *ctx,
 				  size_t max_mem,
 				  enum log_level printlevel);
 
+/* Map the record onto filename, so it survives us crashing (any
+ * existing one is renamed to filename.old). */
+bool set_log_file(struct log_record *lr, const char *filename);
+
+/* For a fork()ed child: log into our own memory, not the parent's file. */
+void log_record_private(struct log_record *lr);
+
+/* Read one back: fails unless it was written by this same binary. */
+struct log_record *load_log_record(const tal_t *ctx, const char *filename);
+
 /* With different entry points */
 struct log *PRINTF_FMT(3,4)
 new_log(const tal_t *ctx, struct log_record *record, const char *fmt, ...);
@@ -34,6 +46,7 @@ new_log(const tal_t *ctx, struct log_record *record, const char *fmt, ...);
 #define log_unusual(log, ...) log_((log), LOG_UNUSUAL, __VA_ARGS__)
 #define log_broken(log, ...) log_((log), LOG_BROKEN, __VA_ARGS__)
 
+/* Only kept if this log is capturing IO (or we're printing it). */
 void log_io(struct log *log, bool in, const void *data, size_t len);
 
 void log_(struct log *log, enum log_level level, const char *fmt, ...)
@@ -41,17 +54,45 @@ void log_(struct log *log, enum log_level level, const char *fmt, ...)
 void log_add(struct log *log, const char *fmt, ...) PRINTF_FMT(2,3);
 void logv(struct log *log, enum log_level level, const char *fmt, va_list ap);
 
+/* The formatter is picked at compile time: other types won't compile. */
 #define log_add_struct(log, structtype, ptr)				\
-	log_add_struct_((log), stringify(structtype),			\
-		((void)sizeof((ptr) == (structtype *)NULL), (ptr)))
+	_Generic((structtype *)NULL,					\
+		 struct protocol_double_sha *: log_add_double_sha,	\
+		 struct protocol_block_id *: log_add_block_id,		\
+		 struct protocol_tx_id *: log_add_tx_id,		\
+		 struct protocol_net_address *: log_add_net_address,	\
+		 struct protocol_address *: log_add_address,		\
+		 struct protocol_gateway_payment *: log_add_gateway_payment, \
+		 union protocol_tx *: log_add_tx,			\
+		 struct bignum_st *: log_add_bignum)((log), (ptr))
 
 #define log_add_enum(log, enumtype, val)				\
 	log_add_enum_((log), stringify(enumtype), (val))
 
-void log_add_struct_(struct log *log, const char *structname, const void *ptr);
+struct protocol_double_sha;
+struct protocol_block_id;
+struct protocol_tx_id;
+struct protocol_net_address;
+struct protocol_address;
+struct protocol_gateway_payment;
+union protocol_tx;
+struct bignum_st;
+
+void log_add_double_sha(struct log *log, const struct protocol_double_sha *s);
+void log_add_block_id(struct log *log, const struct protocol_block_id *b);
+void log_add_tx_id(struct log *log, const struct protocol_tx_id *t);
+void log_add_net_address(struct log *log, const struct protocol_net_address *addr);
+void log_add_address(struct log *log, const struct protocol_address *addr);
+void log_add_gateway_payment(struct log *log, const struct protocol_gateway_payment *gp);
+void log_add_tx(struct log *log, const union protocol_tx *tx);
+void log_add_bignum(struct log *log, const struct bignum_st *bn);
 void log_add_enum_(struct log *log, const char *enumname, unsigned int val);
 
 void set_log_level(struct log_record *lr, enum log_level level);
+/* Capture one in every packets on this log (0 means none). */
+void set_log_io(struct log *log, unsigned int every);
+/* What new logs start with. */
+void set_log_io_default(struct log_record *lr, unsigned int every);
 void set_log_prefix(struct log *log, const char *prefix);
 const char *log_prefix(const struct log *log);
 
@@ -0,0 +1,93 @@
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
+#include "state.h"
+#include "timeout.h"
+#include <ccan/list/list.h>
+#include <ccan/tal/tal.h>
+#include <inttypes.h>
+
+/* How long we spend on work before we poll again. */
+#define WORK_SLICE_MSEC 10
+
+/* How often the watchdog looks in. */
+#define WATCHDOG_MSEC 100
+
+struct work {
+	struct list_node list;
+	bool (*fn)(struct state *state, void *arg);
+	void *arg;
+};
+
+static void do_work(struct state *state)
+{
+	struct timemono start = time_mono();
+	struct work *w;
+
+	while ((w = list_pop(&state->work, struct work, list)) != NULL) {
+		/* Round-robin, so one job can't hog it. */
+		if (w->fn(state, w->arg))
+			list_add_tail(&state->work, &w->list);
+		else
+			tal_free(w);
+
+		if (time_to_msec(timemono_between(time_mono(), start))
+		    >= WORK_SLICE_MSEC)
+			break;
+	}
+
+	/* Not now: io_loop() returns expired timers before it polls. */
+	if (!list_empty(&state->work))
+		refresh_timeout(state, &state->work_timeout);
+}
+
+void add_work_(struct state *state,
+	       bool (*fn)(struct state *state, void *arg), void *arg)
+{
+	struct work *w = tal(state, struct work);
+
+	w->fn = fn;
+	w->arg = arg;
+
+	/* If there's work queued, the timer is already going. */
+	if (list_empty(&state->work)) {
+		init_timeout(&state->work_timeout, 0, do_work, state);
+		state->work_timeout.interval = time_from_msec(1);
+		refresh_timeout(state, &state->work_timeout);
+	}
+	list_add_tail(&state->work, &w->list);
+}
+
+static void arm_watchdog(struct state *state)
+{
+	state->watchdog_armed = time_mono();
+	refresh_timeout(state, &state->watchdog);
+}
+
+/* If we're late, something kept the loop from getting back to us. */
+static void watchdog(struct state *state)
+{
+	struct timerel took, late;
+
+	/* Monotonic, so clock changes don't look like stalls. */
+	took = timemono_between(time_mono(), state->watchdog_armed);
+	if (time_greater(took, state->watchdog.interval))
+		late = time_sub(took, state->watchdog.interval);
+	else
+		late = time_from_sec(0);
+
+	metric_latency_add(&state->metrics.loop_late, late);
+	if (time_to_usec(late) >= state->metrics.stall_usec) {
+		state->metrics.loop_stalls++;
+		log_unusual(state->log, "Loop stalled for %"PRIu64" msec",
+			    time_to_msec(late));
+	}
+	arm_watchdog(state);
+}
+
+void start_loop_watchdog(struct state *state)
+{
+	init_timeout(&state->watchdog, 0, watchdog, state);
+	state->watchdog.interval = time_from_msec(WATCHDOG_MSEC);
+	arm_watchdog(state);
+}
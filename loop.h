@@ -0,0 +1,22 @@
+#ifndef PETTYCOIN_LOOP_H
+#define PETTYCOIN_LOOP_H
+#include "config.h"
+#include <ccan/typesafe_cb/typesafe_cb.h>
+#include <stdbool.h>
+
+struct state;
+
+/* Everything runs in the one io_loop, so long jobs starve our peers.
+ * Instead, they can be done a piece at a time: fn is called repeatedly
+ * (between polls) until it returns false. */
+#define add_work(state, fn, arg)					\
+	add_work_((state),						\
+		  typesafe_cb_preargs(bool, void *, (fn), (arg),	\
+				      struct state *), (arg))
+
+void add_work_(struct state *state,
+	       bool (*fn)(struct state *state, void *arg), void *arg);
+
+/* Watch for the loop not getting back to us in time. */
+void start_loop_watchdog(struct state *state);
+#endif /* PETTYCOIN_LOOP_H */
@@ -3,18 +3,33 @@
 #include "protocol.h"
 #include "protocol_net.h"
 
-static void merkle_hash(size_t n, void *data,
-			struct protocol_double_sha *merkle)
-{
-	const struct protocol_txrefhash *hashes = data;
-
-	merkle_two_hashes(&hashes[n].txhash.sha, &hashes[n].refhash, merkle);
-}
-
 void merkle_hashes(const struct protocol_txrefhash *hashes,
 		   size_t off, size_t num_hashes,
 		   struct protocol_double_sha *merkle)
 {
-	merkle_recurse(off, num_hashes, 256, merkle_hash, (void *)hashes,
-		       merkle);
+	struct protocol_double_sha level[256];
+	size_t i, n, depth;
+
+	/* Only the leaves which have txs: the rest are zero. */
+	n = off < num_hashes ? num_hashes - off : 0;
+	if (n > 256)
+		n = 256;
+
+	for (i = 0; i < n; i++)
+		merkle_two_hashes(&hashes[off + i].txhash.sha,
+				  &hashes[off + i].refhash, &level[i]);
+
+	/* Now merkle it a level at a time, in place. */
+	for (depth = 0; depth < 8; depth++) {
+		size_t pairs = n / 2;
+
+		merkle_level(level, pairs, level);
+		/* Odd one out gets paired with a zero subtree. */
+		if (n % 2)
+			merkle_two_hashes(&level[n-1], merkle_zero(depth),
+					  &level[pairs]);
+		n = (n + 1) / 2;
+	}
+
+	*merkle = n ? level[0] : *merkle_zero(8);
 }
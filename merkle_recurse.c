@@ -2,44 +2,56 @@
 #include "protocol.h"
 #include "shadouble.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <string.h>
 
+/* For getmetrics. */
+static u64 merkles_done;
+
+u64 num_merkle_hashes(void)
+{
+	return merkles_done;
+}
+
 void merkle_two_hashes(const struct protocol_double_sha *a,
 		       const struct protocol_double_sha *b,
 		       struct protocol_double_sha *merkle)
 {
 	SHA256_CTX shactx;
 
+	merkles_done++;
 	SHA256_Init(&shactx);
 	SHA256_Update(&shactx, a, sizeof(*a));
 	SHA256_Update(&shactx, b, sizeof(*b));
 	SHA256_Double_Final(&shactx, merkle);
 }
 
-void merkle_recurse(size_t off, size_t max_off, size_t num,
-		    void (*fn)(size_t, void *, struct protocol_double_sha *),
-		    void *data,
-		    struct protocol_double_sha *merkle)
+void merkle_level(const struct protocol_double_sha *in, size_t num,
+		  struct protocol_double_sha *out)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		struct protocol_double_sha merkle;
+
+		merkle_two_hashes(&in[i*2], &in[i*2+1], &merkle);
+		out[i] = merkle;
+	}
+}
+
+const struct protocol_double_sha *merkle_zero(unsigned int level)
 {
-	/* Always a power of 2. */
-	assert((num & (num-1)) == 0);
-	assert(num != 0);
-
-	if (num == 1) {
-		if (off >= max_off)
-			memset(merkle, 0, sizeof(*merkle));
-		else
-			fn(off, data, merkle);
-	} else {
-		SHA256_CTX shactx;
-		struct protocol_double_sha sub[2];
-
-		num /= 2;
-		merkle_recurse(off, max_off, num, fn, data, sub);
-		merkle_recurse(off + num, max_off, num, fn, data, sub+1);
-		
-		SHA256_Init(&shactx);
-		SHA256_Update(&shactx, sub, sizeof(sub));
-		SHA256_Double_Final(&shactx, merkle);
+	static struct protocol_double_sha zero[MERKLE_ZERO_LEVELS];
+	static bool done;
+
+	assert(level < MERKLE_ZERO_LEVELS);
+	if (!done) {
+		unsigned int i;
+
+		memset(&zero[0], 0, sizeof(zero[0]));
+		for (i = 1; i < MERKLE_ZERO_LEVELS; i++)
+			merkle_two_hashes(&zero[i-1], &zero[i-1], &zero[i]);
+		done = true;
 	}
+	return &zero[level];
 }
@@ -1,21 +1,29 @@
 #ifndef PETTYCOIN_MERKLE_RECURSE_H
 #define PETTYCOIN_MERKLE_RECURSE_H
 #include "config.h"
+#include <ccan/short_types/short_types.h>
 #include <stddef.h>
 
 struct protocol_double_sha;
 
-void merkle_recurse(size_t off, size_t max_off, size_t num,
-		    void (*fn)(size_t n, void *data,
-			       struct protocol_double_sha *merkle),
-		    void *data,
-		    struct protocol_double_sha *merkle);
-
 /* Helper to merkle two hashes together: SHA256(SHA256([a][b])) */
 void merkle_two_hashes(const struct protocol_double_sha *a,
 		       const struct protocol_double_sha *b,
 		       struct protocol_double_sha *merkle);
 
+/* Merkle of a subtree with 1 << level leaves, all zero.  Beyond the
+ * last tx, everything is one of these. */
+#define MERKLE_ZERO_LEVELS 9
+const struct protocol_double_sha *merkle_zero(unsigned int level);
+
+/* A whole level at once: out[i] = merkle of in[i*2] and in[i*2+1], for
+ * i < num.  out may be the same as in. */
+void merkle_level(const struct protocol_double_sha *in, size_t num,
+		  struct protocol_double_sha *out);
+
+/* How many merkle nodes we've hashed. */
+u64 num_merkle_hashes(void);
+
 #endif /* PETTYCOIN_MERKLE_RECURSE_H */
 
 
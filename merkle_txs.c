@@ -6,28 +6,90 @@
 #include "protocol.h"
 #include "tx.h"
 #include <assert.h>
+#include <ccan/cast/cast.h>
 #include <ccan/tal/tal.h>
 #include <string.h>
 
-static void merkle_tx(size_t n, void *data, struct protocol_double_sha *merkle)
+#define MERKLE_LEVELS 8
+
+static void merkle_tx(const struct block_shard *shard, size_t n,
+		      struct protocol_double_sha *merkle)
 {
-	const struct block_shard *shard = data;
-	struct protocol_txrefhash scratch;
 	const struct protocol_txrefhash *h;
 
-	h = txrefhash_in_shard(shard, n, &scratch);
+	h = txrefhash_in_shard(shard, n);
 	merkle_two_hashes(&h->txhash.sha, &h->refhash, merkle);
 }
 
-void merkle_some_txs(const struct block_shard *shard,
-		     size_t off, size_t max,
-		     struct protocol_double_sha *merkle)
+/* We only store nodes which cover at least one tx. */
+static size_t level_nodes(const struct block_shard *shard, unsigned int level)
+{
+	return ((size_t)shard->size + (1 << level) - 1) >> level;
+}
+
+static size_t level_start(const struct block_shard *shard, unsigned int level)
+{
+	size_t off = 0;
+	unsigned int i;
+
+	for (i = 0; i < level; i++)
+		off += level_nodes(shard, i);
+	return off;
+}
+
+static const struct protocol_double_sha *
+node(const struct block_shard *shard, unsigned int level, size_t idx)
+{
+	if (idx >= level_nodes(shard, level))
+		return merkle_zero(level);
+	return &shard->merkles[level_start(shard, level) + idx];
+}
+
+static void build_tree(const struct block_shard *shard)
+{
+	struct block_shard *s = cast_const(struct block_shard *, shard);
+	unsigned int level;
+	size_t i;
+
+	assert(shard_all_hashes(shard));
+	s->merkles = tal_arr(s, struct protocol_double_sha,
+			     level_start(shard, MERKLE_LEVELS + 1));
+
+	for (i = 0; i < shard->size; i++)
+		merkle_tx(shard, i, &s->merkles[i]);
+
+	for (level = 1; level <= MERKLE_LEVELS; level++) {
+		const struct protocol_double_sha *below;
+		struct protocol_double_sha *n;
+		size_t pairs = level_nodes(shard, level-1) / 2;
+
+		below = s->merkles + level_start(shard, level-1);
+		n = s->merkles + level_start(shard, level);
+		merkle_level(below, pairs, n);
+
+		/* Odd one out gets paired with zeroes. */
+		if (pairs < level_nodes(shard, level))
+			merkle_two_hashes(&below[pairs*2],
+					  merkle_zero(level-1), &n[pairs]);
+	}
+}
+
+void shard_merkle_node(const struct block_shard *shard,
+		       unsigned int level, size_t idx,
+		       struct protocol_double_sha *merkle)
 {
-	merkle_recurse(off, shard->size, max, merkle_tx, (void *)shard, merkle);
+	assert(level <= MERKLE_LEVELS);
+	assert(idx < (256 >> level));
+
+	/* Empty shards (eg. genesis, which isn't tal-allocated) need
+	 * no tree: it's all merkle_zero(). */
+	if (!shard->merkles && shard->size)
+		build_tree(shard);
+	*merkle = *node(shard, level, idx);
 }
 
 void merkle_txs(const struct block_shard *shard,
 		struct protocol_double_sha *merkle)
 {
-	merkle_some_txs(shard, 0, 256, merkle);
+	shard_merkle_node(shard, MERKLE_LEVELS, 0, merkle);
 }
@@ -11,10 +11,12 @@ struct protocol_double_sha;
 void merkle_txs(const struct block_shard *shard,
 		struct protocol_double_sha *merkle);
 
-/* Merkle together some subset (for creating proofs). */
-void merkle_some_txs(const struct block_shard *shard,
-		     size_t off, size_t max,
-		     struct protocol_double_sha *merkle);
+/* Node idx at level (0 == txs, 8 == root) of the merkle tree.  The
+ * first call builds the whole tree and keeps it in the shard, so
+ * we must know every hash. */
+void shard_merkle_node(const struct block_shard *shard,
+		       unsigned int level, size_t idx,
+		       struct protocol_double_sha *merkle);
 
 #endif /* PETTYCOIN_MERKLE_TXS_H */
 
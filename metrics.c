@@ -0,0 +1,304 @@
+#include "jsonrpc.h"
+#include "merkle_recurse.h"
+#include "metrics.h"
+#include "peer.h"
+#include "pending.h"
+#include "pkt_names.h"
+#include "signature.h"
+#include "state.h"
+#include "todo.h"
+#include <ccan/err/err.h>
+#include <ccan/io/io.h>
+#include <ccan/str/str.h>
+#include <ccan/tal/str/str.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* So getmetrics and the text socket can share the list. */
+struct metric_out {
+	/* A family of counters or latencies, one per packet type. */
+	void (*start)(struct metric_out *out, const char *family);
+	void (*end)(struct metric_out *out);
+	void (*counter)(struct metric_out *out, const char *name, u64 val);
+	void (*latency)(struct metric_out *out, const char *name,
+			const struct metric_latency *l);
+};
+
+static void pkt_family(struct metric_out *out, const char *family,
+		       const u64 *vals)
+{
+	unsigned int i;
+
+	out->start(out, family);
+	for (i = 0; i < PROTOCOL_PKT_MAX; i++) {
+		if (vals[i])
+			out->counter(out, pkt_name(i), vals[i]);
+	}
+	out->end(out);
+}
+
+static void metrics_each(struct state *state, struct metric_out *out)
+{
+	const struct metrics *m = &state->metrics;
+	struct todo_request *todo;
+	struct peer *peer;
+	u64 num_todo = 0, num_peer_todo = 0, num_peers = 0;
+	unsigned int i;
+
+	pkt_family(out, "pkts_in", m->pkts_in);
+	pkt_family(out, "bytes_in", m->bytes_in);
+	pkt_family(out, "pkts_out", m->pkts_out);
+	pkt_family(out, "bytes_out", m->bytes_out);
+
+	out->start(out, "pkt_handle");
+	for (i = 0; i < PROTOCOL_PKT_MAX; i++) {
+		if (m->pkt_handle[i].count)
+			out->latency(out, pkt_name(i), &m->pkt_handle[i]);
+	}
+	out->end(out);
+	out->counter(out, "slow_pkts", m->num_slow_pkts);
+
+	list_for_each(&state->todo, todo, list)
+		num_todo++;
+	list_for_each(&state->peers, peer, list) {
+		struct todo_pkt *todo_pkt;
+		num_peers++;
+		list_for_each(&peer->todo, todo_pkt, list)
+			num_peer_todo++;
+	}
+	out->latency(out, "loop_late", &m->loop_late);
+	out->counter(out, "loop_stalls", m->loop_stalls);
+
+	out->counter(out, "peers", num_peers);
+	out->counter(out, "todo_added", m->todo_added);
+	out->counter(out, "todo_done", m->todo_done);
+	out->counter(out, "todo_queue", num_todo);
+	out->counter(out, "peer_todo_queue", num_peer_todo);
+
+	out->counter(out, "pending_added", m->pending_added);
+	out->counter(out, "pending_known", num_pending_known(state));
+	out->counter(out, "pending_unknown", state->pending->num_unknown);
+	out->latency(out, "pending_recheck", &m->pending_recheck);
+
+	out->counter(out, "txs_checked", m->txs_checked);
+	out->counter(out, "txs_bad", m->txs_bad);
+	out->counter(out, "sigs_checked", num_sigs_checked());
+	out->counter(out, "merkle_hashes", num_merkle_hashes());
+
+	out->counter(out, "txhash", state->txhash.raw.elems);
+	out->counter(out, "inputhash", state->inputhash.raw.elems);
+	out->counter(out, "utxo_spent", state->utxo.spent.raw.elems);
+	out->counter(out, "addrhash", state->addrhash.raw.elems);
+
+	out->latency(out, "block_check", &m->block_check);
+	out->counter(out, "blocks_loaded", m->blocks_loaded);
+	out->latency(out, "blockfile_load", &m->blockfile_load);
+	out->counter(out, "detached_blocks", state->num_detached);
+	out->counter(out, "detached_evicted", m->detached_evicted);
+}
+
+struct json_out {
+	struct metric_out out;
+	struct json_result *response;
+};
+
+static void json_start(struct metric_out *out, const char *family)
+{
+	struct json_out *j = container_of(out, struct json_out, out);
+
+	json_object_start(j->response, family);
+}
+
+static void json_end(struct metric_out *out)
+{
+	struct json_out *j = container_of(out, struct json_out, out);
+
+	json_object_end(j->response);
+}
+
+static void json_counter(struct metric_out *out, const char *name, u64 val)
+{
+	struct json_out *j = container_of(out, struct json_out, out);
+
+	json_add_u64(j->response, name, val);
+}
+
+static void json_latency(struct metric_out *out, const char *name,
+			 const struct metric_latency *l)
+{
+	struct json_out *j = container_of(out, struct json_out, out);
+	unsigned int i;
+
+	json_object_start(j->response, name);
+	json_add_u64(j->response, "count", l->count);
+	json_add_u64(j->response, "total_usec", l->total_usec);
+	json_array_start(j->response, "buckets");
+	for (i = 0; i < METRIC_LATENCY_BUCKETS; i++)
+		json_add_u64(j->response, NULL, l->bucket[i]);
+	json_array_end(j->response);
+	json_object_end(j->response);
+}
+
+static char *json_getmetrics(struct json_connection *jcon,
+			     const jsmntok_t *params,
+			     struct json_result *response)
+{
+	const struct metrics *m = &jcon->state->metrics;
+	struct json_out j;
+	u64 i;
+
+	j.out.start = json_start;
+	j.out.end = json_end;
+	j.out.counter = json_counter;
+	j.out.latency = json_latency;
+	j.response = response;
+
+	json_object_start(response, NULL);
+	metrics_each(jcon->state, &j.out);
+
+	/* Oldest first. */
+	json_add_u64(response, "slow_pkt_usec", m->slow_pkt_usec);
+	json_array_start(response, "recent_slow_pkts");
+	i = m->num_slow_pkts < METRIC_SLOW_PKTS
+		? 0 : m->num_slow_pkts - METRIC_SLOW_PKTS;
+	for (; i < m->num_slow_pkts; i++) {
+		const struct metric_slow_pkt *s;
+
+		s = &m->slow_pkts[i % METRIC_SLOW_PKTS];
+		json_object_start(response, NULL);
+		json_add_num(response, "time", s->when.ts.tv_sec);
+		json_add_num(response, "peer_num", s->peer_num);
+		json_add_string(response, "type", pkt_name(s->type));
+		json_add_num(response, "len", s->len);
+		json_add_u64(response, "usec", s->usec);
+		json_object_end(response);
+	}
+	json_array_end(response);
+	json_object_end(response);
+	return NULL;
+}
+
+const struct json_command getmetrics_command = {
+	"getmetrics", json_getmetrics,
+	"Get counters and latencies",
+	"Returns packets/bytes in/out and handling time by type, todo,"
+	" pending, tx and block counters, and recent slow packets;"
+	" latency buckets[i] counts times under 2^i usec"
+};
+
+/* Prometheus-style text, one line per sample. */
+struct text_out {
+	struct metric_out out;
+	char *text;
+	const char *family;
+};
+
+static void text_start(struct metric_out *out, const char *family)
+{
+	struct text_out *t = container_of(out, struct text_out, out);
+
+	t->family = family;
+}
+
+static void text_end(struct metric_out *out)
+{
+	struct text_out *t = container_of(out, struct text_out, out);
+
+	t->family = NULL;
+}
+
+static void text_counter(struct metric_out *out, const char *name, u64 val)
+{
+	struct text_out *t = container_of(out, struct text_out, out);
+
+	if (t->family)
+		tal_append_fmt(&t->text, "pettycoin_%s{type=\"%s\"} %"PRIu64"\n",
+			       t->family, name, val);
+	else
+		tal_append_fmt(&t->text, "pettycoin_%s %"PRIu64"\n",
+			       name, val);
+}
+
+static void text_latency(struct metric_out *out, const char *name,
+			 const struct metric_latency *l)
+{
+	struct text_out *t = container_of(out, struct text_out, out);
+	const char *label = "", *sep = "";
+	unsigned int i;
+	u64 total = 0;
+
+	/* In a family, the name is the type. */
+	if (t->family) {
+		label = tal_fmt(t->text, "type=\"%s\"", name);
+		sep = ",";
+		name = t->family;
+	}
+
+	/* Buckets are cumulative here; bucket i is <= 2^i - 1 usec. */
+	for (i = 0; i < METRIC_LATENCY_BUCKETS - 1; i++) {
+		total += l->bucket[i];
+		tal_append_fmt(&t->text,
+			       "pettycoin_%s_usec_bucket{%s%sle=\"%"PRIu64"\"}"
+			       " %"PRIu64"\n",
+			       name, label, sep, ((u64)1 << i) - 1, total);
+	}
+	tal_append_fmt(&t->text,
+		       "pettycoin_%s_usec_bucket{%s%sle=\"+Inf\"} %"PRIu64"\n"
+		       "pettycoin_%s_usec_sum{%s} %"PRIu64"\n"
+		       "pettycoin_%s_usec_count{%s} %"PRIu64"\n",
+		       name, label, sep, l->count,
+		       name, label, l->total_usec,
+		       name, label, l->count);
+}
+
+static char *metrics_text(const tal_t *ctx, struct state *state)
+{
+	struct text_out t;
+
+	t.out.start = text_start;
+	t.out.end = text_end;
+	t.out.counter = text_counter;
+	t.out.latency = text_latency;
+	t.text = tal_strdup(ctx, "");
+	t.family = NULL;
+
+	metrics_each(state, &t.out);
+	return t.text;
+}
+
+static struct io_plan *metrics_connected(struct io_conn *conn,
+					 struct state *state)
+{
+	char *text = metrics_text(conn, state);
+
+	return io_write(conn, text, strlen(text), io_close_cb, NULL);
+}
+
+void setup_metrics_socket(struct state *state, const char *filename)
+{
+	struct sockaddr_un addr;
+	int fd, old_umask;
+
+	if (streq(filename, ""))
+		return;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (strlen(filename) + 1 > sizeof(addr.sun_path))
+		errx(1, "metrics filename '%s' too long", filename);
+	strcpy(addr.sun_path, filename);
+	addr.sun_family = AF_UNIX;
+	unlink(filename);
+
+	old_umask = umask(0177);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		err(1, "Binding metrics socket to '%s'", filename);
+	umask(old_umask);
+
+	if (listen(fd, 1) != 0)
+		err(1, "Listening on '%s'", filename);
+
+	io_new_listener(state, fd, metrics_connected, state);
+}
@@ -0,0 +1,116 @@
+#ifndef PETTYCOIN_METRICS_H
+#define PETTYCOIN_METRICS_H
+#include "config.h"
+#include "protocol_net.h"
+#include <ccan/ilog/ilog.h>
+#include <ccan/short_types/short_types.h>
+#include <ccan/time/time.h>
+
+struct state;
+
+/* Bucket i counts times under 2^i usec; the last one gets the rest. */
+#define METRIC_LATENCY_BUCKETS 24
+
+struct metric_latency {
+	u64 count, total_usec;
+	u64 bucket[METRIC_LATENCY_BUCKETS];
+};
+
+/* Packets which took longer than metrics.slow_pkt_usec to handle. */
+#define METRIC_SLOW_PKTS 16
+
+struct metric_slow_pkt {
+	struct timeabs when;
+	unsigned int peer_num;
+	enum protocol_pkt_type type;
+	u32 len;
+	u64 usec;
+};
+
+/* We're single-threaded, so these are simple counters, bumped as we go.
+ * Anything we can count when asked (queue depths, etc) isn't here. */
+struct metrics {
+	/* Packets from peers, and to them, by type. */
+	u64 pkts_in[PROTOCOL_PKT_MAX], bytes_in[PROTOCOL_PKT_MAX];
+	u64 pkts_out[PROTOCOL_PKT_MAX], bytes_out[PROTOCOL_PKT_MAX];
+
+	/* How long pkt_in() took to handle each type. */
+	struct metric_latency pkt_handle[PROTOCOL_PKT_MAX];
+	/* The most recent slow ones: num_slow_pkts % METRIC_SLOW_PKTS is
+	 * the next to replace. */
+	u64 slow_pkt_usec;
+	struct metric_slow_pkt slow_pkts[METRIC_SLOW_PKTS];
+	u64 num_slow_pkts;
+
+	/* Requests we added to state->todo, and got answers for. */
+	u64 todo_added, todo_done;
+
+	/* Transactions added to pending, and how long until a recheck of
+	 * them all had them back. */
+	u64 pending_added;
+	struct metric_latency pending_recheck;
+
+	/* How late the loop watchdog was; stalls are later than stall_usec. */
+	struct metric_latency loop_late;
+	u64 stall_usec;
+	u64 loop_stalls;
+
+	/* check_tx() calls, and how many failed. */
+	u64 txs_checked, txs_bad;
+
+	/* Blocks we checked the headers of, and loaded from blockfile. */
+	struct metric_latency block_check;
+	u64 blocks_loaded;
+	struct metric_latency blockfile_load;
+
+	/* Detached blocks thrown out to make room. */
+	u64 detached_evicted;
+};
+
+static inline void metric_latency_add(struct metric_latency *l,
+				      struct timerel t)
+{
+	u64 usec = time_to_usec(t);
+	unsigned int b = usec ? ilog64(usec) : 0;
+
+	if (b >= METRIC_LATENCY_BUCKETS)
+		b = METRIC_LATENCY_BUCKETS - 1;
+	l->bucket[b]++;
+	l->count++;
+	l->total_usec += usec;
+}
+
+/* Time since start. */
+static inline struct timerel metric_latency_since(struct metric_latency *l,
+						  struct timemono start)
+{
+	struct timerel t = timemono_between(time_mono(), start);
+
+	metric_latency_add(l, t);
+	return t;
+}
+
+/* Times pkt_in() handling of type; returns true (and keeps it) if slow. */
+static inline bool metric_pkt_handled(struct metrics *m,
+				      unsigned int peer_num,
+				      enum protocol_pkt_type type, u32 len,
+				      struct timemono start, struct timerel *t)
+{
+	struct metric_slow_pkt *slow;
+
+	*t = metric_latency_since(&m->pkt_handle[type], start);
+	if (time_to_usec(*t) < m->slow_pkt_usec)
+		return false;
+
+	slow = &m->slow_pkts[m->num_slow_pkts++ % METRIC_SLOW_PKTS];
+	slow->when = time_now();
+	slow->peer_num = peer_num;
+	slow->type = type;
+	slow->len = len;
+	slow->usec = time_to_usec(*t);
+	return true;
+}
+
+/* Text dump of all metrics on this socket, if not "". */
+void setup_metrics_socket(struct state *state, const char *filename);
+#endif /* PETTYCOIN_METRICS_H */
@@ -33,9 +33,44 @@ void log_add(struct log *log, const char *fmt, ...)
 	va_end(ap);
 }
 
-void log_add_struct_(struct log *log, const char *structname, const void *ptr)
+void log_add_double_sha(struct log *log, const struct protocol_double_sha *s)
 {
-	log_add(log, "%s", structname);
+	log_add(log, "%s", "struct protocol_double_sha");
+}
+
+void log_add_block_id(struct log *log, const struct protocol_block_id *b)
+{
+	log_add(log, "%s", "struct protocol_block_id");
+}
+
+void log_add_tx_id(struct log *log, const struct protocol_tx_id *t)
+{
+	log_add(log, "%s", "struct protocol_tx_id");
+}
+
+void log_add_net_address(struct log *log, const struct protocol_net_address *addr)
+{
+	log_add(log, "%s", "struct protocol_net_address");
+}
+
+void log_add_address(struct log *log, const struct protocol_address *addr)
+{
+	log_add(log, "%s", "struct protocol_address");
+}
+
+void log_add_gateway_payment(struct log *log, const struct protocol_gateway_payment *gp)
+{
+	log_add(log, "%s", "struct protocol_gateway_payment");
+}
+
+void log_add_tx(struct log *log, const union protocol_tx *tx)
+{
+	log_add(log, "%s", "union protocol_tx");
+}
+
+void log_add_bignum(struct log *log, const struct bignum_st *bn)
+{
+	log_add(log, "%s", "struct bignum_st");
 }
 
 void log_add_enum_(struct log *log, const char *enumname, unsigned int val)
@@ -2,6 +2,7 @@
 #include "packet_io.h"
 #include "peer.h"
 #include "protocol_net.h"
+#include "state.h"
 #include "valgrind.h"
 #include <assert.h>
 #include <ccan/io/io_plan.h>
@@ -45,7 +46,7 @@ static int do_read_packet(int fd, struct io_plan_arg *arg)
 	char **pkt = arg->u1.vp;
 	int ret;
 	u32 max;
-	struct log *log = get_log_for_fd(fd);
+	struct log *log;
 
 	/* We store len in the second union */
 	len_start = arg->u2.c;
@@ -58,8 +59,6 @@ static int do_read_packet(int fd, struct io_plan_arg *arg)
 	/* Still reading len? */
 	if (*pkt >= len_start && *pkt < len_end) {
 		ret = read(fd, *pkt, len_end - *pkt);
-		if (log)
-			log_io(log, true, *pkt, ret < 0 ? 0 : ret);
 		if (ret <= 0)
 			return -1;
 		*pkt += ret;
@@ -93,13 +92,18 @@ static int do_read_packet(int fd, struct io_plan_arg *arg)
 	max = le32_to_cpu(*(le32 *)*pkt);
 
 	ret = read(fd, *pkt + arg->u2.s, max - arg->u2.s);
-	if (log)
-		log_io(log, true, *pkt + arg->u2.s, ret < 0 ? 0 : ret);
 	if (ret <= 0)
 		return -1;
 
 	arg->u2.s += ret;
-	return (arg->u2.s == max);
+	if (arg->u2.s != max)
+		return 0;
+
+	/* One entry per packet, not per read. */
+	log = get_log_for_fd(fd);
+	if (log)
+		log_io(log, true, *pkt, max);
+	return 1;
 }
 
 struct io_plan *io_read_packet_(struct io_conn *conn,
@@ -149,6 +153,12 @@ struct io_plan *peer_write_packet(struct peer *peer, const void *pkt,
 	peer->last_time_out = time_now();
 	peer->last_type_out = le32_to_cpu(((struct protocol_net_hdr*)pkt)->type);
 	peer->last_len_out = le32_to_cpu(len);
+	peer->bytes_out += le32_to_cpu(len);
+	if (peer->last_type_out < PROTOCOL_PKT_MAX) {
+		peer->state->metrics.pkts_out[peer->last_type_out]++;
+		peer->state->metrics.bytes_out[peer->last_type_out]
+			+= le32_to_cpu(len);
+	}
 	peer->out_pending = true;
 	refresh_timeout(peer->state, &peer->output_timeout);
 
@@ -46,6 +46,7 @@
 #include <ccan/tal/path/path.h>
 #include <ccan/tal/tal.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -891,11 +892,10 @@ recv_get_shard(struct peer *peer,
 		/* Success, give them all the hashes. */
 		r->err = cpu_to_le16(PROTOCOL_ECODE_NONE);
 		for (i = 0; i < s->size; i++) {
-			struct protocol_txrefhash hashes;
 			const struct protocol_txrefhash *p;
 
 			/* shard_all_hashes() means p will not be NULL! */
-			p = txrefhash_in_shard(s, i, &hashes);
+			p = txrefhash_in_shard(s, i);
 			tal_packet_append_txrefhash(&r, p);
 		}
 	}
@@ -950,39 +950,42 @@ recv_get_tx_in_block(struct peer *peer,
 	return PROTOCOL_ECODE_NONE;
 }
 
-static enum protocol_ecode
-recv_get_tx(struct peer *peer,
-	    const struct protocol_pkt_get_tx *pkt, void **reply)
+void *tx_reply(tal_t *ctx, struct state *state,
+	       const struct protocol_tx_id *txid)
 {
 	struct txhash_elem *te;
 	const union protocol_tx *tx;
 	struct protocol_pkt_tx *r;
 
-	if (le32_to_cpu(pkt->len) != sizeof(*pkt))
-		return PROTOCOL_ECODE_INVALID_LEN;
-
 	/* First look for one in a block: kill two birds with one stone. */
-	te = txhash_gettx_ancestor(peer->state, &pkt->tx,
-				   peer->state->preferred_chain);
-	if (te && shard_is_tx(te->u.block->shard[te->shardnum], te->txoff)) {
-		*reply = pkt_tx_in_block(peer, 
-					 te->u.block, te->shardnum, te->txoff);
-		return PROTOCOL_ECODE_NONE;
-	}
+	te = txhash_gettx_ancestor(state, txid, state->preferred_chain);
+	if (te && shard_is_tx(te->u.block->shard[te->shardnum], te->txoff))
+		return pkt_tx_in_block(ctx,
+				       te->u.block, te->shardnum, te->txoff);
 
 	/* Fallback is to reply with protocol_pkt_tx. */
-	r = tal_packet(peer, struct protocol_pkt_tx, PROTOCOL_PKT_TX);
+	r = tal_packet(ctx, struct protocol_pkt_tx, PROTOCOL_PKT_TX);
 
 	/* Does this exist at all (maybe in pending)? */
-	tx = txhash_gettx(&peer->state->txhash, &pkt->tx, TX_PENDING);
+	tx = txhash_gettx(&state->txhash, txid, TX_PENDING);
 	if (tx) {
 		r->err = cpu_to_le32(PROTOCOL_ECODE_NONE);
 		tal_packet_append_tx(&r, tx);
 	} else {
 		r->err = cpu_to_le32(PROTOCOL_ECODE_UNKNOWN_TX);
-		tal_packet_append_tx_id(&r, &pkt->tx);
+		tal_packet_append_tx_id(&r, txid);
 	}
-	*reply = r;
+	return r;
+}
+
+static enum protocol_ecode
+recv_get_tx(struct peer *peer,
+	    const struct protocol_pkt_get_tx *pkt, void **reply)
+{
+	if (le32_to_cpu(pkt->len) != sizeof(*pkt))
+		return PROTOCOL_ECODE_INVALID_LEN;
+
+	*reply = tx_reply(peer, peer->state, &pkt->tx);
 	return PROTOCOL_ECODE_NONE;
 }
 
@@ -1309,6 +1312,23 @@ again:
 	return PROTOCOL_ECODE_BAD_INPUT;
 }
 
+static void pkt_handled(struct peer *peer, enum protocol_pkt_type type,
+			u32 len, struct timemono start)
+{
+	struct timerel t;
+
+	if (type >= PROTOCOL_PKT_MAX)
+		return;
+
+	if (!metric_pkt_handled(&peer->state->metrics, peer->peer_num,
+				type, len, start, &t))
+		return;
+
+	log_unusual(peer->log, "Slow packet: %"PRIu64" usec for %u byte ",
+		    time_to_usec(t), len);
+	log_add_enum(peer->log, enum protocol_pkt_type, type);
+}
+
 static struct io_plan *pkt_in(struct io_conn *conn, struct peer *peer)
 {
 	const struct protocol_net_hdr *hdr = peer->incoming;
@@ -1317,6 +1337,7 @@ static struct io_plan *pkt_in(struct io_conn *conn, struct peer *peer)
 	enum protocol_pkt_type type;
 	enum protocol_ecode err;
 	void *reply = NULL;
+	struct timemono start = time_mono();
 
 	peer->in_pending = false;
 	peer->last_time_in = time_now();
@@ -1326,6 +1347,12 @@ static struct io_plan *pkt_in(struct io_conn *conn, struct peer *peer)
 	len = le32_to_cpu(hdr->len);
 	type = le32_to_cpu(hdr->type);
 
+	peer->bytes_in += len;
+	if (type < PROTOCOL_PKT_MAX) {
+		peer->state->metrics.pkts_in[type]++;
+		peer->state->metrics.bytes_in[type] += len;
+	}
+
 	log_debug(peer->log, "pkt_in: received ");
 	log_add_enum(peer->log, enum protocol_pkt_type, type);
 
@@ -1352,6 +1379,12 @@ static struct io_plan *pkt_in(struct io_conn *conn, struct peer *peer)
 	case PROTOCOL_PKT_CHILDREN:
 		err = recv_children(peer, peer->incoming);
 		break;
+	case PROTOCOL_PKT_GET_HEADERS:
+		err = recv_get_headers(peer, peer->incoming, &reply);
+		break;
+	case PROTOCOL_PKT_HEADERS:
+		err = recv_headers(peer, peer->incoming);
+		break;
 	case PROTOCOL_PKT_SET_FILTER:
 		err = recv_set_filter(peer, peer->incoming);
 		break;
@@ -1435,13 +1468,13 @@ static struct io_plan *pkt_in(struct io_conn *conn, struct peer *peer)
 	case PROTOCOL_PKT_WELCOME:
 
 	/* These ones never valid. */
-	case PROTOCOL_PKT_UNUSED1:
-	case PROTOCOL_PKT_UNUSED2:
 	case PROTOCOL_PKT_NONE:
 	case PROTOCOL_PKT_MAX:
 		err = PROTOCOL_ECODE_UNKNOWN_COMMAND;
 	}
 
+	pkt_handled(peer, type, len, start);
+
 	if (err) {
 		peer->error_pkt = err_pkt(peer, err);
 
@@ -1479,6 +1512,7 @@ static struct io_plan *welcome_received(struct io_conn *conn, struct peer *peer)
 	peer->last_time_in = time_now();
 	peer->last_type_in = le32_to_cpu(peer->welcome->type);
 	peer->last_len_in = le32_to_cpu(peer->welcome->len);
+	peer->bytes_in += peer->last_len_in;
 	
 	log_debug(peer->log, "Their welcome received");
 
@@ -1531,6 +1565,11 @@ static struct io_plan *welcome_received(struct io_conn *conn, struct peer *peer)
 
 	/* They don't send a block if they have only the genesis. */
 	if (peer->wblock.len) {
+		/* Rather than chase its prevs, we'll ask for headers (if
+		 * they understand: old nodes hang up on GET_HEADERS). */
+		peer->headers_syncing = state->headers_first
+			&& (le16_to_cpu(peer->welcome->you.unused)
+			    & PROTOCOL_NET_CAP_HEADERS);
 		e = recv_welcome_block(peer, peer->welcome,
 				       hdr, peer->wblock.len,
 				       &peer->wblock.id);
@@ -1548,6 +1587,15 @@ static struct io_plan *welcome_received(struct io_conn *conn, struct peer *peer)
 		 * packet, but there's a potential race with input, so
 		 * don't let that happen).. */
 		peer->welcome = tal_packet_dup(peer, peer->welcome);
+
+		if (peer->headers_syncing) {
+			if (block_find_any(state, &peer->wblock.id))
+				peer->headers_syncing = false;
+			else
+				todo_for_peer(peer,
+					      get_headers_pkt(peer,
+						state->longest_chains[0]));
+		}
 	}
 
 	/* Time to go duplex on this connection: input reads packet,
@@ -1640,6 +1688,7 @@ struct io_plan *peer_connected(struct io_conn *conn, struct state *state,
 	list_add(&state->peers, &peer->list);
 	peer->state = state;
 	peer->we_are_syncing = true;
+	peer->headers_syncing = false;
 	peer->they_are_syncing = true;
 	peer->error_pkt = NULL;
 	peer->welcome = NULL;
@@ -1658,6 +1707,7 @@ struct io_plan *peer_connected(struct io_conn *conn, struct state *state,
 	peer->last_time_in.ts.tv_nsec = peer->last_time_out.ts.tv_nsec = 0;
 	peer->last_type_in = peer->last_type_out = PROTOCOL_PKT_NONE;
 	peer->last_len_in = peer->last_len_out = 0;
+	peer->bytes_in = peer->bytes_out = 0;
 	peer->out_pending = peer->in_pending = 0;
 
 	/* Use address as log prefix. */
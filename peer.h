@@ -5,6 +5,7 @@
 #include "protocol_net.h"
 #include "timeout.h"
 #include <ccan/list/list.h>
+#include <ccan/tal/tal.h>
 #include <ccan/time/time.h>
 #include <stdbool.h>
 
@@ -31,6 +32,9 @@ struct peer {
 	/* Are we still syncing with this peer? */
 	bool we_are_syncing;
 
+	/* Are we getting their chain by PROTOCOL_PKT_GET_HEADERS? */
+	bool headers_syncing;
+
 	/* Should we send them tx's (ie. are *they* finished syncing) */
 	bool they_are_syncing;
 
@@ -63,6 +67,7 @@ struct peer {
 	struct timeabs last_time_in, last_time_out;
 	enum protocol_pkt_type last_type_in, last_type_out;
 	size_t last_len_in, last_len_out;
+	u64 bytes_in, bytes_out;
 	bool out_pending, in_pending;
 
 	/* Number of requests we have outstanding (see todo.c) */
@@ -91,6 +96,10 @@ void send_tx_to_peers(struct state *state, struct peer *exclude,
 
 void wake_peers(struct state *state);
 
+/* Answer for protocol_pkt_get_tx: tx_in_block if we can, otherwise tx. */
+void *tx_reply(tal_t *ctx, struct state *state,
+	       const struct protocol_tx_id *txid);
+
 void send_block_to_peers(struct state *state,
 			 struct peer *exclude,
 			 const struct block *block);
@@ -3,6 +3,7 @@
 #include "check_tx.h"
 #include "create_refs.h"
 #include "generating.h"
+#include "loop.h"
 #include "peer.h"
 #include "pending.h"
 #include "shard.h"
@@ -12,6 +13,7 @@
 #include "tx.h"
 #include "tx_cmp.h"
 #include "tx_in_hashes.h"
+#include "watch.h"
 #include <ccan/array_size/array_size.h>
 #include <ccan/asort/asort.h>
 #include <ccan/structeq/structeq.h>
@@ -28,6 +30,8 @@ struct pending_block *new_pending_block(struct state *state)
 	list_head_init(&b->unknown_tx);
 	b->num_unknown = 0;
 	b->needs_recheck = false;
+	b->tip = NULL;
+	b->recheck = NULL;
 	return b;
 }
 
@@ -67,12 +71,21 @@ void block_to_pending(struct state *state, const struct block *block)
 	for (shard = 0; shard < num_shards(block->bi.hdr); shard++) {
 		for (i = 0; i < block->bi.num_txs[shard]; i++) {
 			const union protocol_tx *tx;
+			struct protocol_tx_id sha;
 
 			tx = tx_for(block->shard[shard], i);
 			if (!tx)
 				continue;
-			/* recheck_pending_txs() will sort it out */
+			hash_tx(tx, &sha);
+			if (txhash_get_pending_tx(state, &sha))
+				continue;
+
+			/* The block keeps its own; we hash ours like any
+			 * other pending tx.  recheck_pending_txs() will sort
+			 * it out. */
+			tx = tx_dup(state->pending, tx);
 			add_to_unknown_pending(state, tx);
+			add_pending_tx_to_hashes(state, state->pending, tx);
 			state->pending->needs_recheck = true;
 		}
 	}
@@ -127,11 +140,15 @@ static bool insert_pending_tx(struct state *state, const union protocol_tx *tx)
 	pend->refs = create_refs(state, state->longest_knowns[0], tx, 1);
 
 	/* If inputs are too *old*, we can fail to make references. */
-	if (!pend->refs)
+	if (!pend->refs) {
+		tal_steal(state->pending, tx);
+		tal_free(pend);
 		return false;
+	}
 
 	/* Insert into array at pos. */
 	tal_arr_add(&pending->pend[shard], pos, pend);
+	state->metrics.pending_added++;
 
 	log_debug(state->log, "Added tx to shard %u position %zu",
 		  shard, pos);
@@ -150,108 +167,218 @@ size_t num_pending_known(struct state *state)
 	return known;
 }
 
-/* We've added a whole heap of transactions, recheck them and set input refs. */
-void recheck_pending_txs(struct state *state)
+/* Is tx still waiting to be rechecked? */
+static bool recheck_queued(const struct pending_block *pending,
+			   const union protocol_tx *tx)
 {
-	unsigned int unknown, known, total;
-	unsigned int i, shard;
-	const union protocol_tx **txs;
-	struct pending_unknown_tx *utx;
-
-	if (!state->pending->needs_recheck)
-		return;
+	size_t i;
 
-	state->pending->needs_recheck = false;
+	if (!pending->recheck)
+		return false;
 
-	/* Size up and allocate an array. */
-	unknown = state->pending->num_unknown;
-	known = num_pending_known(state);
+	for (i = pending->num_rechecked; i < tal_count(pending->recheck); i++)
+		if (pending->recheck[i] == tx)
+			return true;
+	return false;
+}
 
-	/* Avoid logging if nothing pending. */
-	if (unknown == 0 && known == 0)
-		return;
-	
-	txs = tal_arr(state, const union protocol_tx *, unknown + known);
+/* When rechecking tx, it's pending itself, and we only count ones which
+ * are ahead of it in the queue (first seen wins). */
+static bool find_pending_doublespend(struct state *state,
+				     const union protocol_tx *tx,
+				     bool rechecking)
+{
+	unsigned int i;
 
-	log_info(state->log, "Rechecking pending (%u known, %u unknown)",
-		  known, unknown);
+	for (i = 0; i < num_inputs(tx); i++) {
+		struct inputhash_elem *ie;
+		struct inputhash_iter iter;
+		const struct protocol_input *inp = tx_input(tx, i);
 
-	/* Now move pending from shards. */
-	total = 0;
-	for (shard = 0; shard < ARRAY_SIZE(state->pending->pend); shard++) {
-		struct pending_tx **pend = state->pending->pend[shard];
-		unsigned int i;
+		for (ie = inputhash_firstval(&state->inputhash, &inp->input,
+				     le16_to_cpu(inp->output), &iter);
+		     ie;
+		     ie = inputhash_nextval(&state->inputhash, &inp->input,
+					    le16_to_cpu(inp->output), &iter)) {
+			const union protocol_tx *other;
 
-		for (i = 0; i < tal_count(pend); i++) {
-			remove_pending_tx_from_hashes(state, pend[i]->tx);
-			txs[total++] = tal_steal(txs, pend[i]->tx);
+			/* OK, is the tx which spend it pending? */
+			other = txhash_get_pending_tx(state, &ie->used_by);
+			if (!other)
+				continue;
+			if (rechecking
+			    && (other == tx
+				|| recheck_queued(state->pending, other)))
+				continue;
+			return true;
 		}
 	}
+	return false;
+}
 
-	/* And last we move the unknown ones. */
-	while ((utx = list_pop(&state->pending->unknown_tx,
-			       struct pending_unknown_tx, list)) != NULL) {
-		remove_pending_tx_from_hashes(state, utx->tx);
-		txs[total++] = tal_steal(txs, utx->tx);
+/* Drop a tx which was pending, but isn't any more. */
+static void forget_pending_tx(struct state *state,
+			      const union protocol_tx *tx)
+{
+	remove_pending_tx_from_hashes(state, tx);
+	tal_free(tx);
+}
+
+/* tx is still in the hashes: put it back, or forget it. */
+static void recheck_pending_tx(struct state *state,
+			       const union protocol_tx *tx)
+{
+	enum input_ecode ierr;
+	unsigned int bad_input_num;
+	struct protocol_tx_id sha;
+
+	/* It may be in the chain now. */
+	hash_tx(tx, &sha);
+	if (txhash_gettx_ancestor(state, &sha, state->longest_knowns[0])) {
+		forget_pending_tx(state, tx);
+		return;
 	}
 
-	assert(total == unknown + known);
+	ierr = check_tx_inputs(state, state->longest_knowns[0],
+			       NULL, tx, &bad_input_num);
+	if (ierr == ECODE_INPUT_OK && find_pending_doublespend(state, tx, true))
+		ierr = ECODE_INPUT_DOUBLESPEND;
 
-	/* Clean up pending (frees everything above as a side effect). */
-	tal_free(state->pending);
-	state->pending = new_pending_block(state);
+	switch (ierr) {
+	case ECODE_INPUT_OK:
+		/* This makes fresh refs against the new tip. */
+		if (insert_pending_tx(state, tx))
+			return;
+		break;
+	case ECODE_INPUT_UNKNOWN:
+		add_to_unknown_pending(state, tx);
+		return;
+	case ECODE_INPUT_BAD:
+	case ECODE_INPUT_BAD_AMOUNT:
+	case ECODE_INPUT_DOUBLESPEND:
+	case ECODE_INPUT_CLAIM_BAD:
+		log_debug(state->log, "Recheck of tx inputs said ");
+		log_add_enum(state->log, enum input_ecode, ierr);
+		log_add(state->log, " for tx ");
+		log_add_struct(state->log, union protocol_tx, tx);
+		break;
+	}
+	forget_pending_tx(state, tx);
+}
 
-	/* Now re-add them */
-	for (i = 0; i < tal_count(txs); i++) {
-		unsigned int bad_input_num;
-		struct protocol_tx_id sha;
+/* How many txs to recheck per call: the loop checks the time between. */
+#define RECHECK_BATCH 16
 
-		hash_tx(txs[i], &sha);
-		add_pending_tx(state, txs[i], &sha, &bad_input_num, NULL, NULL);
+/* Recheck some of pending->recheck; false when they're all done. */
+static bool recheck_some_pending(struct state *state, void *unused)
+{
+	struct pending_block *pending = state->pending;
+	size_t num = tal_count(pending->recheck), end;
+
+	end = pending->num_rechecked + RECHECK_BATCH;
+	if (end > num)
+		end = num;
+
+	while (pending->num_rechecked < end) {
+		const union protocol_tx *tx
+			= pending->recheck[pending->num_rechecked++];
+
+		/* drop_pending_tx() may have taken it already. */
+		if (tx)
+			recheck_pending_tx(state, tx);
 	}
 
-	/* Just to print the debug! */		
-	known = 0;
-	for (shard = 0; shard < ARRAY_SIZE(state->pending->pend); shard++)
-		known += tal_count(state->pending->pend[shard]);
+	if (pending->num_rechecked < num)
+		return true;
 
-	log_info(state->log, "Now have %u known, %u unknown",
-		  known, state->pending->num_unknown);
+	pending->recheck = tal_free(pending->recheck);
 
-	/* Restart generator on this block. */
-	restart_generating(state);
+	log_info(state->log, "Now have %zu known, %u unknown",
+		 num_pending_known(state), pending->num_unknown);
+	metric_latency_since(&state->metrics.pending_recheck,
+			     pending->recheck_start);
+	return false;
 }
 
-static bool find_pending_doublespend(struct state *state,
-				     const union protocol_tx *tx)
+void recheck_pending_txs(struct state *state)
 {
-	unsigned int i;
+	struct pending_block *pending = state->pending;
+	const struct block *tip = state->longest_knowns[0];
+	struct pending_unknown_tx *utx;
+	unsigned int unknown, known, shard;
+	size_t i, left;
 
-	for (i = 0; i < num_inputs(tx); i++) {
-		struct inputhash_elem *ie;
-		struct inputhash_iter iter;
-		const struct protocol_input *inp = tx_input(tx, i);
+	if (!pending->needs_recheck)
+		return;
 
-		for (ie = inputhash_firstval(&state->inputhash, &inp->input,
-				     le16_to_cpu(inp->output), &iter);
-		     ie;
-		     ie = inputhash_nextval(&state->inputhash, &inp->input,
-					    le16_to_cpu(inp->output), &iter)) {
-			/* OK, is the tx which spend it pending? */
-			if (txhash_get_pending_tx(state, &ie->used_by))
-				return true;
+	pending->needs_recheck = false;
+
+	/* Known ones are fine unless the tip (hence their refs) moved. */
+	unknown = pending->num_unknown;
+	known = pending->tip != tip ? num_pending_known(state) : 0;
+
+	/* Avoid logging if nothing pending. */
+	if (unknown == 0 && known == 0) {
+		pending->tip = tip;
+		return;
+	}
+
+	log_info(state->log, "Rechecking pending (%u known, %u unknown)",
+		  known, unknown);
+
+	/* They all stay in the hashes meanwhile, so we don't take a
+	 * doublespend of them, or relay them again.  Checking each one can
+	 * take a while, so we do it a slice at a time.  If we're already
+	 * going, these go on the end. */
+	if (!pending->recheck) {
+		pending->recheck = tal_arr(pending, const union protocol_tx *,
+					   0);
+		pending->num_rechecked = 0;
+		pending->recheck_start = time_mono();
+		add_work(state, recheck_some_pending, NULL);
+	} else {
+		left = tal_count(pending->recheck) - pending->num_rechecked;
+		memmove(pending->recheck,
+			pending->recheck + pending->num_rechecked,
+			left * sizeof(pending->recheck[0]));
+		tal_resize(&pending->recheck, left);
+		pending->num_rechecked = 0;
+	}
+
+	/* Ones we'd accepted go first, so they win any doublespend. */
+	if (pending->tip != tip) {
+		for (shard = 0; shard < ARRAY_SIZE(pending->pend); shard++) {
+			struct pending_tx **pend = pending->pend[shard];
+
+			for (i = 0; i < tal_count(pend); i++) {
+				tal_arr_append(&pending->recheck,
+					       tal_steal(pending, pend[i]->tx));
+				tal_free(pend[i]);
+			}
+			tal_resize(&pending->pend[shard], 0);
 		}
+		pending->tip = tip;
+
+		/* Generator's working on the old tip, with the old refs. */
+		restart_generating(state);
 	}
-	return false;
+
+	while ((utx = list_pop(&pending->unknown_tx,
+			       struct pending_unknown_tx, list)) != NULL) {
+		tal_arr_append(&pending->recheck, tal_steal(pending, utx->tx));
+		tal_free(utx);
+	}
+	pending->num_unknown = 0;
 }
 
 /* FIXME: Return ECODE_INPUT_UNKNOWN if input is actually pending! */
-enum input_ecode add_pending_tx(struct state *state,
-				const union protocol_tx *tx,
-				const struct protocol_tx_id *sha,
-				unsigned int *bad_input_num,
-				bool *too_old,
-				bool *already_known)
+static enum input_ecode add_pending_tx_(struct state *state,
+					const union protocol_tx *tx,
+					const struct protocol_tx_id *sha,
+					unsigned int *bad_input_num,
+					bool *too_old,
+					bool *already_known,
+					bool notify)
 {
 	enum input_ecode ierr;
 
@@ -281,7 +408,7 @@ enum input_ecode add_pending_tx(struct state *state,
 
 	if (ierr == ECODE_INPUT_OK) {
 		/* But that doesn't find doublespends in *pending*. */
-		if (find_pending_doublespend(state, tx))
+		if (find_pending_doublespend(state, tx, false))
 			ierr = ECODE_INPUT_DOUBLESPEND;
 	}
 
@@ -334,6 +461,7 @@ enum input_ecode add_pending_tx(struct state *state,
 	if (ierr == ECODE_INPUT_UNKNOWN)
 		add_to_unknown_pending(state, tx);
 	else if (!insert_pending_tx(state, tx)) {
+		tal_free(tx);
 		if (too_old)
 			*too_old = true;
 		return ECODE_INPUT_BAD;
@@ -341,9 +469,22 @@ enum input_ecode add_pending_tx(struct state *state,
 
 	/* Now put it in txhash and inputhash */
 	add_pending_tx_to_hashes(state, state->pending, tx);
+	if (notify)
+		watch_tx(state, tx, NULL, WATCH_PENDING);
 	return ierr;
 }
 
+enum input_ecode add_pending_tx(struct state *state,
+				const union protocol_tx *tx,
+				const struct protocol_tx_id *sha,
+				unsigned int *bad_input_num,
+				bool *too_old,
+				bool *already_known)
+{
+	return add_pending_tx_(state, tx, sha, bad_input_num,
+			       too_old, already_known, true);
+}
+
 static void remove_pending_tx(struct state *state,
 			      u16 shard, unsigned int i)
 {
@@ -357,13 +498,16 @@ void drop_pending_tx(struct state *state, const union protocol_tx *tx)
 {
 	struct pending_tx **pend;
 	u16 shard;
-	size_t pos;
+	size_t pos, i;
 	struct protocol_tx_id sha;
 
 	hash_tx(tx, &sha);
 	if (!txhash_get_pending_tx(state, &sha))
 		return;
 
+	/* Otherwise txhash (and addrhash) would point at freed tx. */
+	remove_pending_tx_from_hashes(state, tx);
+
 	shard = shard_of_tx(tx, next_shard_order(state->longest_knowns[0]));
 	pend = state->pending->pend[shard];
 
@@ -385,6 +529,22 @@ void drop_pending_tx(struct state *state, const union protocol_tx *tx)
 			return;
 		}
 
+		/* Or waiting to be rechecked. */
+		for (i = state->pending->num_rechecked;
+		     state->pending->recheck
+			     && i < tal_count(state->pending->recheck);
+		     i++) {
+			const union protocol_tx *rtx
+				= state->pending->recheck[i];
+
+			if (!rtx || tx_len(rtx) != tx_len(tx))
+				continue;
+			if (memcmp(rtx, tx, tx_len(tx)) != 0)
+				continue;
+			state->pending->recheck[i] = tal_free(rtx);
+			return;
+		}
+
 		/* Hash said it was here somewhere! */
 		abort();
 		
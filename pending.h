@@ -5,6 +5,7 @@
 #include "protocol.h"
 #include <ccan/short_types/short_types.h>
 #include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
 
 struct pending_tx {
 	const union protocol_tx *tx;
@@ -22,9 +23,17 @@ struct pending_block {
 	/* Available for the next block. */
 	struct pending_tx **pend[1 << PROTOCOL_INITIAL_SHARD_ORDER];
 
+	/* What the refs in pend[] were made against. */
+	const struct block *tip;
+
 	/* Has the chain changed? */
 	bool needs_recheck;
 
+	/* Txs still to recheck, from [num_rechecked] on (NULL if none). */
+	const union protocol_tx **recheck;
+	size_t num_rechecked;
+	struct timemono recheck_start;
+
 	/* List of pending_unknown_tx. */
 	struct list_head unknown_tx;
 	unsigned int num_unknown;
@@ -3,6 +3,8 @@
 #include "generating.h"
 #include "jsonrpc.h"
 #include "log.h"
+#include "loop.h"
+#include "metrics.h"
 #include "netaddr.h"
 #include "peer.h"
 #include "peer_cache.h"
@@ -198,6 +200,50 @@ static char *arg_log_level(const char *arg, struct state *state)
 	return NULL;
 }
 
+static char *arg_log_io(const char *arg, struct state *state)
+{
+	unsigned int every;
+	char *err = opt_set_uintval(arg, &every);
+
+	if (err)
+		return err;
+	set_log_io_default(state->lr, every);
+	set_log_io(state->log, every);
+	return NULL;
+}
+
+static char *decode_log_and_exit(const char *arg, struct state *state)
+{
+	struct log_record *lr = load_log_record(state, arg);
+
+	if (!lr)
+		err(1, "Loading log %s", arg);
+	log_to_file(STDOUT_FILENO, lr);
+	exit(0);
+}
+
+static char *arg_slow_packet(const char *arg, struct state *state)
+{
+	unsigned int msec;
+	char *err = opt_set_uintval(arg, &msec);
+
+	if (err)
+		return err;
+	state->metrics.slow_pkt_usec = (u64)msec * 1000;
+	return NULL;
+}
+
+static char *arg_stall(const char *arg, struct state *state)
+{
+	unsigned int msec;
+	char *err = opt_set_uintval(arg, &msec);
+
+	if (err)
+		return err;
+	state->metrics.stall_usec = (u64)msec * 1000;
+	return NULL;
+}
+
 static char *arg_log_prefix(const char *arg, struct state *state)
 {
 	set_log_prefix(state->log, arg);
@@ -289,7 +335,8 @@ static char *set_reward_address(const char *arg, struct state *state)
 
 int main(int argc, char *argv[])
 {
-	char *pettycoin_dir, *rpc_filename;
+	char *pettycoin_dir, *rpc_filename, *log_file = "log";
+	char *metrics_file = "";
 	struct state *state;
 	unsigned int portnum = 0;
 	struct timer *expired;
@@ -309,14 +356,31 @@ int main(int argc, char *argv[])
 
 	opt_register_arg("--log-level", arg_log_level, NULL, state,
 			 "log level (debug, info, unusual, broken)");
+	opt_register_arg("--log-io", arg_log_io, NULL, state,
+			 "Keep one in this many packets in the log (0 for none)");
 	opt_register_arg("--log-prefix", arg_log_prefix, NULL, state,
 			 "log prefix");
+	opt_register_arg("--log-file", opt_set_charp, opt_show_charp,
+			 &log_file,
+			 "File in pettycoin dir to keep log in (\"\" for none)");
+	opt_register_arg("--slow-packet-ms", arg_slow_packet, NULL, state,
+			 "Log packets which take longer than this to handle");
+	opt_register_arg("--stall-ms", arg_stall, NULL, state,
+			 "Log if the main loop blocks for longer than this");
+	opt_register_arg("--metrics-socket", opt_set_charp, opt_show_charp,
+			 &metrics_file,
+			 "Socket in pettycoin dir to dump metrics as text on");
+	opt_register_early_arg("--decode-log", decode_log_and_exit, NULL,
+			       state, "Print log file from a previous run");
 	opt_register_arg("--connect", add_connect, NULL, state,
 			 "Node to connect to (can be specified multiple times)");
 	opt_register_arg("--port", opt_set_uintval, NULL, &portnum,
 			 "Port to bind to (otherwise, dynamic port is used)");
 	opt_register_noarg("--seeding", opt_set_bool, &state->nopeers_ok,
 			 "Don't exit if there are no peers to connect to");
+	opt_register_noarg("--no-headers-first", opt_set_invbool,
+			   &state->headers_first,
+			   "Sync by chasing prevs, rather than asking for headers");
 
 	/* Generation options. */
 	opt_register_arg("--generator", opt_set_charp, opt_show_charp,
@@ -329,6 +393,9 @@ int main(int argc, char *argv[])
 	opt_register_noarg("--require-gateway-fees", opt_set_bool,
 			 &state->require_gateway_tx_fee,
 			 "Never mine gateway transactions without a fee");
+	opt_register_noarg("--index-addresses", opt_set_bool,
+			 &state->index_addresses,
+			 "Index transactions by address, for listtransactions");
 
 	opt_register_noarg("--developer-test",
 			   opt_set_bool, &state->developer_test,
@@ -363,6 +430,11 @@ int main(int argc, char *argv[])
 	if (argc != 1)
 		errx(1, "no arguments accepted");
 
+	/* Keep log in a file, so we have it even if we crash. */
+	if (!streq(log_file, "") && !set_log_file(state->lr, log_file))
+		log_unusual(state->log, "Could not map log file %s: %s",
+			    log_file, strerror(errno));
+
 	/* Start up. */
 	load_blocks(state);
 	init_peer_cache(state);
@@ -370,6 +442,8 @@ int main(int argc, char *argv[])
 	fill_peers(state);
 	start_generating(state);
 	setup_jsonrpc(state, rpc_filename);
+	setup_metrics_socket(state, metrics_file);
+	start_loop_watchdog(state);
 
 	/* We handle write errors, don't kill us! */
 	signal(SIGPIPE, SIG_IGN);
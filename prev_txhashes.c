@@ -8,6 +8,8 @@
 #include "shadouble.h"
 #include "shard.h"
 #include <ccan/array_size/array_size.h>
+#include <ccan/cast/cast.h>
+#include <ccan/structeq/structeq.h>
 
 size_t num_prev_txhashes(const struct block *prev_block)
 {
@@ -23,8 +25,8 @@ size_t num_prev_txhashes(const struct block *prev_block)
 
 /* Hash has block reward address prepended, so you can prove you know
  * all the transactions. */
-u8 prev_txhash(const struct protocol_address *addr,
-	       const struct block *block, u16 shard)
+static u8 hash_shard(const struct protocol_address *addr,
+		     const struct block *block, u16 shard)
 {
 	SHA256_CTX shactx;
 	struct protocol_double_sha sha;
@@ -49,6 +51,28 @@ u8 prev_txhash(const struct protocol_address *addr,
 	return sha.sha[0];
 }
 
+/* The address is first, so there's no midstate to share between
+ * addresses.  But we almost always ask with the same one (ours when
+ * generating, the same miner's when checking), so remember it. */
+u8 prev_txhash(const struct protocol_address *addr,
+	       const struct block *block, u16 shard)
+{
+	struct block_shard *s = cast_const(struct block_shard *,
+					   block->shard[shard]);
+
+	/* Contents can't change once we know them all. */
+	if (!shard_all_known(s))
+		return hash_shard(addr, block, shard);
+
+	if (!s->prev_txhash_valid
+	    || !structeq(&s->prev_txhash_addr, addr)) {
+		s->prev_txhash = hash_shard(addr, block, shard);
+		s->prev_txhash_addr = *addr;
+		s->prev_txhash_valid = true;
+	}
+	return s->prev_txhash;
+}
+
 u8 *make_prev_txhashes(const tal_t *ctx, const struct block *prev_block,
 		      const struct protocol_address *my_addr)
 {
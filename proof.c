@@ -27,16 +27,10 @@ void create_proof(struct protocol_proof *proof,
 	/* We only should get rid of shard->proofs once we can make our own. */
 	assert(shard_all_hashes(shard));
 
-	for (i = 0; i < 8; i++) {
-		if (txoff & (1 << i))
-			/* Hash the left side together. */
-			merkle_some_txs(shard, 0, 1 << i,
-					&proof->merkles.merkle[i]);
-		else
-			/* Hash the right side together */
-			merkle_some_txs(shard, 1 << i, 1 << i,
-					&proof->merkles.merkle[i]);
-	}
+	/* Sibling at each level of the (cached) merkle tree. */
+	for (i = 0; i < 8; i++)
+		shard_merkle_node(shard, i, (txoff >> i) ^ 1,
+				  &proof->merkles.merkle[i]);
 }
 
 /* What does proof say the merkle should be? */
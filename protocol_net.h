@@ -44,8 +44,10 @@ enum protocol_pkt_type {
 	PROTOCOL_PKT_ERR,
 	/* Hi, my version is, and my hobbies are... */
 	PROTOCOL_PKT_WELCOME,
-	PROTOCOL_PKT_UNUSED1,
-	PROTOCOL_PKT_UNUSED2,
+	/* Please tell me the blocks after these (headers-first sync). */
+	PROTOCOL_PKT_GET_HEADERS,
+	/* Here are some blocks, in order (response to above). */
+	PROTOCOL_PKT_HEADERS,
 	/* Please tell me about this block's children. */
 	PROTOCOL_PKT_GET_CHILDREN,
 	/* Here's info about this block's children (response to above). */
@@ -112,7 +114,7 @@ struct protocol_pkt_welcome {
 	le16 listen_port;
 	/* Duplicate detection */
 	struct protocol_net_uuid uuid;
-	/* Address we see you at. */
+	/* Address we see you at (you.unused holds our PROTOCOL_NET_CAP_*). */
 	struct protocol_net_address you;
 	/* What shards we're interested in. */
 	u8 interests[65536/8];
@@ -252,6 +254,36 @@ struct protocol_pkt_hashes_in_block {
 	struct protocol_hashes_with_proof hproof;
 };
 
+/* In the welcome's you.unused (old nodes send 0): we understand
+ * PROTOCOL_PKT_GET_HEADERS.  Don't send it to those who don't! */
+#define PROTOCOL_NET_CAP_HEADERS 0x0001
+
+/* Most we put in a PROTOCOL_PKT_HEADERS. */
+#define PROTOCOL_MAX_HEADERS 256
+
+/* Ask for the blocks on your best chain after one of these (reply will
+ * be PROTOCOL_PKT_HEADERS). */
+struct protocol_pkt_get_headers {
+	le32 len; /* sizeof(struct protocol_pkt_get_headers) */
+	le32 type; /* PROTOCOL_PKT_GET_HEADERS */
+
+	/* Our best block, then 1, 3, 7, 15... blocks back (0 past genesis).
+	 * Like the prevs in a block header, so you can find where we fork. */
+	struct protocol_block_id locator[PROTOCOL_NUM_PREV_IDS];
+};
+
+/* The blocks after the first in the locator on our best chain (genesis
+ * if none), in order, up to PROTOCOL_MAX_HEADERS or what fits in a
+ * packet.  None means the first in the locator is our best block. */
+struct protocol_pkt_headers {
+	le32 len; /* sizeof(struct protocol_pkt_headers) + ... */
+	le32 type; /* PROTOCOL_PKT_HEADERS */
+
+	le32 num;
+	/* Followed by num of: le32 len, then that many bytes of marshaled
+	 * block (as in PROTOCOL_PKT_BLOCK). */
+};
+
 /* Ask for a specific block (reply will be PROTOCOL_PKT_BLOCK). */
 struct protocol_pkt_get_block {
 	le32 len; /* sizeof(struct protocol_pkt_get_block) */
@@ -23,6 +23,7 @@
 #include "tal_packet.h"
 #include "timestamp.h"
 #include "todo.h"
+#include "tx_cmp.h"
 #include "tx_in_hashes.h"
 #include <ccan/structeq/structeq.h>
 
@@ -66,7 +67,8 @@ static u32 min_difficulty(struct state *state, u32 height)
 static void seek_predecessor(struct state *state, 
 			     const tal_t *pkt_ctx,
 			     const struct protocol_block_id *sha,
-			     const struct block_info *bi)
+			     const struct block_info *bi,
+			     bool ask_prevs)
 {
 	u32 min_diff;
 	size_t i;
@@ -86,6 +88,10 @@ static void seek_predecessor(struct state *state,
 
 	add_detached_block(state, pkt_ctx, sha, bi);
 
+	/* Headers sync will bring them, in order. */
+	if (!ask_prevs)
+		return;
+
 	/* Ask for all the prevs we don't have */
 	for (i = 0; i < block_num_prevs(bi); i++) {
 		if (block_find_any(state, block_prev(bi, i)))
@@ -150,8 +156,8 @@ recv_block(struct state *state, struct log *log, struct peer *peer,
 		/* If it was due to unknown prev, ask about that. */
 		if (peer) {
 			if (e == PROTOCOL_ECODE_PRIV_UNKNOWN_PREV) {
-				seek_predecessor(state, pkt_ctx,
-						 &sha, bi);
+				seek_predecessor(state, pkt_ctx, &sha, bi,
+						 !peer->headers_syncing);
 				/* In case we were asking for this,
 				 * we're not any more. */
 				todo_done_get_block(peer, &sha, true);
@@ -197,7 +203,10 @@ recv_block(struct state *state, struct log *log, struct peer *peer,
 				/* Don't bother about contents or extra
 				 * children of expired blocks. */
 				if (!block_expired_by(expiry, current_time())) {
-					todo_add_get_children(state, &b->sha);
+					/* Headers tell us about their chain. */
+					if (!peer || !peer->headers_syncing)
+						todo_add_get_children(state,
+								      &b->sha);
 					get_block_contents(state, b);
 				}
 				
@@ -323,27 +332,82 @@ bool try_resolve_hash(struct state *state,
 	return true;
 }
 
-static void try_resolve_hashes(struct state *state,
-			       const struct peer *source,
-			       struct block *block,
-			       u16 shard,
-			       bool add_todos)
+/* What checking a shard found, before we change anything. */
+struct shard_check {
+	/* The txs we already know (tx is NULL if we don't). */
+	struct txptr_with_ref *txp;
+	/* First one out of order (or shard size), and what it hit. */
+	unsigned int bad_txoff;
+	u8 conflict_txoff;
+};
+
+/* Same answers as check_tx_ordering() as each resolved tx went in,
+ * but one pass over the whole shard. */
+static void check_shard_ordering(const struct block_shard *shard,
+				 struct shard_check *sc)
 {
-	unsigned int i;
+	const union protocol_tx *prev_tx = NULL;
+	unsigned int i, prev = shard->size, next = shard->size;
+	u8 *next_known = tal_arr(sc, u8, shard->size);
+
+	/* Next tx we already had after each one. */
+	for (i = shard->size; i > 0; i--) {
+		next_known[i-1] = next;
+		if (tx_for(shard, i-1))
+			next = i-1;
+	}
 
-	/* If we know any of these transactions, resolve them now! */
-	for (i = 0;
-	     i < block_num_txs(&block->bi, shard) && !block->complaint;
-	     i++) {
-		if (shard_is_tx(block->shard[shard], i))
-			continue;
+	for (i = 0; i < shard->size; i++) {
+		const union protocol_tx *tx = tx_for(shard, i);
 
-		if (try_resolve_hash(state, source, block, shard, i))
-			continue;
+		if (!tx) {
+			tx = sc->txp[i].tx;
+			if (!tx)
+				continue;
+			if (prev_tx && tx_cmp(prev_tx, tx) >= 0) {
+				sc->conflict_txoff = prev;
+				break;
+			}
+			if (next_known[i] != shard->size
+			    && tx_cmp(tx, tx_for(shard, next_known[i])) >= 0) {
+				sc->conflict_txoff = next_known[i];
+				break;
+			}
+		}
+		prev_tx = tx;
+		prev = i;
+	}
+	sc->bad_txoff = i;
+	tal_free(next_known);
+}
 
-		if (add_todos)
-			todo_add_get_tx_in_block(state, &block->sha, shard, i);
+/* Everything we can check about a shard's contents without changing
+ * state, so it can all be committed at once. */
+static enum protocol_ecode check_shard(struct state *state,
+				       struct block *block, u16 shardnum,
+				       const struct protocol_txrefhash *hashes,
+				       struct shard_check *sc)
+{
+	struct block_shard *shard = block->shard[shardnum];
+	struct protocol_double_sha merkle;
+	unsigned int i;
+
+	merkle_hashes(hashes, 0, shard->size, &merkle);
+	if (!structeq(block_merkle(&block->bi, shardnum), &merkle))
+		return PROTOCOL_ECODE_BAD_MERKLE;
+
+	/* If we know any of these transactions, resolve them now! */
+	sc->txp = tal_arr(sc, struct txptr_with_ref, shard->size);
+	for (i = 0; i < shard->size; i++) {
+		if (tx_for(shard, i))
+			sc->txp[i].tx = NULL;
+		else
+			sc->txp[i] = find_tx_with_ref(shard, state, block,
+						      &hashes[i]);
 	}
+
+	check_shard_ordering(shard, sc);
+	return PROTOCOL_ECODE_NONE;
 }
 
 static enum protocol_ecode
@@ -353,7 +417,8 @@ recv_shard(struct state *state, struct log *log, struct peer *peer,
 	struct block *b;
 	u16 shard;
 	unsigned int i;
-	struct protocol_double_sha merkle;
+	enum protocol_ecode e;
+	struct shard_check *sc;
 	const struct protocol_txrefhash *hashes;
 
 	if (le32_to_cpu(pkt->len) < sizeof(*pkt))
@@ -422,11 +487,13 @@ recv_shard(struct state *state, struct log *log, struct peer *peer,
 	log_add_struct(log, struct protocol_block_id, &pkt->block);
 
 	/* Check it's right. */
-	merkle_hashes(hashes, 0, block_num_txs(&b->bi, shard), &merkle);
-	if (!structeq(block_merkle(&b->bi, shard), &merkle)) {
+	sc = tal(NULL, struct shard_check);
+	e = check_shard(state, b, shard, hashes, sc);
+	if (e != PROTOCOL_ECODE_NONE) {
 		log_unusual(log, "Bad hash for shard %u of ", shard);
 		log_add_struct(log, struct protocol_block_id, &pkt->block);
-		return PROTOCOL_ECODE_BAD_MERKLE;
+		tal_free(sc);
+		return e;
 	}
 
 	log_debug(log, "Before adding hashes: txs %u, hashes %u (of %u)",
@@ -438,17 +505,32 @@ recv_shard(struct state *state, struct log *log, struct peer *peer,
 	if (peer)
 		todo_done_get_shard(peer, &pkt->block, shard, true);
 
-	/* This may resolve some of the txs if we know them already. */
-	for (i = 0; i < block_num_txs(&b->bi, shard); i++)
-		put_txhash_in_shard(state, b, shard, i, &hashes[i]);
+	/* Hashes, and the txs we know which are in order. */
+	put_shard_in_block(state, peer, b, shard, hashes, sc->txp,
+			   sc->bad_txoff);
 
-	log_debug(log, "Hashes now in shar. txs %u, hashes %u (of %u)",
-		  b->shard[shard]->txcount,
-		  b->shard[shard]->hashcount,
-		  b->shard[shard]->size);
+	if (!b->complaint && sc->bad_txoff < b->shard[shard]->size) {
+		struct protocol_proof proof;
+		const struct txptr_with_ref *txp = &sc->txp[sc->bad_txoff];
+
+		/* We can generate proof, since we now have hashes. */
+		create_proof(&proof, b, shard, sc->bad_txoff);
+		complain_misorder(state, b, &proof, txp->tx, refs_for(*txp),
+				  sc->conflict_txoff);
+	}
 
-	/* This will try to match the rest, or trigger asking. */
-	try_resolve_hashes(state, peer, b, shard, peer != NULL);
+	/* Ask for the rest. */
+	for (i = 0; i < sc->bad_txoff && !b->complaint; i++) {
+		if (peer && !sc->txp[i].tx && !tx_for(b->shard[shard], i))
+			todo_add_get_tx_in_block(state, &b->sha, shard, i);
+	}
+
+	/* Anything we found but didn't use. */
+	for (i = 0; i < b->shard[shard]->size; i++) {
+		if (sc->txp[i].tx != tx_for(b->shard[shard], i))
+			tal_free(sc->txp[i].tx);
+	}
+	tal_free(sc);
 
 	log_debug(log, "Shard now resolved. txs %u, hashes %u (of %u)",
 		  b->shard[shard]->txcount,
@@ -557,6 +639,28 @@ bool recv_block_from_generator(struct state *state, struct log *log,
 	return true;
 }
 
+/* One block from a headers packet: like a block packet, but no txs. */
+enum protocol_ecode recv_header_block(struct peer *peer,
+				      const tal_t *pkt_ctx,
+				      const struct protocol_block_header *hdr,
+				      size_t len,
+				      struct block **block)
+{
+	enum protocol_ecode e;
+	struct block_info bi;
+
+	*block = NULL;
+	e = unmarshal_block_into(peer->log, len, hdr, &bi);
+	if (e != PROTOCOL_ECODE_NONE)
+		return e;
+
+	e = recv_block(peer->state, peer->log, peer, pkt_ctx, &bi, true, block);
+	/* Detached, so it'll be reinjected if its prev turns up. */
+	if (e == PROTOCOL_ECODE_PRIV_UNKNOWN_PREV)
+		e = PROTOCOL_ECODE_NONE;
+	return e;
+}
+
 /* Now we know prev for a block, receive it again. */
 void recv_block_reinject(struct state *state,
 			 const tal_t *pkt_ctx,
@@ -8,6 +8,9 @@ struct protocol_pkt_shard;
 struct peer;
 struct state;
 struct log;
+struct block;
+struct protocol_block_header;
+struct protocol_block_id;
 
 /* From a peer we separate block and shard packets. */
 enum protocol_ecode recv_block_from_peer(struct peer *peer,
@@ -33,6 +36,14 @@ enum protocol_ecode recv_welcome_block(struct peer *peer,
 				       size_t len,
 				       struct protocol_block_id *id);
 
+/* One of the blocks in a PROTOCOL_PKT_HEADERS; *block is NULL unless
+ * it's now in the chain. */
+enum protocol_ecode recv_header_block(struct peer *peer,
+				      const tal_t *pkt_ctx,
+				      const struct protocol_block_header *hdr,
+				      size_t len,
+				      struct block **block);
+
 /* We have a txhash, can we figure out the tx? */
 bool try_resolve_hash(struct state *state,
 		      const struct peer *source,
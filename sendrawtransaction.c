@@ -4,6 +4,7 @@
 #include "marshal.h"
 #include "peer.h"
 #include "pending.h"
+#include "sendrawtransaction.h"
 #include "todo.h"
 #include "tx.h"
 #include <ccan/tal/str/str.h>
@@ -45,6 +46,36 @@ static void *dehex(const tal_t *ctx, const char *p, size_t len)
 	return ret;
 }
 
+enum input_ecode submit_tx(struct state *state, const union protocol_tx *tx,
+			   const struct protocol_tx_id *sha,
+			   unsigned int *bad_input_num,
+			   bool *old, bool *already_known)
+{
+	enum input_ecode ierr;
+
+	ierr = add_pending_tx(state, tx, sha, bad_input_num, old,
+			      already_known);
+	switch (ierr) {
+	case ECODE_INPUT_OK:
+		if (*already_known)
+			return ierr;
+		break;
+	case ECODE_INPUT_UNKNOWN:
+		/* Ask about this input. */
+		todo_add_get_tx(state, &tx_input(tx, *bad_input_num)->input);
+		break;
+	default:
+		return ierr;
+	}
+
+	log_info(state->log, "RPC gave us TX ");
+	log_add_struct(state->log, struct protocol_tx_id, sha);
+
+	/* Tell everyone. */
+	send_tx_to_peers(state, NULL, tx);
+	return ierr;
+}
+
 static char *json_sendrawtransaction(struct json_connection *jcon,
 				     const jsmntok_t *params,
 				     struct json_result *response)
@@ -78,16 +109,13 @@ static char *json_sendrawtransaction(struct json_connection *jcon,
 	json_object_start(response, NULL);
 	json_add_tx_id(response, "tx", &sha);
 
-	switch (add_pending_tx(jcon->state, tx, &sha, &bad_input_num, &old,
-			       &already_known)) {
+	switch (submit_tx(jcon->state, tx, &sha, &bad_input_num, &old,
+			  &already_known)) {
 	case ECODE_INPUT_OK:
 		if (already_known)
 			return tal_fmt(jcon, "Transaction already known");
 		break;
 	case ECODE_INPUT_UNKNOWN:
-		/* Ask about this input. */
-		todo_add_get_tx(jcon->state,
-				&tx_input(tx, bad_input_num)->input);
 		/* FIXME: we only report one unknown input! */
 		json_object_start(response, "unknown_input");
 		json_add_num(response, "input_num", bad_input_num);
@@ -109,12 +137,6 @@ static char *json_sendrawtransaction(struct json_connection *jcon,
 		return tal_fmt(jcon, "Claim is bad");
 	}
 	json_object_end(response);
-
-	log_info(jcon->state->log, "JSON gave us TX ");
-	log_add_struct(jcon->state->log, struct protocol_tx_id, &sha);
-
-	/* Tell everyone. */
-	send_tx_to_peers(jcon->state, NULL, tx);
 	return NULL;
 }
 
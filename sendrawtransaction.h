@@ -0,0 +1,18 @@
+#ifndef PETTYCOIN_SENDRAWTRANSACTION_H
+#define PETTYCOIN_SENDRAWTRANSACTION_H
+#include "config.h"
+#include "check_tx.h"
+#include <stdbool.h>
+
+struct state;
+union protocol_tx;
+struct protocol_tx_id;
+
+/* Add a checked tx from a local client to pending.  If it's new (or
+ * only has unknown inputs), ask about the input and tell our peers.
+ * Arguments as per add_pending_tx(). */
+enum input_ecode submit_tx(struct state *state, const union protocol_tx *tx,
+			   const struct protocol_tx_id *sha,
+			   unsigned int *bad_input_num,
+			   bool *old, bool *already_known);
+#endif /* PETTYCOIN_SENDRAWTRANSACTION_H */
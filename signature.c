@@ -50,6 +50,14 @@ static void sighash_tx(const union protocol_tx *tx,
 	SHA256_Double_Final(&shactx, sha);
 }
 
+/* For getmetrics. */
+static u64 sigs_checked;
+
+u64 num_sigs_checked(void)
+{
+	return sigs_checked;
+}
+
 bool check_tx_sign(const union protocol_tx *tx,
 		   const struct protocol_pubkey *key)
 {
@@ -61,6 +69,8 @@ bool check_tx_sign(const union protocol_tx *tx,
 	struct protocol_double_sha sha;
 	const struct protocol_signature *signature = get_signature(tx);
 
+	sigs_checked++;
+
 	/* Get hash of transaction without sig */
 	sighash_tx(tx, &sha);
 
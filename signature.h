@@ -2,6 +2,7 @@
 #define PETTYCOIN_SIGNATURES_H
 #include "config.h"
 #include "protocol.h"
+#include <ccan/short_types/short_types.h>
 #include <openssl/ec.h>
 #include <stdbool.h>
 
@@ -9,4 +10,7 @@ bool check_tx_sign(const union protocol_tx *tx,
 		   const struct protocol_pubkey *key);
 
 bool sign_tx(union protocol_tx *tx, EC_KEY *private_key);
+
+/* How many times check_tx_sign() has been called. */
+u64 num_sigs_checked(void);
 #endif /* PETTYCOIN_SIGNATURES_H */
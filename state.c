@@ -15,6 +15,10 @@ static void destroy_state(struct state *state)
 {
 	txhash_clear(&state->txhash);
 	inputhash_clear(&state->inputhash);
+	utxo_spendhash_clear(&state->utxo.spent);
+	addrhash_clear(&state->addrhash);
+	detached_sha_hash_clear(&state->detached_by_sha);
+	detached_prev_hash_clear(&state->detached_by_prev);
 	BN_free(&genesis.total_work);
 }
 
@@ -35,9 +39,18 @@ struct state *new_state(bool test_net)
 	s->preferred_chain = &genesis;
 	list_head_init(&s->todo);
 	list_head_init(&s->detached_blocks);
+	s->num_detached = 0;
+	detached_sha_hash_init(&s->detached_by_sha);
+	detached_prev_hash_init(&s->detached_by_prev);
+	list_head_init(&s->detached_queue);
 	txhash_init(&s->txhash);
 	inputhash_init(&s->inputhash);
+	utxo_init(&s->utxo, s, &genesis);
+	s->index_addresses = false;
+	addrhash_init(&s->addrhash);
+	list_head_init(&s->watches);
 	s->nopeers_ok = false;
+	s->headers_first = true;
 	s->num_peers = 0;
 	list_head_init(&s->peers);
 	s->num_peers_connecting = 0;
@@ -50,6 +63,9 @@ struct state *new_state(bool test_net)
 		s->uuid.bytes[i] = isaac64_next_uint(isaac64, 256);
 	bitmap_zero(s->peer_map, MAX_PEERS);
 	s->peer_seed_count = 0;
+	memset(&s->metrics, 0, sizeof(s->metrics));
+	s->metrics.slow_pkt_usec = 100000;
+	s->metrics.stall_usec = 250000;
 	s->lr = new_log_record(s, 16777216, LOG_INFORM);
 	s->log = new_log(s, s->lr, "%s", "");
 	s->generator = "pettycoin-generate";
@@ -58,6 +74,7 @@ struct state *new_state(bool test_net)
 	s->require_non_gateway_tx_fee = false;
 	s->require_gateway_tx_fee = false;
 	timers_init(&s->timers, time_now());
+	list_head_init(&s->work);
 	init_timeout(&s->peer_get_timeout, 30 * 60, refresh_peer_cache, s);
 
 	tal_add_destructor(s, destroy_state);
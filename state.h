@@ -1,11 +1,15 @@
 #ifndef PETTYCOIN_STATE_H
 #define PETTYCOIN_STATE_H
 #include "config.h"
+#include "addrhash.h"
+#include "detached_block.h"
 #include "inputhash.h"
 #include "log.h"
+#include "metrics.h"
 #include "peer.h"
 #include "timeout.h"
 #include "txhash.h"
+#include "utxo.h"
 #include <ccan/bitmap/bitmap.h>
 #include <ccan/compiler/compiler.h>
 #include <ccan/endian/endian.h>
@@ -45,8 +49,13 @@ struct state {
 	/* These are our known unknowns. */
 	struct list_head todo;
 
-	/* Blocks we don't know the prev for. */
+	/* Blocks we don't know the prev for, oldest first. */
 	struct list_head detached_blocks;
+	size_t num_detached;
+	struct detached_sha_hash detached_by_sha;
+	struct detached_prev_hash detached_by_prev;
+	/* Ones whose prev turned up, waiting to be reinjected. */
+	struct list_head detached_queue;
 
 	/* Block we're working on now. */
 	struct pending_block *pending;
@@ -57,6 +66,19 @@ struct state {
 	/* All inputs to transactions. */
 	struct inputhash inputhash;
 
+	/* Outputs spent on preferred_chain (hence longest_knowns[0]). */
+	struct utxo utxo;
+
+	/* Transactions by address (if index_addresses, for RPC). */
+	bool index_addresses;
+	struct addrhash addrhash;
+
+	/* JSON connections' struct watch. */
+	struct list_head watches;
+
+	/* Do we sync by PROTOCOL_PKT_GET_HEADERS? */
+	bool headers_first;
+
 	/* Are we a bootstrap node? */
 	bool nopeers_ok;
 
@@ -98,12 +120,23 @@ struct state {
 	struct log_record *lr;
 	struct log *log;
 
+	/* For getmetrics. */
+	struct metrics metrics;
+
 	/* blocks.list */
 	int blockfd;
 
 	/* Any pending timers. */
 	struct timers timers;
 
+	/* Jobs we do a slice at a time, and when to do the next. */
+	struct list_head work;
+	struct timeout work_timeout;
+
+	/* If this goes off late, the loop was stalled. */
+	struct timeout watchdog;
+	struct timemono watchdog_armed;
+
 	/* Which shards are we interested in. */
 	BITMAP_DECLARE(interests, 65536);
 };
@@ -1,6 +1,11 @@
 #include "block.h"
 #include "chain.h"
+#include "detached_block.h"
 #include "difficulty.h"
+#include "marshal.h"
+#include "peer.h"
+#include "prev_blocks.h"
+#include "recv_block.h"
 #include "shadouble.h"
 #include "state.h"
 #include "sync.h"
@@ -10,22 +15,28 @@
 #include <ccan/asort/asort.h>
 #include <openssl/bn.h>
 
-static int hash_cmp(const struct block *const *a,
-		    const struct block *const *b, void *null)
+static int hash_cmp(struct block *const *a,
+		    struct block *const *b, void *null)
 {
 	return memcmp(&(*a)->sha, &(*b)->sha, sizeof((*a)->sha));
 }
 
-static void hash_children(const struct block *block,
+/* Cached in the block: block_add() invalidates it up the chain. */
+static void hash_children(struct block *block,
 			  struct protocol_double_sha *sha)
 {
-	const struct block *c;
-	const struct block **kids;
+	struct block *c;
+	struct block **kids;
 	SHA256_CTX ctx;
 	size_t i;
 
+	if (block->descendents_valid) {
+		*sha = block->descendents;
+		return;
+	}
+
 	/* Hash children in fixed order: order by id. */
-	kids = tal_arr(NULL, const struct block *, 0);
+	kids = tal_arr(NULL, struct block *, 0);
 	list_for_each(&block->children, c, sibling) {
 		size_t count = tal_count(kids);
 		tal_resize(&kids, count+1);
@@ -41,7 +52,9 @@ static void hash_children(const struct block *block,
 		SHA256_Update(&ctx, &child_sha, sizeof(child_sha));
 	}
 	SHA256_Update(&ctx, &block->sha, sizeof(block->sha));
-	SHA256_Double_Final(&ctx, sha);
+	SHA256_Double_Final(&ctx, &block->descendents);
+	block->descendents_valid = true;
+	*sha = block->descendents;
 	tal_free(kids);
 }
 
@@ -93,30 +106,206 @@ recv_get_children(struct peer *peer,
 	return PROTOCOL_ECODE_NONE;
 }
 
+/* Is b an ancestor of (or equal to) best? */
+static bool on_chain(const struct state *state,
+		     const struct block *b, const struct block *best)
+{
+	u32 height = block_height(&b->bi);
+	const struct list_head *h = state->block_height[height];
+
+	/* If it's the only one at its height, it must be. */
+	if (height <= block_height(&best->bi)
+	    && list_top(h, struct block, list) == list_tail(h, struct block, list))
+		return true;
+	return block_preceeds(b, best);
+}
+
+/* Next block from b towards best (which b preceeds, and isn't). */
+static const struct block *next_on_chain(const struct block *b,
+					 const struct block *best)
+{
+	const struct block *c;
+
+	/* Usually there's only one. */
+	list_for_each(&b->children, c, sibling) {
+		if (c == list_tail(&b->children, struct block, sibling)
+		    || block_preceeds(c, best))
+			return c;
+	}
+	abort();
+}
+
+struct protocol_pkt_get_headers *get_headers_pkt(const tal_t *ctx,
+						 const struct block *from)
+{
+	struct protocol_pkt_get_headers *pkt;
+
+	pkt = tal_packet(ctx, struct protocol_pkt_get_headers,
+			 PROTOCOL_PKT_GET_HEADERS);
+	make_prev_blocks(from, pkt->locator);
+	return pkt;
+}
+
 enum protocol_ecode
-recv_get_block(struct peer *peer,
-	       const struct protocol_pkt_get_block *pkt,
-	       void **reply)
+recv_get_headers(struct peer *peer,
+		 const struct protocol_pkt_get_headers *pkt,
+		 void **reply)
 {
-	struct block *b;
-	struct protocol_pkt_block *r;
+	struct state *state = peer->state;
+	const struct block *b, *best = state->longest_chains[0];
+	struct protocol_pkt_headers *r;
+	u32 i, num;
 
 	if (le32_to_cpu(pkt->len) != sizeof(*pkt))
 		return PROTOCOL_ECODE_INVALID_LEN;
 
-	r = tal_packet(peer, struct protocol_pkt_block, PROTOCOL_PKT_BLOCK);
+	/* Most recent first, so the first we know is where they fork. */
+	b = genesis_block(state);
+	for (i = 0; i < PROTOCOL_NUM_PREV_IDS; i++) {
+		const struct block *l = block_find_any(state, &pkt->locator[i]);
+		if (l && on_chain(state, l, best)) {
+			b = l;
+			break;
+		}
+	}
 
-	b = block_find_any(peer->state, &pkt->block);
+	r = tal_packet(peer, struct protocol_pkt_headers,
+		       PROTOCOL_PKT_HEADERS);
+	for (num = 0; num < PROTOCOL_MAX_HEADERS && b != best; num++) {
+		le32 len;
+
+		b = next_on_chain(b, best);
+		len = cpu_to_le32(marshal_block_len(b->bi.hdr));
+		if (le32_to_cpu(r->len) + sizeof(len) + le32_to_cpu(len)
+		    > PROTOCOL_MAX_PACKET_LEN)
+			break;
+		tal_packet_append(&r, &len, sizeof(len));
+		tal_packet_append_block(&r, &b->bi);
+	}
+	r->num = cpu_to_le32(num);
+
+	log_debug(peer->log, "Sending %u headers", num);
+	*reply = r;
+	return PROTOCOL_ECODE_NONE;
+}
+
+/* We've got all they'll give us. */
+static void headers_sync_done(struct peer *peer)
+{
+	struct state *state = peer->state;
+	const struct protocol_block_header *hdr;
+	unsigned int i;
+
+	log_info(peer->log, "Headers sync finished");
+	peer->headers_syncing = false;
+
+	/* Their welcome block wasn't on the chain they gave us?  Fall back
+	 * to asking for its prevs. */
+	if (!peer->wblock.len || block_find_any(state, &peer->wblock.id))
+		return;
+
+	hdr = (const struct protocol_block_header *)(peer->welcome + 1);
+	for (i = 0; i < num_prevs(hdr); i++) {
+		if (block_find_any(state, &hdr->prevs[i]))
+			continue;
+		if (have_detached_block(state, &hdr->prevs[i]))
+			continue;
+		todo_add_get_block(state, &hdr->prevs[i]);
+	}
+}
+
+enum protocol_ecode recv_headers(struct peer *peer,
+				 const struct protocol_pkt_headers *pkt)
+{
+	const char *p;
+	size_t len;
+	u32 i, num;
+	struct block *last = NULL;
+
+	if (le32_to_cpu(pkt->len) < sizeof(*pkt))
+		return PROTOCOL_ECODE_INVALID_LEN;
+
+	num = le32_to_cpu(pkt->num);
+	p = (const char *)(pkt + 1);
+	len = le32_to_cpu(pkt->len) - sizeof(*pkt);
+
+	for (i = 0; i < num; i++) {
+		enum protocol_ecode e;
+		struct block *b;
+		le32 blen;
+		void *block;
+
+		if (len < sizeof(blen))
+			return PROTOCOL_ECODE_INVALID_LEN;
+		memcpy(&blen, p, sizeof(blen));
+		p += sizeof(blen);
+		len -= sizeof(blen);
+		if (len < le32_to_cpu(blen))
+			return PROTOCOL_ECODE_INVALID_LEN;
+
+		/* Each block keeps its own copy. */
+		block = tal_dup(pkt, char, p, le32_to_cpu(blen), 0);
+		e = recv_header_block(peer, block, block, le32_to_cpu(blen),
+				      &b);
+		if (e != PROTOCOL_ECODE_NONE)
+			return e;
+		if (b)
+			last = b;
+
+		p += le32_to_cpu(blen);
+		len -= le32_to_cpu(blen);
+	}
+	if (len != 0)
+		return PROTOCOL_ECODE_INVALID_LEN;
+
+	log_debug(peer->log, "Gave us %u headers", num);
+
+	if (!peer->headers_syncing)
+		return PROTOCOL_ECODE_NONE;
+
+	/* Ask for more after the last, until they run out. */
+	if (last)
+		todo_for_peer(peer, get_headers_pkt(peer, last));
+	else
+		headers_sync_done(peer);
+	return PROTOCOL_ECODE_NONE;
+}
+
+struct protocol_pkt_block *block_reply(tal_t *ctx, struct state *state,
+				       const struct protocol_block_id *block)
+{
+	struct block *b;
+	struct protocol_pkt_block *r;
+
+	r = tal_packet(ctx, struct protocol_pkt_block, PROTOCOL_PKT_BLOCK);
+
+	b = block_find_any(state, block);
 	if (b) {
 		r->err = le32_to_cpu(PROTOCOL_ECODE_NONE);
 		tal_packet_append_block(&r, &b->bi);
 	} else {
+		r->err = le32_to_cpu(PROTOCOL_ECODE_UNKNOWN_BLOCK);
+		tal_packet_append_block_id(&r, block);
+	}
+	return r;
+}
+
+enum protocol_ecode
+recv_get_block(struct peer *peer,
+	       const struct protocol_pkt_get_block *pkt,
+	       void **reply)
+{
+	struct protocol_pkt_block *r;
+
+	if (le32_to_cpu(pkt->len) != sizeof(*pkt))
+		return PROTOCOL_ECODE_INVALID_LEN;
+
+	r = block_reply(peer, peer->state, &pkt->block);
+	if (le32_to_cpu(r->err) != PROTOCOL_ECODE_NONE) {
 		/* If we don't know it, that's OK. */
 		log_debug(peer->log, "unknown get_block block ");
 		log_add_struct(peer->log, struct protocol_block_id,
 			       &pkt->block);
-		r->err = le32_to_cpu(PROTOCOL_ECODE_UNKNOWN_BLOCK);
-		tal_packet_append_block_id(&r, &pkt->block);
 	}
 
 	*reply = r;
@@ -157,7 +346,7 @@ enum protocol_ecode recv_children(struct peer *peer,
 
 	cb = (void *)(pkt + 1);
 	for (i = 0; i < num; i++) {
-		const struct block *b;
+		struct block *b;
 
 		b = block_find_any(peer->state, &cb[i].block);
 		if (!b) {
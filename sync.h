@@ -1,6 +1,7 @@
 #ifndef PETTYCOIN_SYNC_H
 #define PETTYCOIN_SYNC_H
 #include "config.h"
+#include <ccan/tal/tal.h>
 
 struct peer;
 struct block;
@@ -10,6 +11,10 @@ struct protocol_pkt_horizon;
 struct protocol_pkt_children;
 struct protocol_pkt_get_children;
 struct protocol_pkt_get_block;
+struct protocol_pkt_block;
+struct protocol_block_id;
+struct protocol_pkt_get_headers;
+struct protocol_pkt_headers;
 
 /* Process protocol_pkt_get_children, fill in *reply if no error. */
 enum protocol_ecode
@@ -21,6 +26,24 @@ recv_get_children(struct peer *peer,
 enum protocol_ecode recv_children(struct peer *peer,
 				  const struct protocol_pkt_children *pkt);
 
+/* Ask for the blocks after from on their best chain. */
+struct protocol_pkt_get_headers *get_headers_pkt(const tal_t *ctx,
+						 const struct block *from);
+
+/* Process protocol_pkt_get_headers, fill in *reply if no error. */
+enum protocol_ecode
+recv_get_headers(struct peer *peer,
+		 const struct protocol_pkt_get_headers *pkt,
+		 void **reply);
+
+/* Process protocol_pkt_headers: ask for more, if we're syncing. */
+enum protocol_ecode recv_headers(struct peer *peer,
+				 const struct protocol_pkt_headers *pkt);
+
+/* Answer for protocol_pkt_get_block: the block, or UNKNOWN_BLOCK. */
+struct protocol_pkt_block *block_reply(tal_t *ctx, struct state *state,
+				       const struct protocol_block_id *block);
+
 /* Process protocol_pkt_get_block */
 enum protocol_ecode
 recv_get_block(struct peer *peer,
@@ -0,0 +1,95 @@
+/* Compare merkling a shard a level at a time with the old recursive
+ * way, which went through SHA256_Update/Final for every node. */
+#include "../merkle_hashes.c"
+#include "../merkle_recurse.c"
+#include "../shadouble.c"
+#include <ccan/time/time.h>
+#include <ccan/structeq/structeq.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+/* How they used to be. */
+static void old_merkle_two_hashes(const struct protocol_double_sha *a,
+				  const struct protocol_double_sha *b,
+				  struct protocol_double_sha *merkle)
+{
+	SHA256_CTX shactx;
+
+	SHA256_Init(&shactx);
+	SHA256_Update(&shactx, a, sizeof(*a));
+	SHA256_Update(&shactx, b, sizeof(*b));
+	SHA256_Double_Final(&shactx, merkle);
+}
+
+static void old_merkle_recurse(size_t off, size_t max_off, size_t num,
+			       void (*fn)(size_t, void *,
+					  struct protocol_double_sha *),
+			       void *data,
+			       struct protocol_double_sha *merkle)
+{
+	if (num == 1) {
+		if (off >= max_off)
+			memset(merkle, 0, sizeof(*merkle));
+		else
+			fn(off, data, merkle);
+	} else {
+		SHA256_CTX shactx;
+		struct protocol_double_sha sub[2];
+
+		num /= 2;
+		old_merkle_recurse(off, max_off, num, fn, data, sub);
+		old_merkle_recurse(off + num, max_off, num, fn, data, sub+1);
+
+		SHA256_Init(&shactx);
+		SHA256_Update(&shactx, sub, sizeof(sub));
+		SHA256_Double_Final(&shactx, merkle);
+	}
+}
+
+static void old_merkle_hash(size_t n, void *data,
+			    struct protocol_double_sha *merkle)
+{
+	const struct protocol_txrefhash *hashes = data;
+
+	old_merkle_two_hashes(&hashes[n].txhash.sha, &hashes[n].refhash,
+			      merkle);
+}
+
+static double per_op(struct timeabs start, unsigned int num)
+{
+	return (double)time_to_nsec(time_between(time_now(), start)) / num;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i, j, num = argc > 1 ? atoi(argv[1]) : 2000;
+	unsigned int sizes[] = { 1, 16, 128, 255 };
+	struct protocol_txrefhash hashes[256];
+	struct protocol_double_sha old, new;
+	struct timeabs start;
+
+	for (i = 0; i < 256; i++)
+		memset(&hashes[i], i, sizeof(hashes[i]));
+
+	for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+		old_merkle_recurse(0, sizes[j], 256, old_merkle_hash, hashes,
+				   &old);
+		merkle_hashes(hashes, 0, sizes[j], &new);
+		assert(structeq(&old, &new));
+
+		start = time_now();
+		for (i = 0; i < num; i++)
+			old_merkle_recurse(0, sizes[j], 256, old_merkle_hash,
+					   hashes, &old);
+		printf("%u txs: old %.0f ns", sizes[j], per_op(start, num));
+
+		start = time_now();
+		for (i = 0; i < num; i++)
+			merkle_hashes(hashes, 0, sizes[j], &new);
+		printf(", new %.0f ns per shard\n", per_op(start, num));
+	}
+	return 0;
+}
@@ -20,13 +20,13 @@ static struct block *add_next_block(struct state *state,
 	u8 *num_txs;
 	struct protocol_block_id dummy = { { { 0 } } };
 
-	hdr = tal(state, struct protocol_block_header);
+	hdr = talz(state, struct protocol_block_header);
 	hdr->shard_order = shard_order;
 	hdr->height = cpu_to_le32(block_height(&prev->bi) + 1);
 	hdr->prevs[0] = prev->sha;
 	hdr->fees_to = *addr;
 
-	tailer = tal(state, struct protocol_block_tailer);
+	tailer = talz(state, struct protocol_block_tailer);
 	tailer->difficulty = cpu_to_le32(block_difficulty(&prev->bi));
 
 	num_txs = tal_arrz(state, u8, 1 << hdr->shard_order);
@@ -38,6 +38,9 @@ static struct block *add_next_block(struct state *state,
 	bi.hdr = hdr;
 	bi.tailer = tailer;
 	bi.num_txs = num_txs;
+	bi.merkles = tal_arrz(state, struct protocol_double_sha,
+			      1 << hdr->shard_order);
+	bi.prev_txhashes = NULL;
 	b = block_add(state, prev, &dummy, &bi);
 
 	if (!blockmap_initialized) {
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <ccan/io/io.h>
+#include <ccan/read_write_all/read_write_all.h>
+#include <ccan/structeq/structeq.h>
+#include <ccan/tal/tal.h>
+#include <sys/socket.h>
+
+#include "../jsonrpc.c"
+#include "../json.c"
+#include "../binrpc.c"
+#include "../sync.c"
+#include "../packet_io.c"
+#include "../tal_packet.c"
+#include "../marshal.c"
+#include "../minimal_log.c"
+#include "easy_genesis.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for detachedblocks_command */
+const struct json_command detachedblocks_command;
+/* Generated stub for getblock_command */
+const struct json_command getblock_command;
+/* Generated stub for getblockhash_command */
+const struct json_command getblockhash_command;
+/* Generated stub for getinfo_command */
+const struct json_command getinfo_command;
+/* Generated stub for getmetrics_command */
+const struct json_command getmetrics_command;
+/* Generated stub for getpeerinfo_command */
+const struct json_command getpeerinfo_command;
+/* Generated stub for gettransaction_command */
+const struct json_command gettransaction_command;
+/* Generated stub for have_detached_block */
+bool have_detached_block(const struct state *state,
+			 const struct protocol_block_id *sha)
+{ fprintf(stderr, "have_detached_block called!\n"); abort(); }
+/* Generated stub for listtodo_command */
+const struct json_command listtodo_command;
+/* Generated stub for listtransactions_command */
+const struct json_command listtransactions_command;
+/* Generated stub for log_each_line_ */
+void log_each_line_(const struct log_record *lr,
+		    void (*func)(unsigned int skipped,
+				 struct timerel time,
+				 enum log_level level,
+				 const char *prefix,
+				 const char *log,
+				 void *arg),
+		    void *arg)
+{ fprintf(stderr, "log_each_line_ called!\n"); abort(); }
+/* Generated stub for log_init_time */
+const struct timeabs *log_init_time(const struct log_record *lr)
+{ fprintf(stderr, "log_init_time called!\n"); abort(); }
+/* Generated stub for log_max_mem */
+size_t log_max_mem(const struct log_record *lr)
+{ fprintf(stderr, "log_max_mem called!\n"); abort(); }
+/* Generated stub for log_record_private */
+void log_record_private(struct log_record *lr)
+{ fprintf(stderr, "log_record_private called!\n"); abort(); }
+/* Generated stub for log_used */
+size_t log_used(const struct log_record *lr)
+{ fprintf(stderr, "log_used called!\n"); abort(); }
+/* Generated stub for make_prev_blocks */
+void make_prev_blocks(const struct block *prev,
+		      struct protocol_block_id prevs[PROTOCOL_NUM_PREV_IDS])
+{ fprintf(stderr, "make_prev_blocks called!\n"); abort(); }
+/* Generated stub for num_inputs */
+u32 num_inputs(const union protocol_tx *tx)
+{ fprintf(stderr, "num_inputs called!\n"); abort(); }
+/* Generated stub for num_prevs */
+unsigned int num_prevs(const struct protocol_block_header *hdr)
+{ fprintf(stderr, "num_prevs called!\n"); abort(); }
+/* Generated stub for pettycoin_to_base58 */
+char *pettycoin_to_base58(const tal_t *ctx, bool test_net,
+			  const struct protocol_address *addr,
+			  bool bitcoin_style)
+{ fprintf(stderr, "pettycoin_to_base58 called!\n"); abort(); }
+/* Generated stub for recv_header_block */
+enum protocol_ecode recv_header_block(struct peer *peer,
+				      const tal_t *pkt_ctx,
+				      const struct protocol_block_header *hdr,
+				      size_t len,
+				      struct block **block)
+{ fprintf(stderr, "recv_header_block called!\n"); abort(); }
+/* Generated stub for refresh_timeout */
+void refresh_timeout(struct state *state, struct timeout *t)
+{ fprintf(stderr, "refresh_timeout called!\n"); abort(); }
+/* Generated stub for sendrawtransaction_command */
+const struct json_command sendrawtransaction_command;
+/* Generated stub for set_log_io */
+void set_log_io(struct log *log, unsigned int every)
+{ fprintf(stderr, "set_log_io called!\n"); abort(); }
+/* Generated stub for set_log_io_default */
+void set_log_io_default(struct log_record *lr, unsigned int every)
+{ fprintf(stderr, "set_log_io_default called!\n"); abort(); }
+/* Generated stub for SHA256_Double_Final */
+void SHA256_Double_Final(SHA256_CTX *ctx, struct protocol_double_sha *sha)
+{ fprintf(stderr, "SHA256_Double_Final called!\n"); abort(); }
+/* Generated stub for submitblock_command */
+const struct json_command submitblock_command;
+/* Generated stub for todo_add_get_block */
+void todo_add_get_block(struct state *state,
+			const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_block called!\n"); abort(); }
+/* Generated stub for todo_add_get_children */
+void todo_add_get_children(struct state *state,
+			   const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_children called!\n"); abort(); }
+/* Generated stub for todo_done_get_children */
+void todo_done_get_children(struct peer *peer,
+			    const struct protocol_block_id *block,
+			    bool success)
+{ fprintf(stderr, "todo_done_get_children called!\n"); abort(); }
+/* Generated stub for todo_for_peer */
+void todo_for_peer(struct peer *peer, void *pkt)
+{ fprintf(stderr, "todo_for_peer called!\n"); abort(); }
+/* Generated stub for to_hex */
+char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
+{ fprintf(stderr, "to_hex called!\n"); abort(); }
+/* Generated stub for tx_len */
+size_t tx_len(const union protocol_tx *tx)
+{ fprintf(stderr, "tx_len called!\n"); abort(); }
+/* Generated stub for tx_reply */
+void *tx_reply(tal_t *ctx, struct state *state,
+	       const struct protocol_tx_id *txid)
+{ fprintf(stderr, "tx_reply called!\n"); abort(); }
+/* Generated stub for unwatchaddress_command */
+const struct json_command unwatchaddress_command;
+/* Generated stub for watchaddress_command */
+const struct json_command watchaddress_command;
+/* AUTOGENERATED MOCKS END */
+
+/* Dummy functions */
+const char *log_prefix(const struct log *log)
+{
+	return "";
+}
+
+struct block *block_find_any(struct state *state,
+			     const struct protocol_block_id *sha)
+{
+	if (structeq(sha, &genesis.sha))
+		return &genesis;
+	return NULL;
+}
+
+enum protocol_ecode check_tx(struct state *state, const union protocol_tx *tx,
+			     const struct block *inside_block)
+{
+	return PROTOCOL_ECODE_NONE;
+}
+
+void hash_tx(const union protocol_tx *tx, struct protocol_tx_id *txid)
+{
+	memset(txid, 0, sizeof(*txid));
+}
+
+static unsigned int num_submitted;
+static enum input_ecode submit_result;
+
+enum input_ecode submit_tx(struct state *state, const union protocol_tx *tx,
+			   const struct protocol_tx_id *sha,
+			   unsigned int *bad_input_num,
+			   bool *old, bool *already_known)
+{
+	num_submitted++;
+	return submit_result;
+}
+
+void recheck_pending_txs(struct state *state)
+{
+}
+
+static void send_tx(int fd, u32 len)
+{
+	struct protocol_pkt_tx *pkt;
+	struct protocol_tx_from_gateway gtx;
+
+	/* check_tx is a dummy, so it only has to unmarshal. */
+	memset(&gtx, 0, sizeof(gtx));
+	gtx.version = current_version();
+	gtx.type = TX_FROM_GATEWAY;
+
+	pkt = tal_packet(NULL, struct protocol_pkt_tx, PROTOCOL_PKT_TX);
+	pkt->err = cpu_to_le32(PROTOCOL_ECODE_NONE);
+	tal_packet_append(&pkt, &gtx, sizeof(gtx));
+	if (len)
+		pkt->len = cpu_to_le32(len);
+	assert(write_all(fd, pkt, le32_to_cpu(pkt->len)));
+	tal_free(pkt);
+}
+
+static void send_get_block(int fd, const struct protocol_block_id *sha)
+{
+	struct protocol_pkt_get_block *pkt;
+
+	pkt = tal_packet(NULL, struct protocol_pkt_get_block,
+			 PROTOCOL_PKT_GET_BLOCK);
+	pkt->block = *sha;
+	assert(write_all(fd, pkt, tal_count(pkt)));
+	tal_free(pkt);
+}
+
+static void *read_reply(const tal_t *ctx, int fd, enum protocol_pkt_type type)
+{
+	struct protocol_net_hdr hdr;
+	char *pkt;
+
+	assert(read_all(fd, &hdr, sizeof(hdr)));
+	assert(le32_to_cpu(hdr.type) == type);
+	pkt = tal_arr(ctx, char, le32_to_cpu(hdr.len));
+	memcpy(pkt, &hdr, sizeof(hdr));
+	assert(read_all(fd, pkt + sizeof(hdr), le32_to_cpu(hdr.len) - sizeof(hdr)));
+	return pkt;
+}
+
+static enum protocol_ecode read_err(int fd)
+{
+	struct protocol_pkt_err *err = read_reply(NULL, fd, PROTOCOL_PKT_ERR);
+	enum protocol_ecode e = le32_to_cpu(err->error);
+
+	tal_free(err);
+	return e;
+}
+
+int main(void)
+{
+	struct state *state = tal(NULL, struct state);
+	struct protocol_pkt_block *blk;
+	struct protocol_block_id unknown;
+	struct protocol_net_hdr hdr;
+	char *marshaled;
+	int fds[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	io_new_conn(state, fds[0], jcon_connected, state);
+
+	/* A NUL first byte means we speak packets. */
+	assert(write_all(fds[1], "", 1));
+
+	/* Accepted into pending. */
+	submit_result = ECODE_INPUT_OK;
+	send_tx(fds[1], 0);
+	/* Too short to hold the err field. */
+	send_tx(fds[1], sizeof(struct protocol_net_hdr));
+
+	/* A block we know, and one we don't. */
+	send_get_block(fds[1], &genesis.sha);
+	memset(&unknown, 1, sizeof(unknown));
+	send_get_block(fds[1], &unknown);
+
+	/* We don't do that here. */
+	hdr.len = cpu_to_le32(sizeof(hdr));
+	hdr.type = cpu_to_le32(PROTOCOL_PKT_GET_CHILDREN);
+	assert(write_all(fds[1], &hdr, sizeof(hdr)));
+
+	/* Server answers them all, then sees EOF and closes. */
+	shutdown(fds[1], SHUT_WR);
+	io_loop(NULL, NULL);
+
+	assert(read_err(fds[1]) == PROTOCOL_ECODE_NONE);
+	assert(num_submitted == 1);
+	assert(read_err(fds[1]) == PROTOCOL_ECODE_INVALID_LEN);
+	assert(num_submitted == 1);
+
+	blk = read_reply(state, fds[1], PROTOCOL_PKT_BLOCK);
+	assert(le32_to_cpu(blk->err) == PROTOCOL_ECODE_NONE);
+	assert(le32_to_cpu(blk->len)
+	       == sizeof(*blk) + marshal_block_len(genesis.bi.hdr));
+	marshaled = tal_arr(state, char, marshal_block_len(genesis.bi.hdr));
+	marshal_block_into(marshaled, &genesis.bi);
+	assert(memcmp(blk + 1, marshaled, tal_count(marshaled)) == 0);
+
+	blk = read_reply(state, fds[1], PROTOCOL_PKT_BLOCK);
+	assert(le32_to_cpu(blk->err) == PROTOCOL_ECODE_UNKNOWN_BLOCK);
+	assert(le32_to_cpu(blk->len) == sizeof(*blk) + sizeof(unknown));
+	assert(structeq((struct protocol_block_id *)(blk + 1), &unknown));
+
+	assert(read_err(fds[1]) == PROTOCOL_ECODE_UNKNOWN_COMMAND);
+
+	/* Nothing more. */
+	assert(read(fds[1], &hdr, 1) == 0);
+
+	/* A rejected tx is BAD_INPUT. */
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	io_new_conn(state, fds[0], jcon_connected, state);
+	assert(write_all(fds[1], "", 1));
+	submit_result = ECODE_INPUT_DOUBLESPEND;
+	send_tx(fds[1], 0);
+	shutdown(fds[1], SHUT_WR);
+	io_loop(NULL, NULL);
+	assert(read_err(fds[1]) == PROTOCOL_ECODE_BAD_INPUT);
+	assert(num_submitted == 2);
+
+	tal_free(state);
+	return 0;
+}
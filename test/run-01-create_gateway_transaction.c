@@ -13,6 +13,7 @@
 #include "../hash_tx.c"
 #include "../tx.c"
 #include "../block_shard.c"
+#include "../utxo.c"
 #include <assert.h>
 #include "helper_gateway_key.h"
 #include "helper_key.h"
@@ -44,6 +45,10 @@ struct txhash_elem *txhash_gettx_ancestor(struct state *state,
 					  const struct protocol_tx_id *sha,
 					  const struct block *block)
 { fprintf(stderr, "txhash_gettx_ancestor called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 bool accept_gateway(const struct state *state,
@@ -0,0 +1,162 @@
+#include <ccan/array_size/array_size.h>
+#include <ccan/tal/tal.h>
+#include "../detached_block.c"
+#include "../minimal_log.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for json_add_double_sha */
+void json_add_double_sha(struct json_result *result, const char *fieldname,
+			 const struct protocol_double_sha *sha)
+{ fprintf(stderr, "json_add_double_sha called!\n"); abort(); }
+/* Generated stub for json_add_num */
+void json_add_num(struct json_result *result, const char *fieldname,
+		  unsigned int value)
+{ fprintf(stderr, "json_add_num called!\n"); abort(); }
+/* Generated stub for json_array_end */
+void json_array_end(struct json_result *ptr)
+{ fprintf(stderr, "json_array_end called!\n"); abort(); }
+/* Generated stub for json_array_start */
+void json_array_start(struct json_result *ptr, const char *fieldname)
+{ fprintf(stderr, "json_array_start called!\n"); abort(); }
+/* Generated stub for json_object_end */
+void json_object_end(struct json_result *ptr)
+{ fprintf(stderr, "json_object_end called!\n"); abort(); }
+/* Generated stub for json_object_start */
+void json_object_start(struct json_result *ptr, const char *fieldname)
+{ fprintf(stderr, "json_object_start called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static struct protocol_block_id id(unsigned int n)
+{
+	struct protocol_block_id sha;
+
+	memset(&sha, 0, sizeof(sha));
+	memcpy(&sha, &n, sizeof(n));
+	return sha;
+}
+
+static unsigned int id_num(const struct protocol_block_id *sha)
+{
+	unsigned int n;
+
+	memcpy(&n, sha, sizeof(n));
+	return n;
+}
+
+static void add(struct state *state, unsigned int n, unsigned int prev)
+{
+	char *pkt_ctx = tal(state, char);
+	struct protocol_block_header *hdr;
+	struct protocol_block_id sha = id(n);
+	struct block_info bi;
+
+	hdr = talz(pkt_ctx, struct protocol_block_header);
+	hdr->height = cpu_to_le32(n);
+	hdr->prevs[0] = id(prev);
+	memset(&bi, 0, sizeof(bi));
+	bi.hdr = hdr;
+	add_detached_block(state, pkt_ctx, &sha, &bi);
+}
+
+/* What got reinjected, in order, and how deeply nested. */
+static unsigned int reinjected[10], num_reinjected;
+static unsigned int depth, max_depth;
+
+/* Like block_add() does, the new block looks for its children. */
+static void seek(struct state *state, unsigned int n)
+{
+	struct block block;
+
+	block.sha = id(n);
+	seek_detached_blocks(state, &block);
+}
+
+void recv_block_reinject(struct state *state,
+			 const tal_t *pkt_ctx,
+			 const struct block_info *bi)
+{
+	unsigned int n = le32_to_cpu(bi->hdr->height);
+
+	assert(num_reinjected < ARRAY_SIZE(reinjected));
+	reinjected[num_reinjected++] = n;
+
+	if (++depth > max_depth)
+		max_depth = depth;
+	seek(state, n);
+	depth--;
+}
+
+int main(void)
+{
+	struct state *state = talz(NULL, struct state);
+	unsigned int i;
+
+	list_head_init(&state->detached_blocks);
+	detached_sha_hash_init(&state->detached_by_sha);
+	detached_prev_hash_init(&state->detached_by_prev);
+	list_head_init(&state->detached_queue);
+
+	/* 1 <- 2 <- 3 <- 4 <- 5, and 2 <- 6, arriving backwards. */
+	add(state, 5, 4);
+	add(state, 4, 3);
+	add(state, 3, 2);
+	add(state, 6, 2);
+	add(state, 2, 1);
+	assert(state->num_detached == 5);
+	for (i = 2; i <= 6; i++) {
+		struct protocol_block_id sha = id(i);
+		assert(have_detached_block(state, &sha));
+	}
+
+	/* Something else arriving doesn't shake any loose. */
+	seek(state, 7);
+	assert(num_reinjected == 0);
+	assert(state->num_detached == 5);
+
+	/* 1 arrives: the whole run goes in, parents first, no recursion. */
+	seek(state, 1);
+	assert(num_reinjected == 5);
+	assert(max_depth == 1);
+	assert(reinjected[0] == 2);
+	/* 3 and 6 both wait on 2, in either order. */
+	assert((reinjected[1] == 3 && reinjected[2] == 6)
+	       || (reinjected[1] == 6 && reinjected[2] == 3));
+	assert(reinjected[3] == 4);
+	assert(reinjected[4] == 5);
+	assert(state->num_detached == 0);
+	assert(list_empty(&state->detached_blocks));
+	assert(list_empty(&state->detached_queue));
+	for (i = 2; i <= 6; i++) {
+		struct protocol_block_id sha = id(i);
+		assert(!have_detached_block(state, &sha));
+	}
+
+	/* Fill it up: the oldest two get evicted. */
+	num_reinjected = 0;
+	for (i = 0; i < MAX_DETACHED_BLOCKS + 2; i++)
+		add(state, 1000 + i, 100000 + i);
+	assert(state->num_detached == MAX_DETACHED_BLOCKS);
+	assert(state->metrics.detached_evicted == 2);
+	for (i = 0; i < MAX_DETACHED_BLOCKS + 2; i++) {
+		struct protocol_block_id sha = id(1000 + i);
+		assert(have_detached_block(state, &sha) == (i >= 2));
+	}
+	assert(id_num(&list_top(&state->detached_blocks,
+				struct detached_block, list)->sha) == 1002);
+
+	/* Evicted ones don't come back when their prev turns up... */
+	seek(state, 100000);
+	seek(state, 100001);
+	assert(num_reinjected == 0);
+
+	/* ...but the survivors do. */
+	seek(state, 100002);
+	assert(num_reinjected == 1);
+	assert(reinjected[0] == 1002);
+	assert(state->num_detached == MAX_DETACHED_BLOCKS - 1);
+
+	detached_sha_hash_clear(&state->detached_by_sha);
+	detached_prev_hash_clear(&state->detached_by_prev);
+	tal_free(state);
+	return 0;
+}
@@ -14,6 +14,8 @@ int main(void)
 	char *cmd_arr, *cmd_obj;
 	struct protocol_double_sha sha;
 	struct json_result *result;
+	char *expect;
+	unsigned int i;
 
 	ctx = tal(NULL, char);
 
@@ -161,6 +163,19 @@ int main(void)
 		     " \"sha\" : \"2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a\","
 		     " \"test-address\" : \"qKCafy33t92L9Nmoxx8H6NHDuiyGViqWBZ\","
 		     " \"address\" : \"PZZyf1xcSbNFodrGQ6ot4LrsdSUu1bgmkc\" }"));
+
+	/* Long enough to grow the buffer many times, part way through
+	 * formatting. */
+	result = new_json_result(ctx);
+	expect = tal_strdup(ctx, "[ ");
+	json_array_start(result, NULL);
+	for (i = 0; i < 1000; i++) {
+		json_add_num(result, NULL, i * 12345);
+		tal_append_fmt(&expect, "%s%u", i ? ", " : "", i * 12345);
+	}
+	json_array_end(result);
+	tal_append_fmt(&expect, " ]");
+	assert(streq(json_result_string(result), expect));
 	tal_free(ctx);
 	return 0;
 }
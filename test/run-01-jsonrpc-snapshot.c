@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <ccan/io/io.h>
+#include <ccan/tal/tal.h>
+
+#include "../jsonrpc.c"
+#include "../json.c"
+#include "../minimal_log.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for binrpc_connected */
+struct io_plan *binrpc_connected(struct io_conn *conn, struct state *state)
+{ fprintf(stderr, "binrpc_connected called!\n"); abort(); }
+/* Generated stub for detachedblocks_command */
+const struct json_command detachedblocks_command;
+/* Generated stub for getblock_command */
+const struct json_command getblock_command;
+/* Generated stub for getblockhash_command */
+const struct json_command getblockhash_command;
+/* Generated stub for getinfo_command */
+const struct json_command getinfo_command;
+/* Generated stub for getpeerinfo_command */
+const struct json_command getpeerinfo_command;
+/* Generated stub for gettransaction_command */
+const struct json_command gettransaction_command;
+/* Generated stub for listtodo_command */
+const struct json_command listtodo_command;
+/* Generated stub for listtransactions_command */
+const struct json_command listtransactions_command;
+/* Generated stub for log_each_line_ */
+void log_each_line_(const struct log_record *lr,
+		    void (*func)(unsigned int skipped,
+				 struct timerel time,
+				 enum log_level level,
+				 const char *prefix,
+				 const char *log,
+				 void *arg),
+		    void *arg)
+{ fprintf(stderr, "log_each_line_ called!\n"); abort(); }
+/* Generated stub for log_init_time */
+const struct timeabs *log_init_time(const struct log_record *lr)
+{ fprintf(stderr, "log_init_time called!\n"); abort(); }
+/* Generated stub for log_max_mem */
+size_t log_max_mem(const struct log_record *lr)
+{ fprintf(stderr, "log_max_mem called!\n"); abort(); }
+/* Generated stub for log_prefix */
+const char *log_prefix(const struct log *log)
+{ fprintf(stderr, "log_prefix called!\n"); abort(); }
+/* Generated stub for log_used */
+size_t log_used(const struct log_record *lr)
+{ fprintf(stderr, "log_used called!\n"); abort(); }
+/* Generated stub for pettycoin_to_base58 */
+char *pettycoin_to_base58(const tal_t *ctx, bool test_net,
+			  const struct protocol_address *addr,
+			  bool bitcoin_style)
+{ fprintf(stderr, "pettycoin_to_base58 called!\n"); abort(); }
+/* Generated stub for sendrawtransaction_command */
+const struct json_command sendrawtransaction_command;
+/* Generated stub for set_log_io */
+void set_log_io(struct log *log, unsigned int every)
+{ fprintf(stderr, "set_log_io called!\n"); abort(); }
+/* Generated stub for set_log_io_default */
+void set_log_io_default(struct log_record *lr, unsigned int every)
+{ fprintf(stderr, "set_log_io_default called!\n"); abort(); }
+/* Generated stub for submitblock_command */
+const struct json_command submitblock_command;
+/* Generated stub for to_hex */
+char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
+{ fprintf(stderr, "to_hex called!\n"); abort(); }
+/* Generated stub for unwatchaddress_command */
+const struct json_command unwatchaddress_command;
+/* Generated stub for watchaddress_command */
+const struct json_command watchaddress_command;
+/* AUTOGENERATED MOCKS END */
+
+/* Children must stop logging into our record. */
+static bool went_private;
+static pid_t parent;
+void log_record_private(struct log_record *lr)
+{
+	assert(lr == (void *)&went_private);
+	went_private = true;
+}
+
+/* Tells us which process ran it. */
+static char *json_whoami(struct json_connection *jcon,
+			 const jsmntok_t *params,
+			 struct json_result *response)
+{
+	json_add_num(response, NULL,
+		     getpid() == parent || went_private ? getpid() : 0);
+	return NULL;
+}
+
+const struct json_command getmetrics_command = {
+	"whoami", json_whoami, "", "", true
+};
+
+static struct json_output *request(struct json_connection *jcon,
+				   const char *cmd)
+{
+	struct json_output *out = tal(jcon, struct json_output);
+	jsmn_parser parser;
+	jsmntok_t toks[10];
+
+	jcon->buffer = tal_strdup(jcon, cmd);
+	jsmn_init(&parser);
+	assert(jsmn_parse(&parser, jcon->buffer, strlen(jcon->buffer),
+			  toks, ARRAY_SIZE(toks)) > 0);
+	assert(parse_request(jcon, toks, out, false));
+	list_add_tail(&jcon->output, &out->list);
+	return out;
+}
+
+static const char *reply_from(const tal_t *ctx, pid_t pid)
+{
+	return tal_fmt(ctx, "{ \"result\" : %u, \"error\" : null,"
+		       " \"id\" : 1 }\n", (unsigned)pid);
+}
+
+int main(void)
+{
+	struct state *state = tal(NULL, struct state);
+	struct json_connection *jcon;
+	struct json_output *out[MAX_SNAPSHOTS_PER_JCON + 1];
+	const char *cmd = "{ \"method\" : \"whoami\", \"params\" : [],"
+		" \"id\" : 1 }";
+	unsigned int i;
+
+	jcon = tal(NULL, struct json_connection);
+	parent = getpid();
+	state->lr = (void *)&went_private;
+	jcon->state = state;
+	jcon->log = NULL;
+	jcon->num_snapshots = 0;
+	list_head_init(&jcon->output);
+
+	/* First ones fork, last one is over the limit so runs here. */
+	for (i = 0; i < ARRAY_SIZE(out); i++)
+		out[i] = request(jcon, cmd);
+
+	assert(num_snapshots == MAX_SNAPSHOTS_PER_JCON);
+	assert(jcon->num_snapshots == MAX_SNAPSHOTS_PER_JCON);
+	for (i = 0; i < MAX_SNAPSHOTS_PER_JCON; i++)
+		assert(!out[i]->json);
+	assert(streq(out[i]->json, reply_from(jcon, getpid())));
+
+	/* Reads replies from the pipes, and they all close. */
+	io_loop(NULL, NULL);
+
+	for (i = 0; i < MAX_SNAPSHOTS_PER_JCON; i++) {
+		assert(out[i]->json);
+		assert(!streq(out[i]->json, reply_from(jcon, getpid())));
+		assert(!streq(out[i]->json, reply_from(jcon, 0)));
+		assert(strstarts(out[i]->json, "{ \"result\" : "));
+	}
+	assert(!streq(out[0]->json, out[1]->json));
+
+	/* Children have been reaped. */
+	assert(num_snapshots == 0);
+	assert(jcon->num_snapshots == 0);
+	assert(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD);
+
+	/* We can fork again now. */
+	out[0] = request(jcon, cmd);
+	assert(!out[0]->json);
+	assert(num_snapshots == 1);
+
+	/* If jcon goes away, child still gets reaped. */
+	tal_free(jcon);
+	assert(num_snapshots == 1);
+	io_loop(NULL, NULL);
+	assert(num_snapshots == 0);
+	assert(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD);
+
+	tal_free(state);
+	return 0;
+}
@@ -13,6 +13,9 @@
 #include "../minimal_log.c"
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for binrpc_connected */
+struct io_plan *binrpc_connected(struct io_conn *conn, struct state *state)
+{ fprintf(stderr, "binrpc_connected called!\n"); abort(); }
 /* Generated stub for detachedblocks_command */
 const struct json_command detachedblocks_command;
 /* Generated stub for getblock_command */
@@ -21,6 +24,8 @@ const struct json_command getblock_command;
 const struct json_command getblockhash_command;
 /* Generated stub for getinfo_command */
 const struct json_command getinfo_command;
+/* Generated stub for getmetrics_command */
+const struct json_command getmetrics_command;
 /* Generated stub for getpeerinfo_command */
 const struct json_command getpeerinfo_command;
 /* Generated stub for gettransaction_command */
@@ -48,6 +53,9 @@ size_t log_max_mem(const struct log_record *lr)
 /* Generated stub for log_prefix */
 const char *log_prefix(const struct log *log)
 { fprintf(stderr, "log_prefix called!\n"); abort(); }
+/* Generated stub for log_record_private */
+void log_record_private(struct log_record *lr)
+{ fprintf(stderr, "log_record_private called!\n"); abort(); }
 /* Generated stub for log_used */
 size_t log_used(const struct log_record *lr)
 { fprintf(stderr, "log_used called!\n"); abort(); }
@@ -58,11 +66,21 @@ char *pettycoin_to_base58(const tal_t *ctx, bool test_net,
 { fprintf(stderr, "pettycoin_to_base58 called!\n"); abort(); }
 /* Generated stub for sendrawtransaction_command */
 const struct json_command sendrawtransaction_command;
+/* Generated stub for set_log_io */
+void set_log_io(struct log *log, unsigned int every)
+{ fprintf(stderr, "set_log_io called!\n"); abort(); }
+/* Generated stub for set_log_io_default */
+void set_log_io_default(struct log_record *lr, unsigned int every)
+{ fprintf(stderr, "set_log_io_default called!\n"); abort(); }
 /* Generated stub for submitblock_command */
 const struct json_command submitblock_command;
 /* Generated stub for to_hex */
 char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
 { fprintf(stderr, "to_hex called!\n"); abort(); }
+/* Generated stub for unwatchaddress_command */
+const struct json_command unwatchaddress_command;
+/* Generated stub for watchaddress_command */
+const struct json_command watchaddress_command;
 /* AUTOGENERATED MOCKS END */
 
 static void test(const char *input, const char *expect, bool needs_more, bool extra)
@@ -75,6 +93,7 @@ static void test(const char *input, const char *expect, bool needs_more, bool ex
 	jcon->len_read = strlen(input);
 	jcon->buffer = tal_dup(jcon, char, input, strlen(input), 0);
 	jcon->state = &state;
+	init_json_parse(jcon);
 	list_head_init(&jcon->output);
 
 	plan = read_json(NULL, jcon);
@@ -107,7 +126,10 @@ static void test(const char *input, const char *expect, bool needs_more, bool ex
 int main(void)
 {
 	unsigned int i;
-	const char *cmd;
+	const char *cmd, *expect;
+	struct state state;
+	struct json_connection *jcon;
+	struct json_output *out;
 	const char echocmd[] = "{ \"method\" : \"dev-echo\", "
 		"\"params\" : [ \"hello\", \"Arabella!\" ], "
 		"\"id\" : \"1\" }";
@@ -131,6 +153,90 @@ int main(void)
 	test(cmd, echoresult, false, true);
 	tal_free(cmd);
 
+	/* A batch gets an array of replies. */
+	cmd = tal_fmt(NULL, "[ %s, %s ]", echocmd, echocmd);
+	expect = tal_fmt(NULL, "[ %.*s, %.*s ]\n",
+			 (int)strlen(echoresult) - 1, echoresult,
+			 (int)strlen(echoresult) - 1, echoresult);
+	test(cmd, expect, false, false);
+	tal_free(cmd);
+	tal_free(expect);
+
+	/* A bad element gets an error reply; the rest still run. */
+	cmd = tal_fmt(NULL, "[ %s, 5, { \"method\" : \"dev-echo\","
+		      " \"params\" : [ ] }, %s ]", echocmd, echocmd);
+	expect = tal_fmt(NULL, "[ %.*s, %s, %s, %.*s ]\n",
+			 (int)strlen(echoresult) - 1, echoresult,
+			 "{ \"result\" : null, \"error\" : \"Invalid request\","
+			 " \"id\" : null }",
+			 "{ \"result\" : null, \"error\" : \"Invalid request\","
+			 " \"id\" : null }",
+			 (int)strlen(echoresult) - 1, echoresult);
+	test(cmd, expect, false, false);
+	tal_free(cmd);
+	tal_free(expect);
+
+	/* Empty batch is an error. */
+	test("[ ]", NULL, false, false);
+
+	/* Parsing carries on where the last read stopped. */
+	cmd = tal_fmt(NULL, "%s %s", echocmd, echocmd);
+	for (i = 1; i < strlen(cmd); i++) {
+		unsigned int num = 0;
+
+		jcon = tal(NULL, struct json_connection);
+		jcon->used = 0;
+		jcon->len_read = i;
+		jcon->buffer = tal_dup(jcon, char, cmd, strlen(cmd), 0);
+		jcon->state = &state;
+		init_json_parse(jcon);
+		list_head_init(&jcon->output);
+
+		assert(read_json(NULL, jcon) == (void *)jcon);
+		/* Whatever it didn't consume is still at the front. */
+		memcpy(jcon->buffer + jcon->used, cmd + i, strlen(cmd) - i);
+		jcon->len_read = strlen(cmd) - i;
+		assert(read_json(NULL, jcon) == (void *)jcon);
+		assert(jcon->used == 0);
+
+		while ((out = list_pop(&jcon->output, struct json_output,
+				       list)) != NULL) {
+			assert(streq(out->json, echoresult));
+			num++;
+		}
+		assert(num == 2);
+		tal_free(jcon);
+	}
+	tal_free(cmd);
+
+	/* A read can end in the middle of a number: we must not take
+	 * the first part as the whole thing. */
+	cmd = "{ \"method\" : \"dev-echo\", "
+		"\"params\" : [ 12345, \"x\" ], \"id\" : 678 }";
+	expect = "{ \"result\" : { \"num\" : 2,"
+		" \"echo\" : [ 12345, \"x\" ] }, "
+		"\"error\" : null, \"id\" : 678 }\n";
+	for (i = 1; i < strlen(cmd); i++) {
+		jcon = tal(NULL, struct json_connection);
+		jcon->used = 0;
+		jcon->len_read = i;
+		jcon->buffer = tal_dup(jcon, char, cmd, strlen(cmd), 0);
+		jcon->state = &state;
+		init_json_parse(jcon);
+		list_head_init(&jcon->output);
+
+		assert(read_json(NULL, jcon) == (void *)jcon);
+		assert(list_empty(&jcon->output));
+		memcpy(jcon->buffer + jcon->used, cmd + i, strlen(cmd) - i);
+		jcon->len_read = strlen(cmd) - i;
+		assert(read_json(NULL, jcon) == (void *)jcon);
+
+		out = list_pop(&jcon->output, struct json_output, list);
+		assert(streq(out->json, expect));
+		assert(list_empty(&jcon->output));
+		tal_free(jcon);
+	}
+
 	/* Unknown method. */
 	test("{ \"method\" : \"unknown\", "
 	     "\"params\" : [ \"hello\", \"Arabella!\" ], "
@@ -154,5 +260,17 @@ int main(void)
 	     "\"params\" : [ \"hello\", \"Arabella!\" ], "
 	     "\"id\" : \"2\" }", NULL, false, false);
 
+	/* Notifications get queued like any reply. */
+	jcon = tal(NULL, struct json_connection);
+	list_head_init(&jcon->output);
+	json_notify(jcon, "{ \"event\" : \"pending\" }");
+	out = list_pop(&jcon->output, struct json_output, list);
+	assert(streq(out->json,
+		     "{ \"method\" : \"notify\","
+		     " \"params\" : { \"event\" : \"pending\" },"
+		     " \"id\" : null }\n"));
+	assert(list_empty(&jcon->output));
+	tal_free(jcon);
+
 	return 0;
 }
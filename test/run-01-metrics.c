@@ -0,0 +1,169 @@
+#include <ccan/io/io.h>
+#include <ccan/tal/tal.h>
+#include "../metrics.c"
+#include "../json.c"
+#include "../pkt_names.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for pettycoin_to_base58 */
+char *pettycoin_to_base58(const tal_t *ctx, bool test_net,
+			  const struct protocol_address *addr,
+			  bool bitcoin_style)
+{ fprintf(stderr, "pettycoin_to_base58 called!\n"); abort(); }
+/* Generated stub for to_hex */
+char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
+{ fprintf(stderr, "to_hex called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+size_t num_pending_known(struct state *state)
+{
+	return 7;
+}
+
+u64 num_sigs_checked(void)
+{
+	return 8;
+}
+
+u64 num_merkle_hashes(void)
+{
+	return 9;
+}
+
+static struct timerel usec(u64 usec)
+{
+	return time_from_usec(usec);
+}
+
+/* Layout of JSON output isn't what we're testing. */
+static const char *squash(const tal_t *ctx, const char *str)
+{
+	char *out = tal_arr(ctx, char, strlen(str) + 1), *p = out;
+
+	for (; *str; str++)
+		if (!cisspace(*str))
+			*(p++) = *str;
+	*p = '\0';
+	return out;
+}
+
+int main(void)
+{
+	struct state *state = talz(NULL, struct state);
+	struct json_connection *jcon = talz(state, struct json_connection);
+	struct json_result *response = new_json_result(state);
+	struct metrics *m = &state->metrics;
+	const char *json, *text, *p;
+	struct timerel t;
+	unsigned int i;
+
+	list_head_init(&state->todo);
+	list_head_init(&state->peers);
+	state->pending = talz(state, struct pending_block);
+	state->pending->num_unknown = 3;
+	jcon->state = state;
+
+	m->pkts_in[PROTOCOL_PKT_TX] = 2;
+	m->bytes_in[PROTOCOL_PKT_TX] = 200;
+	m->todo_added = 5;
+
+	/* Bucket i is under 2^i usec: 0, 1, 3 and 4 go in 0, 1, 2, 3. */
+	metric_latency_add(&m->pkt_handle[PROTOCOL_PKT_TX], usec(0));
+	metric_latency_add(&m->pkt_handle[PROTOCOL_PKT_TX], usec(1));
+	metric_latency_add(&m->pkt_handle[PROTOCOL_PKT_TX], usec(3));
+	metric_latency_add(&m->pkt_handle[PROTOCOL_PKT_TX], usec(4));
+	assert(m->pkt_handle[PROTOCOL_PKT_TX].bucket[0] == 1);
+	assert(m->pkt_handle[PROTOCOL_PKT_TX].bucket[1] == 1);
+	assert(m->pkt_handle[PROTOCOL_PKT_TX].bucket[2] == 1);
+	assert(m->pkt_handle[PROTOCOL_PKT_TX].bucket[3] == 1);
+	assert(m->pkt_handle[PROTOCOL_PKT_TX].total_usec == 8);
+
+	/* Huge ones all go in the last bucket. */
+	metric_latency_add(&m->loop_late, usec(1ULL << 40));
+	assert(m->loop_late.bucket[METRIC_LATENCY_BUCKETS-1] == 1);
+
+	assert(!json_getmetrics(jcon, NULL, response));
+	json = squash(state, json_result_string(response));
+
+	/* Only non-zero types appear in a family. */
+	assert(strstr(json, "\"pkts_in\":{\"PROTOCOL_PKT_TX\":2}"));
+	assert(strstr(json, "\"bytes_in\":{\"PROTOCOL_PKT_TX\":200}"));
+	assert(strstr(json, "\"pkts_out\":{}"));
+	assert(strstr(json, "\"pkt_handle\":{\"PROTOCOL_PKT_TX\":{\"count\":4,"
+		      "\"total_usec\":8,\"buckets\":[1,1,1,1,0,"));
+	assert(strstr(json, ",0,1]},\"loop_stalls\":0,"));
+	assert(strstr(json, "\"todo_added\":5,"));
+	assert(strstr(json, "\"pending_known\":7,"));
+	assert(strstr(json, "\"pending_unknown\":3,"));
+	assert(strstr(json, "\"sigs_checked\":8,"));
+	assert(strstr(json, "\"merkle_hashes\":9,"));
+	assert(strstr(json, "\"recent_slow_pkts\":[]"));
+
+	/* So every line starts with \n. */
+	text = tal_fmt(state, "\n%s", metrics_text(state, state));
+	assert(strstr(text, "\npettycoin_pkts_in{type=\"PROTOCOL_PKT_TX\"} 2\n"));
+	assert(!strstr(text, "pettycoin_pkts_out{"));
+	assert(strstr(text, "\npettycoin_todo_added 5\n"));
+	assert(strstr(text, "\npettycoin_pending_unknown 3\n"));
+
+	/* Text buckets are cumulative. */
+	assert(strstr(text, "\npettycoin_pkt_handle_usec_bucket"
+		      "{type=\"PROTOCOL_PKT_TX\",le=\"0\"} 1\n"
+		      "pettycoin_pkt_handle_usec_bucket"
+		      "{type=\"PROTOCOL_PKT_TX\",le=\"1\"} 2\n"
+		      "pettycoin_pkt_handle_usec_bucket"
+		      "{type=\"PROTOCOL_PKT_TX\",le=\"3\"} 3\n"
+		      "pettycoin_pkt_handle_usec_bucket"
+		      "{type=\"PROTOCOL_PKT_TX\",le=\"7\"} 4\n"));
+	assert(strstr(text, "\npettycoin_pkt_handle_usec_bucket"
+		      "{type=\"PROTOCOL_PKT_TX\",le=\"+Inf\"} 4\n"
+		      "pettycoin_pkt_handle_usec_sum{type=\"PROTOCOL_PKT_TX\"} 8\n"
+		      "pettycoin_pkt_handle_usec_count{type=\"PROTOCOL_PKT_TX\"} 4\n"));
+	assert(strstr(text, "\npettycoin_loop_late_usec_bucket"
+		      "{le=\"4194303\"} 0\n"));
+	assert(strstr(text, "\npettycoin_loop_late_usec_bucket"
+		      "{le=\"+Inf\"} 1\n"
+		      "pettycoin_loop_late_usec_sum{} 1099511627776\n"));
+
+	/* Slow packets: under the threshold isn't kept. */
+	m->slow_pkt_usec = 1000000;
+	assert(!metric_pkt_handled(m, 1, PROTOCOL_PKT_BLOCK, 100,
+				   time_mono(), &t));
+	assert(m->num_slow_pkts == 0);
+	assert(m->pkt_handle[PROTOCOL_PKT_BLOCK].count == 1);
+
+	/* Over it is, and the ring wraps keeping the newest. */
+	for (i = 0; i < METRIC_SLOW_PKTS + 3; i++) {
+		struct timemono start = time_mono();
+		start.ts.tv_sec -= 2;
+		assert(metric_pkt_handled(m, i, PROTOCOL_PKT_BLOCK, 1000 + i,
+					  start, &t));
+		assert(time_to_usec(t) >= 2000000);
+	}
+	assert(m->num_slow_pkts == METRIC_SLOW_PKTS + 3);
+	assert(m->pkt_handle[PROTOCOL_PKT_BLOCK].count == METRIC_SLOW_PKTS + 4);
+	assert(m->slow_pkts[0].peer_num == METRIC_SLOW_PKTS);
+	assert(m->slow_pkts[2].len == 1000 + METRIC_SLOW_PKTS + 2);
+	assert(m->slow_pkts[3].peer_num == 3);
+
+	/* getmetrics gives them oldest first. */
+	response = new_json_result(state);
+	assert(!json_getmetrics(jcon, NULL, response));
+	json = squash(state, json_result_string(response));
+	assert(strstr(json, "\"slow_pkts\":19,"));
+	assert(strstr(json, "\"slow_pkt_usec\":1000000,"));
+	p = strstr(json, "\"recent_slow_pkts\":[");
+	assert(p);
+	for (i = 3; i < METRIC_SLOW_PKTS + 3; i++) {
+		char *want = tal_fmt(state, "\"peer_num\":%u,"
+				     "\"type\":\"PROTOCOL_PKT_BLOCK\","
+				     "\"len\":%u,", i, 1000 + i);
+		p = strstr(p, want);
+		assert(p);
+	}
+	/* The three overwritten ones are gone. */
+	assert(!strstr(json, "\"peer_num\":2,"));
+
+	tal_free(state);
+	return 0;
+}
@@ -86,6 +86,9 @@ void seek_detached_blocks(struct state *state, const struct block *block)
 /* Generated stub for update_block_ptrs_new_block */
 void update_block_ptrs_new_block(struct state *state, struct block *block)
 { fprintf(stderr, "update_block_ptrs_new_block called!\n"); abort(); }
+/* Generated stub for utxo_add_block */
+void utxo_add_block(struct state *state, const struct block *block)
+{ fprintf(stderr, "utxo_add_block called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 int main(int argc, char *argv[])
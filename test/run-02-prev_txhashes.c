@@ -9,10 +9,17 @@
 #include "../prev_txhashes.c"
 #include "../shadouble.c"
 #include "../tx.c"
+#include "../utxo.c"
 #include "easy_genesis.c"
 #include "named_blocks.c"
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for addrhash_hashfn */
+size_t addrhash_hashfn(const struct protocol_address *addr)
+{ fprintf(stderr, "addrhash_hashfn called!\n"); abort(); }
+/* Generated stub for addrhash_keyof */
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae)
+{ fprintf(stderr, "addrhash_keyof called!\n"); abort(); }
 /* Generated stub for block_to_pending */
 void block_to_pending(struct state *state, const struct block *block)
 { fprintf(stderr, "block_to_pending called!\n"); abort(); }
@@ -131,9 +138,23 @@ void refresh_peer_cache(struct state *state)
 void todo_forget_about_block(struct state *state,
 			     const struct protocol_block_id *block)
 { fprintf(stderr, "todo_forget_about_block called!\n"); abort(); }
+/* Generated stub for txhash_firstval */
+struct txhash_elem *txhash_firstval(struct txhash *txhash,
+				    const struct protocol_tx_id *sha,
+				    struct txhash_iter *i)
+{ fprintf(stderr, "txhash_firstval called!\n"); abort(); }
+/* Generated stub for txhash_nextval */
+struct txhash_elem *txhash_nextval(struct txhash *txhash,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i)
+{ fprintf(stderr, "txhash_nextval called!\n"); abort(); }
 /* Generated stub for wake_peers */
 void wake_peers(struct state *state)
 { fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 size_t marshal_input_ref_len(const union protocol_tx *tx)
@@ -170,7 +191,7 @@ int main(void)
 	union protocol_tx *tx;
 	struct block *b;
 	u8 empty_prev_txhash, non_empty_prev_txhash, *prev_txhashes;
-	struct protocol_address my_addr;
+	struct protocol_address my_addr, other_addr;
 	size_t i;
 
 	memset(&my_addr, 0, sizeof(my_addr));
@@ -207,6 +228,13 @@ int main(void)
 
 	non_empty_prev_txhash = prev_txhash(&my_addr, b, 0);
 
+	/* Another address mustn't get our cached answer. */
+	other_addr = my_addr;
+	other_addr.addr[0] = 1;
+	assert(prev_txhash(&other_addr, b, 0) == hash_shard(&other_addr, b, 0));
+	assert(prev_txhash(&my_addr, b, 0) == non_empty_prev_txhash);
+	assert(non_empty_prev_txhash == hash_shard(&my_addr, b, 0));
+
 	prev_txhashes = make_prev_txhashes(state, b, &my_addr);
 	/* This will be first byte of prev_txhashes */
 	for (i = 0; i < tal_count(prev_txhashes); i++) {
@@ -56,21 +56,24 @@ int generate_main(int argc, char *argv[]);
 #include "../create_refs.c"
 #include "../tx.c"
 #include "../proof.c"
+#include "../utxo.c"
+#include "../addrhash.c"
 #include "easy_genesis.c"
 
 /* AUTOGENERATED MOCKS START */
-/* Generated stub for add_txhash_to_hashes */
-void add_txhash_to_hashes(struct state *state,
-			  const tal_t *ctx,
-			  struct block *block, u16 shard, u8 txoff,
-			  const struct protocol_tx_id *txhash)
-{ fprintf(stderr, "add_txhash_to_hashes called!\n"); abort(); }
 /* Generated stub for add_tx_to_hashes */
 void add_tx_to_hashes(struct state *state,
 		      const tal_t *ctx,
 		      struct block *block, u16 shard, u8 txoff,
 		      const union protocol_tx *tx)
 { fprintf(stderr, "add_tx_to_hashes called!\n"); abort(); }
+/* Generated stub for add_txhash_to_hashes */
+struct txhash_elem *add_txhash_to_hashes(struct state *state,
+					 const tal_t *ctx,
+					 struct block *block,
+					 u16 shard, u8 txoff,
+					 const struct protocol_tx_id *txhash)
+{ fprintf(stderr, "add_txhash_to_hashes called!\n"); abort(); }
 /* Generated stub for block_expired_by */
 bool block_expired_by(u32 expires, u32 now)
 { fprintf(stderr, "block_expired_by called!\n"); abort(); }
@@ -242,12 +245,17 @@ struct txhash_elem *txhash_gettx_ancestor(struct state *state,
 { fprintf(stderr, "txhash_gettx_ancestor called!\n"); abort(); }
 /* Generated stub for upgrade_tx_in_hashes */
 void upgrade_tx_in_hashes(struct state *state,
+			  const struct block *block, u16 shard, u8 txoff,
 			  const struct protocol_tx_id *sha,
 			  const union protocol_tx *tx)
 { fprintf(stderr, "upgrade_tx_in_hashes called!\n"); abort(); }
 /* Generated stub for wake_peers */
 void wake_peers(struct state *state)
 { fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 struct pending_block *new_pending_block(struct state *state)
@@ -58,6 +58,8 @@ int generate_main(int argc, char *argv[]);
 #include "../proof.c"
 #include "../tx_in_hashes.c"
 #include "../horizon.c"
+#include "../utxo.c"
+#include "../addrhash.c"
 #include "easy_genesis.c"
 
 /* AUTOGENERATED MOCKS START */
@@ -216,6 +218,10 @@ void todo_forget_about_block(struct state *state,
 /* Generated stub for wake_peers */
 void wake_peers(struct state *state)
 { fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 void send_tx_in_block_to_peers(struct state *state, const struct peer *exclude,
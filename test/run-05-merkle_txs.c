@@ -0,0 +1,127 @@
+#include "../block_shard.c"
+#include "../merkle_hashes.c"
+#include "../merkle_recurse.c"
+#include "../merkle_txs.c"
+#include "../proof.c"
+#include "../shadouble.c"
+#include <assert.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for check_tx */
+enum protocol_ecode check_tx(struct state *state, const union protocol_tx *tx,
+			     const struct block *inside_block)
+{ fprintf(stderr, "check_tx called!\n"); abort(); }
+/* Generated stub for check_tx_inputs */
+enum input_ecode check_tx_inputs(struct state *state,
+				 const struct block *block,
+				 const struct txhash_elem *me,
+				 const union protocol_tx *tx,
+				 unsigned int *bad_input_num)
+{ fprintf(stderr, "check_tx_inputs called!\n"); abort(); }
+/* Generated stub for hash_tx_and_refs */
+void hash_tx_and_refs(const union protocol_tx *tx,
+		      const struct protocol_input_ref *refs,
+		      struct protocol_txrefhash *txrefhash)
+{ fprintf(stderr, "hash_tx_and_refs called!\n"); abort(); }
+/* Generated stub for num_inputs */
+u32 num_inputs(const union protocol_tx *tx)
+{ fprintf(stderr, "num_inputs called!\n"); abort(); }
+/* Generated stub for tx_len */
+size_t tx_len(const union protocol_tx *tx)
+{ fprintf(stderr, "tx_len called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* The slow way: every level in full, zeroes and all. */
+static void full_merkle(const struct block_shard *shard,
+			struct protocol_double_sha *merkle)
+{
+	struct protocol_double_sha level[256];
+	unsigned int i;
+
+	memset(level, 0, sizeof(level));
+	for (i = 0; i < shard->size; i++)
+		merkle_tx(shard, i, &level[i]);
+	for (i = 128; i > 0; i /= 2)
+		merkle_level(level, i, level);
+	*merkle = level[0];
+}
+
+int main(void)
+{
+	const tal_t *ctx = tal(NULL, char);
+	unsigned int sizes[] = { 1, 2, 3, 5, 100, 128, 129, 255 };
+	struct protocol_txrefhash hashes[256];
+	struct protocol_double_sha merkle;
+	unsigned int i, j;
+
+	/* Our shortcut must match the plain double SHA. */
+	for (i = 0; i < 3; i++) {
+		struct protocol_double_sha pair[2], merkle, sha;
+
+		memset(pair, i * 0x55, sizeof(pair));
+		pair[1].sha[31] = i;
+		merkle_two_hashes(&pair[0], &pair[1], &merkle);
+		double_sha_of(&sha, pair, sizeof(pair));
+		assert(structeq(&merkle, &sha));
+		merkle_level(pair, 1, pair);
+		assert(structeq(&pair[0], &sha));
+	}
+
+	/* Empty shard: all zero subtrees. */
+	merkle_hashes(hashes, 0, 0, &merkle);
+	assert(structeq(&merkle, merkle_zero(8)));
+	for (i = 1; i < MERKLE_ZERO_LEVELS; i++) {
+		struct protocol_double_sha zero;
+
+		memset(&zero, 0, sizeof(zero));
+		assert(structeq(merkle_zero(i-1), &zero) == (i == 1));
+		merkle_two_hashes(merkle_zero(i-1), merkle_zero(i-1), &zero);
+		assert(structeq(merkle_zero(i), &zero));
+	}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		struct block_shard *shard = new_block_shard(ctx, 0, sizes[i]);
+		struct protocol_block_header hdr;
+		struct protocol_double_sha root;
+		struct block b;
+		u8 num_txs = sizes[i];
+
+		for (j = 0; j < shard->size; j++) {
+			struct protocol_txrefhash *h;
+
+			h = tal(shard, struct protocol_txrefhash);
+			memset(h, j, sizeof(*h));
+			h->refhash.sha[0] = i;
+			bitmap_set_bit(shard->txp_or_hash, j);
+			shard->u[j].hash = h;
+			shard->hashcount++;
+		}
+
+		full_merkle(shard, &root);
+		merkle_txs(shard, &merkle);
+		assert(structeq(&merkle, &root));
+		for (j = 0; j < shard->size; j++)
+			hashes[j] = *shard->u[j].hash;
+		merkle_hashes(hashes, 0, shard->size, &merkle);
+		assert(structeq(&merkle, &root));
+
+		/* A block with just this shard. */
+		memset(&hdr, 0, sizeof(hdr));
+		memset(&b, 0, sizeof(b));
+		b.bi.hdr = &hdr;
+		b.bi.num_txs = &num_txs;
+		b.bi.merkles = &root;
+		b.shard = &shard;
+
+		for (j = 0; j < shard->size; j++) {
+			struct protocol_proof proof;
+
+			create_proof(&proof, &b, 0, j);
+			assert(check_proof_byhash(&proof, &b,
+						  shard->u[j].hash));
+		}
+	}
+
+	tal_free(ctx);
+	return 0;
+}
@@ -8,12 +8,11 @@
 #include <sys/wait.h>
 static struct timeabs my_time;
 
-/* Prune everything! */
-#define isaac64_next_uint(isaac64, n) ((n) - 1)
 #define time_now() my_time
 #include "../log.c"
 #include "../log_helper.c"
 #include "../ecode_names.c"
+#include "../hex.c"
 #include "../base58.c"
 #include "../marshal.c"
 #include "../pkt_names.c"
@@ -24,13 +23,6 @@ static struct timeabs my_time;
 /* Generated stub for hash_tx */
 void hash_tx(const union protocol_tx *tx, struct protocol_tx_id *txid)
 { fprintf(stderr, "hash_tx called!\n"); abort(); }
-/* Generated stub for to_hex */
-char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
-{ fprintf(stderr, "to_hex called!\n"); abort(); }
-/* Generated stub for to_hex_direct */
-size_t to_hex_direct(char *dest, size_t destlen,
-		     const void *buf, size_t bufsize)
-{ fprintf(stderr, "to_hex_direct called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 static char *read_from(const tal_t *ctx, int fd)
@@ -50,6 +42,21 @@ static char *read_from(const tal_t *ctx, int fd)
 	return p;
 }
 
+static char *log_text(const tal_t *ctx, const struct log_record *lr)
+{
+	char tmpfile[100];
+	char *text;
+	int fd;
+
+	sprintf(tmpfile, "/tmp/run-06-log.%u.txt", getpid());
+	fd = open(tmpfile, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	log_to_file(fd, lr);
+	close(fd);
+	text = grab_file(ctx, tmpfile);
+	unlink(tmpfile);
+	return text;
+}
+
 int main(void)
 {
 	struct protocol_double_sha dsha;
@@ -57,10 +64,12 @@ int main(void)
 	int fds[2];
 	char *p, *mem1, *mem2, *mem3;
 	int status;
-	size_t maxmem = sizeof(struct log_entry) * 4 + 25 + 25 + 28 + 161;
+	size_t maxmem = 2048;
+	unsigned int i;
 	void *ctx = tal(NULL, char);
-	struct log_record *lr;
+	struct log_record *lr, *loaded;
 	struct log *log;
+	char logfile[100];
 
 	my_time.ts.tv_sec = 1384064855;
 	my_time.ts.tv_nsec = 500;
@@ -128,9 +137,12 @@ int main(void)
 	/* Make sure log record survives freeing of log. */
 	tal_free(log);
 
-	/* This cleans us out! */
+	/* Wrap around a few times: only the newest survive. */
 	log = new_log(ctx, lr, "PREFIX2:");
-	log_debug(log, "Overflow!");
+	for (i = 0; i < 100; i++) {
+		log_debug(log, "Overflow %u", i);
+		log_add(log, "!");
+	}
 
 	/* Make child write log, be sure it's correct. */
 	pipe(fds);
@@ -153,14 +165,63 @@ int main(void)
 
 	assert(tal_strreg(p, p,
 			  "([0-9]*) bytes, Sun Nov 10 06:27:35 2013\n"
-			  "\\.\\.\\. 4 skipped\\.\\.\\.\n"
-			  "\\+0.000000004 PREFIX2:DEBUG: Overflow!\n"
-			  "\\+0.000000004 PREFIX2:DEBUG: Log pruned 4 entries \\(mem ([0-9]*) -> ([0-9]*)\\)\n\n", &mem1, &mem2, &mem3));
-	assert(atoi(mem1) < maxmem);
-	assert(atoi(mem2) >= maxmem);
-	assert(atoi(mem3) < maxmem);
-	tal_free(ctx);
+			  "\\.\\.\\. ([0-9]*) skipped\\.\\.\\.\n"
+			  "\\+0.000000004 PREFIX2:DEBUG: Overflow ([0-9]*)!\n"
+			  "(.*\n)*"
+			  "\\+0.000000004 PREFIX2:DEBUG: Overflow 99!\n\n",
+			  &mem1, &mem2, &mem3, NULL));
+	assert(atoi(mem1) <= maxmem);
+	/* The first four, and the oldest of ours, are gone. */
+	assert(atoi(mem2) == 4 + atoi(mem3));
+	assert(atoi(mem3) > 0);
+	wait(&status);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	/* Move it into a file, and keep logging. */
+	sprintf(logfile, "/tmp/run-06-log.%u", getpid());
+	assert(set_log_file(lr, logfile));
+	log_io(log, true, "\x01\x02", 2);
+	set_log_io(log, 1);
+	log_io(log, true, "\x01\x02", 2);
+	log_info(log, "After mapping %s", "it");
+	/* Again: the first one is kept as .old. */
+	assert(set_log_file(lr, logfile));
+	log_info(log, "After remapping %s", "it");
+
+	/* A child can't scribble on our file once it's private. */
+	fflush(stdout);
+	if (fork() == 0) {
+		log_record_private(lr);
+		log_info(log, "From the child");
+		exit(strstr(log_text(ctx, lr), "From the child")
+		     && !strstr(log_text(ctx, lr), "After remapping") ? 0 : 1);
+	}
 	wait(&status);
 	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	tal_free(log);
+
+	/* Reading it back gives the same thing. */
+	loaded = load_log_record(ctx, logfile);
+	assert(loaded);
+	assert(log_used(loaded) == log_used(lr));
+	p = log_text(ctx, lr);
+	assert(streq(log_text(ctx, loaded), p));
+	assert(strstr(p, "PREFIX2:IO-IN: 0102\n"));
+	assert(strstr(p, "PREFIX2:INFO: After mapping it\n"));
+	assert(strstr(p, "PREFIX2:INFO: After remapping it\n"));
+	assert(!strstr(p, "From the child"));
+
+	p = tal_fmt(ctx, "%s.old", logfile);
+	loaded = load_log_record(ctx, p);
+	assert(loaded);
+	assert(!strstr(log_text(ctx, loaded), "After remapping"));
+	unlink(p);
+
+	/* A truncated file isn't a log. */
+	assert(truncate(logfile, 1000) == 0);
+	assert(!load_log_record(ctx, logfile));
+	unlink(logfile);
+
+	tal_free(ctx);
 	return 0;
 }
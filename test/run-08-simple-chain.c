@@ -8,10 +8,17 @@
 #include "../block_shard.c"
 #include "../tx.c"
 #include "../features.c"
+#include "../utxo.c"
 #include "easy_genesis.c"
 #include "named_blocks.c"
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for addrhash_hashfn */
+size_t addrhash_hashfn(const struct protocol_address *addr)
+{ fprintf(stderr, "addrhash_hashfn called!\n"); abort(); }
+/* Generated stub for addrhash_keyof */
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae)
+{ fprintf(stderr, "addrhash_keyof called!\n"); abort(); }
 /* Generated stub for block_to_pending */
 void block_to_pending(struct state *state, const struct block *block)
 { fprintf(stderr, "block_to_pending called!\n"); abort(); }
@@ -130,9 +137,23 @@ void refresh_peer_cache(struct state *state)
 void todo_forget_about_block(struct state *state,
 			     const struct protocol_block_id *block)
 { fprintf(stderr, "todo_forget_about_block called!\n"); abort(); }
+/* Generated stub for txhash_firstval */
+struct txhash_elem *txhash_firstval(struct txhash *txhash,
+				    const struct protocol_tx_id *sha,
+				    struct txhash_iter *i)
+{ fprintf(stderr, "txhash_firstval called!\n"); abort(); }
+/* Generated stub for txhash_nextval */
+struct txhash_elem *txhash_nextval(struct txhash *txhash,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i)
+{ fprintf(stderr, "txhash_nextval called!\n"); abort(); }
 /* Generated stub for wake_peers */
 void wake_peers(struct state *state)
 { fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 struct pending_block *new_pending_block(struct state *state)
@@ -35,11 +35,6 @@ enum input_ecode check_tx_inputs(struct state *state,
 /* Could not find declaration for helper_gateway_key */
 /* Could not find declaration for helper_gateway_public_key */
 /* Could not find declaration for helper_private_key */
-/* Generated stub for merkle_some_txs */
-void merkle_some_txs(const struct block_shard *shard,
-		     size_t off, size_t max,
-		     struct protocol_double_sha *merkle)
-{ fprintf(stderr, "merkle_some_txs called!\n"); abort(); }
 /* Generated stub for merkle_txs */
 void merkle_txs(const struct block_shard *shard,
 		struct protocol_double_sha *merkle)
@@ -53,9 +48,17 @@ void save_block(struct state *state, struct block *new)
 /* Generated stub for seek_detached_blocks */
 void seek_detached_blocks(struct state *state, const struct block *block)
 { fprintf(stderr, "seek_detached_blocks called!\n"); abort(); }
+/* Generated stub for shard_merkle_node */
+void shard_merkle_node(const struct block_shard *shard,
+		       unsigned int level, size_t idx,
+		       struct protocol_double_sha *merkle)
+{ fprintf(stderr, "shard_merkle_node called!\n"); abort(); }
 /* Generated stub for update_block_ptrs_new_block */
 void update_block_ptrs_new_block(struct state *state, struct block *block)
 { fprintf(stderr, "update_block_ptrs_new_block called!\n"); abort(); }
+/* Generated stub for utxo_add_block */
+void utxo_add_block(struct state *state, const struct block *block)
+{ fprintf(stderr, "utxo_add_block called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 static struct block *mock_block(const tal_t *ctx)
@@ -87,7 +90,7 @@ int main(void)
 	const union protocol_tx *tx1, *tx2;
 	struct txptr_with_ref txp1, txp2;
 	struct protocol_input input[1];
-	struct protocol_txrefhash txrhash, scratch;
+	struct protocol_txrefhash txrhash;
 	const struct protocol_txrefhash *txrhp;
 	struct block *b = mock_block(ctx);
 	unsigned int i;
@@ -172,11 +175,12 @@ int main(void)
 	assert(refs_for(shard->u[1].txp) == refs_for(txp2));
 
 	/* Get txrefhash of hash */
-	txrhp = txrefhash_in_shard(shard, 0, &scratch);
+	txrhp = txrefhash_in_shard(shard, 0);
 	assert(structeq(txrhp, &txrhash));
 
-	/* Get txrefhash of tx (it will hash for us) */
-	txrhp = txrefhash_in_shard(shard, 1, &scratch);
+	/* Get txrefhash of tx (txptr_with_ref hashed it for us) */
+	txrhp = txrefhash_in_shard(shard, 1);
+	assert(txrhp == txrefhash_for(txp2));
 	hash_tx(tx2, &txrhash.txhash);
 	hash_refs(refs, 1, &txrhash.refhash);
 	assert(structeq(txrhp, &txrhash));
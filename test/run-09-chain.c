@@ -7,10 +7,17 @@
 #include "../difficulty.c"
 #include "../block_shard.c"
 #include "../tx.c"
+#include "../utxo.c"
 #include "easy_genesis.c"
 #include "named_blocks.c"
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for addrhash_hashfn */
+size_t addrhash_hashfn(const struct protocol_address *addr)
+{ fprintf(stderr, "addrhash_hashfn called!\n"); abort(); }
+/* Generated stub for addrhash_keyof */
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae)
+{ fprintf(stderr, "addrhash_keyof called!\n"); abort(); }
 /* Generated stub for check_proof */
 bool check_proof(const struct protocol_proof *proof,
 		 const struct block *b,
@@ -117,6 +124,20 @@ void merkle_txs(const struct block_shard *shard,
 /* Generated stub for refresh_peer_cache */
 void refresh_peer_cache(struct state *state)
 { fprintf(stderr, "refresh_peer_cache called!\n"); abort(); }
+/* Generated stub for txhash_firstval */
+struct txhash_elem *txhash_firstval(struct txhash *txhash,
+				    const struct protocol_tx_id *sha,
+				    struct txhash_iter *i)
+{ fprintf(stderr, "txhash_firstval called!\n"); abort(); }
+/* Generated stub for txhash_nextval */
+struct txhash_elem *txhash_nextval(struct txhash *txhash,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i)
+{ fprintf(stderr, "txhash_nextval called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 void block_to_pending(struct state *state, const struct block *block)
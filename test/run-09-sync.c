@@ -0,0 +1,503 @@
+#include "../sync.c"
+#include "../chain.c"
+#include "../state.c"
+#include "../timeout.c"
+#include "../block.c"
+#include "../pseudorand.c"
+#include "../minimal_log.c"
+#include "../difficulty.c"
+#include "../block_shard.c"
+#include "../tx.c"
+#include "../utxo.c"
+#include "../tal_packet.c"
+#include "../shadouble.c"
+#include "../marshal.c"
+#include "../prev_blocks.c"
+#include "easy_genesis.c"
+#include "named_blocks.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for addrhash_hashfn */
+size_t addrhash_hashfn(const struct protocol_address *addr)
+{ fprintf(stderr, "addrhash_hashfn called!\n"); abort(); }
+/* Generated stub for addrhash_keyof */
+const struct protocol_address *addrhash_keyof(const struct addrhash_elem *ae)
+{ fprintf(stderr, "addrhash_keyof called!\n"); abort(); }
+/* Generated stub for check_proof */
+bool check_proof(const struct protocol_proof *proof,
+		 const struct block *b,
+		 const union protocol_tx *tx,
+		 const struct protocol_input_ref *refs)
+{ fprintf(stderr, "check_proof called!\n"); abort(); }
+/* Generated stub for check_tx */
+enum protocol_ecode check_tx(struct state *state, const union protocol_tx *tx,
+			     const struct block *inside_block)
+{ fprintf(stderr, "check_tx called!\n"); abort(); }
+/* Generated stub for check_tx_inputs */
+enum input_ecode check_tx_inputs(struct state *state,
+				 const struct block *block,
+				 const struct txhash_elem *me,
+				 const union protocol_tx *tx,
+				 unsigned int *bad_input_num)
+{ fprintf(stderr, "check_tx_inputs called!\n"); abort(); }
+/* Generated stub for complain_bad_prev_txhashes */
+void complain_bad_prev_txhashes(struct state *state,
+				struct block *block,
+				const struct block *bad_prev,
+				u16 bad_prev_shard)
+{ fprintf(stderr, "complain_bad_prev_txhashes called!\n"); abort(); }
+/* Generated stub for from_hex */
+bool from_hex(const char *str, size_t slen, void *buf, size_t bufsize)
+{ fprintf(stderr, "from_hex called!\n"); abort(); }
+/* Generated stub for hash_tx */
+void hash_tx(const union protocol_tx *tx, struct protocol_tx_id *txid)
+{ fprintf(stderr, "hash_tx called!\n"); abort(); }
+/* Generated stub for hash_tx_and_refs */
+void hash_tx_and_refs(const union protocol_tx *tx,
+		      const struct protocol_input_ref *refs,
+		      struct protocol_txrefhash *txrefhash)
+{ fprintf(stderr, "hash_tx_and_refs called!\n"); abort(); }
+/* Generated stub for have_detached_block */
+bool have_detached_block(const struct state *state,
+			 const struct protocol_block_id *sha)
+{ fprintf(stderr, "have_detached_block called!\n"); abort(); }
+/* Generated stub for inputhash_hashfn */
+size_t inputhash_hashfn(const struct inputhash_key *key)
+{ fprintf(stderr, "inputhash_hashfn called!\n"); abort(); }
+/* Generated stub for inputhash_keyof */
+const struct inputhash_key *inputhash_keyof(const struct inputhash_elem *ie)
+{ fprintf(stderr, "inputhash_keyof called!\n"); abort(); }
+/* Generated stub for json_add_address */
+void json_add_address(struct json_result *result, const char *fieldname,
+		      bool test_net,  const struct protocol_address *addr)
+{ fprintf(stderr, "json_add_address called!\n"); abort(); }
+/* Generated stub for json_add_block_id */
+void json_add_block_id(struct json_result *result, const char *fieldname,
+		       const struct protocol_block_id *id)
+{ fprintf(stderr, "json_add_block_id called!\n"); abort(); }
+/* Generated stub for json_add_double_sha */
+void json_add_double_sha(struct json_result *result, const char *fieldname,
+			 const struct protocol_double_sha *sha)
+{ fprintf(stderr, "json_add_double_sha called!\n"); abort(); }
+/* Generated stub for json_add_hex */
+void json_add_hex(struct json_result *result, const char *fieldname,
+		  const void *data, size_t len)
+{ fprintf(stderr, "json_add_hex called!\n"); abort(); }
+/* Generated stub for json_add_num */
+void json_add_num(struct json_result *result, const char *fieldname,
+		  unsigned int value)
+{ fprintf(stderr, "json_add_num called!\n"); abort(); }
+/* Generated stub for json_add_tx_id */
+void json_add_tx_id(struct json_result *result, const char *fieldname,
+		    const struct protocol_tx_id *id)
+{ fprintf(stderr, "json_add_tx_id called!\n"); abort(); }
+/* Generated stub for json_array_end */
+void json_array_end(struct json_result *ptr)
+{ fprintf(stderr, "json_array_end called!\n"); abort(); }
+/* Generated stub for json_array_start */
+void json_array_start(struct json_result *ptr, const char *fieldname)
+{ fprintf(stderr, "json_array_start called!\n"); abort(); }
+/* Generated stub for json_get_params */
+void json_get_params(const char *buffer, const jsmntok_t param[], ...)
+{ fprintf(stderr, "json_get_params called!\n"); abort(); }
+/* Generated stub for json_object_end */
+void json_object_end(struct json_result *ptr)
+{ fprintf(stderr, "json_object_end called!\n"); abort(); }
+/* Generated stub for json_object_start */
+void json_object_start(struct json_result *ptr, const char *fieldname)
+{ fprintf(stderr, "json_object_start called!\n"); abort(); }
+/* Generated stub for json_tok_contents */
+const char *json_tok_contents(const char *buffer, const jsmntok_t *t)
+{ fprintf(stderr, "json_tok_contents called!\n"); abort(); }
+/* Generated stub for json_tok_len */
+int json_tok_len(const jsmntok_t *t)
+{ fprintf(stderr, "json_tok_len called!\n"); abort(); }
+/* Generated stub for json_tok_number */
+bool json_tok_number(const char *buffer, const jsmntok_t *tok,
+		     unsigned int *num)
+{ fprintf(stderr, "json_tok_number called!\n"); abort(); }
+/* Generated stub for log_to_file */
+void log_to_file(int fd, const struct log_record *lr)
+{ fprintf(stderr, "log_to_file called!\n"); abort(); }
+/* Generated stub for logv */
+void logv(struct log *log, enum log_level level, const char *fmt, va_list ap)
+{ fprintf(stderr, "logv called!\n"); abort(); }
+/* Generated stub for merkle_txs */
+void merkle_txs(const struct block_shard *shard,
+		struct protocol_double_sha *merkle)
+{ fprintf(stderr, "merkle_txs called!\n"); abort(); }
+/* Generated stub for refresh_peer_cache */
+void refresh_peer_cache(struct state *state)
+{ fprintf(stderr, "refresh_peer_cache called!\n"); abort(); }
+/* Generated stub for todo_add_get_block */
+void todo_add_get_block(struct state *state,
+			const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_block called!\n"); abort(); }
+/* Generated stub for todo_add_get_children */
+void todo_add_get_children(struct state *state,
+			   const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_children called!\n"); abort(); }
+/* Generated stub for todo_done_get_children */
+void todo_done_get_children(struct peer *peer,
+			    const struct protocol_block_id *block,
+			    bool success)
+{ fprintf(stderr, "todo_done_get_children called!\n"); abort(); }
+/* Generated stub for txhash_firstval */
+struct txhash_elem *txhash_firstval(struct txhash *txhash,
+				    const struct protocol_tx_id *sha,
+				    struct txhash_iter *i)
+{ fprintf(stderr, "txhash_firstval called!\n"); abort(); }
+/* Generated stub for txhash_nextval */
+struct txhash_elem *txhash_nextval(struct txhash *txhash,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i)
+{ fprintf(stderr, "txhash_nextval called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+void block_to_pending(struct state *state, const struct block *block)
+{
+}
+
+void check_block(struct state *state, const struct block *block, bool all)
+{
+}
+
+bool check_prev_txhashes(struct state *state, const struct block *block,
+			 const struct block **bad_prev,
+			 u16 *bad_shard)
+{
+	return true;
+}
+
+void restart_generating(struct state *state)
+{
+}
+
+void todo_forget_about_block(struct state *state,
+			     const struct protocol_block_id *block)
+{
+}
+
+void wake_peers(struct state *state)
+{
+}
+
+void save_block(struct state *state, struct block *new)
+{
+}
+
+struct pending_block *new_pending_block(struct state *state)
+{
+	return talz(state, struct pending_block);
+}
+
+u8 pending_features(const struct block *block)
+{
+	return 0;
+}
+
+void todo_add_get_shard(struct state *state,
+			const struct protocol_block_id *block,
+			u16 shardnum)
+{
+}
+
+void seek_detached_blocks(struct state *state, 
+			  const struct block *block)
+{
+}
+
+/* The last one we were asked to send. */
+static void *sent;
+void todo_for_peer(struct peer *peer, void *pkt)
+{
+	tal_free(sent);
+	sent = tal_steal(NULL, pkt);
+}
+
+/* They're all ones we have: find which. */
+static unsigned int num_header_blocks;
+enum protocol_ecode recv_header_block(struct peer *peer,
+				      const tal_t *pkt_ctx,
+				      const struct protocol_block_header *hdr,
+				      size_t len,
+				      struct block **block)
+{
+	u32 height = le32_to_cpu(hdr->height);
+	struct block *b;
+
+	assert(len == marshal_block_len(hdr));
+	num_header_blocks++;
+	list_for_each(peer->state->block_height[height], b, list) {
+		if (memcmp(b->bi.hdr, hdr, sizeof(*hdr)) == 0) {
+			*block = b;
+			return PROTOCOL_ECODE_NONE;
+		}
+	}
+	abort();
+}
+
+static struct block *named(const char *name)
+{
+	return strmap_get(&blockmap, name);
+}
+
+/* Returns the descendents hash they'd give for child. */
+static struct protocol_double_sha get_children(struct peer *peer,
+					       const char *parent,
+					       const char *child)
+{
+	struct protocol_pkt_get_children *pkt;
+	const struct protocol_pkt_children *r;
+	const struct protocol_net_childblock *cb;
+	void *reply;
+	size_t i, num;
+
+	pkt = tal_packet(peer, struct protocol_pkt_get_children,
+			 PROTOCOL_PKT_GET_CHILDREN);
+	pkt->block = named(parent)->sha;
+	assert(recv_get_children(peer, pkt, &reply) == PROTOCOL_ECODE_NONE);
+
+	r = reply;
+	assert(le32_to_cpu(r->err) == PROTOCOL_ECODE_NONE);
+	cb = (const void *)(r + 1);
+	num = (le32_to_cpu(r->len) - sizeof(*r)) / sizeof(*cb);
+	for (i = 0; i < num; i++)
+		if (structeq(&cb[i].block, &named(child)->sha))
+			return cb[i].descendents;
+	abort();
+}
+
+/* What they'd be without any caching. */
+static struct protocol_double_sha uncached(struct block *b)
+{
+	struct protocol_double_sha sha, cached = b->descendents;
+	bool was_valid = b->descendents_valid;
+	struct block *i;
+
+	list_for_each(&b->children, i, sibling)
+		uncached(i);
+	b->descendents_valid = false;
+	hash_children(b, &sha);
+	b->descendents_valid = was_valid;
+	if (was_valid)
+		assert(structeq(&cached, &sha));
+	b->descendents = cached;
+	return sha;
+}
+
+/* Ask with this locator, get back headers (checking they follow on). */
+static const struct protocol_pkt_headers *
+get_headers(struct peer *peer,
+	    const struct protocol_pkt_get_headers *pkt,
+	    const struct block *after, u32 expect)
+{
+	const struct protocol_pkt_headers *r;
+	const char *p;
+	void *reply;
+	u32 i;
+
+	assert(recv_get_headers(peer, pkt, &reply) == PROTOCOL_ECODE_NONE);
+	r = reply;
+	assert(le32_to_cpu(r->type) == PROTOCOL_PKT_HEADERS);
+	assert(le32_to_cpu(r->num) == expect);
+	assert(le32_to_cpu(r->len) <= PROTOCOL_MAX_PACKET_LEN);
+
+	p = (const char *)(r + 1);
+	for (i = 0; i < expect; i++) {
+		const struct protocol_block_header *hdr;
+		le32 blen;
+
+		memcpy(&blen, p, sizeof(blen));
+		hdr = (const void *)(p + sizeof(blen));
+		assert(le32_to_cpu(blen) == marshal_block_len(hdr));
+		assert(structeq(&hdr->prevs[0], &after->sha));
+		after = next_on_chain(after, peer->state->longest_chains[0]);
+		assert(le32_to_cpu(hdr->height) == block_height(&after->bi));
+		p += sizeof(blen) + le32_to_cpu(blen);
+	}
+	assert(p == (const char *)r + le32_to_cpu(r->len));
+	return r;
+}
+
+static enum protocol_ecode bad_headers(struct peer *peer, u32 num,
+				       const void *data, size_t len)
+{
+	struct protocol_pkt_headers *pkt;
+
+	pkt = tal_packet(peer, struct protocol_pkt_headers,
+			 PROTOCOL_PKT_HEADERS);
+	pkt->num = cpu_to_le32(num);
+	tal_packet_append(&pkt, data, len);
+	return recv_headers(peer, pkt);
+}
+
+static bool sha_eq(struct protocol_double_sha a,
+		   struct protocol_double_sha b)
+{
+	return structeq(&a, &b);
+}
+
+int main(void)
+{
+	struct state *state;
+	struct peer *peer;
+	struct protocol_address dummy = { { 0 } };
+	struct protocol_double_sha b0, b1, zero;
+	struct protocol_pkt_get_headers *gpkt;
+	const struct protocol_pkt_headers *r;
+	void *reply;
+	le32 blen;
+	char buf[sizeof(blen) + 10];
+	char *name;
+
+	pseudorand_init();
+	state = new_state(true);
+	peer = talz(state, struct peer);
+	peer->state = state;
+	peer->log = state->log;
+	memset(&zero, 0, sizeof(zero));
+
+	/* genesis -> a-0 ... a-4, and a-1 -> b-0 -> b-1. */
+	create_chain(state, &genesis, "a", &dummy,
+		     PROTOCOL_INITIAL_SHARD_ORDER, 5, true);
+	create_chain(state, named("a-1"), "b", &dummy,
+		     PROTOCOL_INITIAL_SHARD_ORDER, 2, true);
+	assert(state->preferred_chain == named("a-4"));
+
+	/* Main chain isn't hashed; the fork is, and gets cached. */
+	assert(sha_eq(get_children(peer, "a-1", "a-2"), zero));
+	b0 = get_children(peer, "a-1", "b-0");
+	assert(named("b-0")->descendents_valid);
+	assert(named("b-1")->descendents_valid);
+	b1 = get_children(peer, "b-0", "b-1");
+	assert(sha_eq(b0, uncached(named("b-0"))));
+	assert(sha_eq(b1, uncached(named("b-1"))));
+
+	/* Asking again gives the same answer. */
+	assert(sha_eq(get_children(peer, "a-1", "b-0"), b0));
+
+	/* A grandchild of b-0 clears b-1 and b-0 (a-1 never had one). */
+	add_next_block(state, named("b-1"), "b-2", 0,
+		       PROTOCOL_INITIAL_SHARD_ORDER, &dummy);
+	assert(!named("b-1")->descendents_valid);
+	assert(!named("b-0")->descendents_valid);
+	assert(!named("a-1")->descendents_valid);
+	assert(state->preferred_chain == named("a-4"));
+
+	/* So the answers change, all the way up. */
+	assert(!sha_eq(get_children(peer, "b-0", "b-1"), b1));
+	assert(!sha_eq(get_children(peer, "a-1", "b-0"), b0));
+	b0 = get_children(peer, "a-1", "b-0");
+	b1 = get_children(peer, "b-0", "b-1");
+	assert(sha_eq(b0, uncached(named("b-0"))));
+	assert(sha_eq(b1, uncached(named("b-1"))));
+
+	/* A sibling (not a descendent) of b-1 changes b-0's, not b-1's. */
+	add_next_block(state, named("b-0"), "c-1", 0,
+		       PROTOCOL_INITIAL_SHARD_ORDER, &dummy);
+	assert(named("b-1")->descendents_valid);
+	assert(!named("b-0")->descendents_valid);
+	assert(sha_eq(get_children(peer, "b-0", "b-1"), b1));
+	assert(!sha_eq(get_children(peer, "a-1", "b-0"), b0));
+	assert(sha_eq(get_children(peer, "a-1", "b-0"),
+		      uncached(named("b-0"))));
+
+	/* Headers: a-4 is their best, and a-1 is where b forks. */
+	assert(state->longest_chains[0] == named("a-4"));
+	assert(on_chain(state, named("a-0"), named("a-4")));
+	assert(on_chain(state, named("a-1"), named("a-4")));
+	assert(!on_chain(state, named("b-0"), named("a-4")));
+	assert(!on_chain(state, named("a-4"), named("b-2")));
+	assert(next_on_chain(named("a-1"), named("a-4")) == named("a-2"));
+	assert(next_on_chain(named("a-1"), named("b-2")) == named("b-0"));
+	assert(next_on_chain(named("b-0"), named("b-2")) == named("b-1"));
+
+	/* From b-2, the locator is b-2, b-1, a-1: a-1 is the first on
+	 * their chain, so they send a-2 onwards. */
+	gpkt = get_headers_pkt(peer, named("b-2"));
+	assert(structeq(&gpkt->locator[2], &named("a-1")->sha));
+	r = get_headers(peer, gpkt, named("a-1"), 3);
+
+	/* We take them, and ask for more after the last... */
+	peer->headers_syncing = true;
+	assert(recv_headers(peer, r) == PROTOCOL_ECODE_NONE);
+	assert(num_header_blocks == 3);
+	gpkt = sent;
+	assert(le32_to_cpu(gpkt->type) == PROTOCOL_PKT_GET_HEADERS);
+	assert(structeq(&gpkt->locator[0], &named("a-4")->sha));
+	assert(structeq(&gpkt->locator[1], &named("a-3")->sha));
+
+	/* ... which is their best, so there are none, and we're done. */
+	r = get_headers(peer, gpkt, named("a-4"), 0);
+	assert(recv_headers(peer, r) == PROTOCOL_ECODE_NONE);
+	assert(!peer->headers_syncing);
+
+	/* Unknown entries are skipped. */
+	gpkt = get_headers_pkt(peer, named("a-2"));
+	memset(&gpkt->locator[0], 0xFF, sizeof(gpkt->locator[0]));
+	get_headers(peer, gpkt, named("a-1"), 3);
+
+	/* If we know none of them, start from genesis. */
+	memset(gpkt->locator, 0xFF, sizeof(gpkt->locator));
+	get_headers(peer, gpkt, &genesis, 5);
+
+	/* Malformed. */
+	gpkt->len = cpu_to_le32(sizeof(*gpkt) - 1);
+	assert(recv_get_headers(peer, gpkt, &reply)
+	       == PROTOCOL_ECODE_INVALID_LEN);
+	gpkt->len = cpu_to_le32(sizeof(*gpkt) + 1);
+	assert(recv_get_headers(peer, gpkt, &reply)
+	       == PROTOCOL_ECODE_INVALID_LEN);
+
+	num_header_blocks = 0;
+	blen = cpu_to_le32(1000);
+	/* Too short for num. */
+	r = tal_packet(peer, struct protocol_pkt_headers, PROTOCOL_PKT_HEADERS);
+	((struct protocol_pkt_headers *)r)->len = cpu_to_le32(sizeof(*r) - 1);
+	assert(recv_headers(peer, r) == PROTOCOL_ECODE_INVALID_LEN);
+	/* More than there are. */
+	assert(bad_headers(peer, 1, NULL, 0) == PROTOCOL_ECODE_INVALID_LEN);
+	assert(bad_headers(peer, 0xFFFFFFFF, NULL, 0)
+	       == PROTOCOL_ECODE_INVALID_LEN);
+	/* Not enough for the block length. */
+	assert(bad_headers(peer, 1, &blen, 2) == PROTOCOL_ECODE_INVALID_LEN);
+	/* Block shorter than it says. */
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, &blen, sizeof(blen));
+	assert(bad_headers(peer, 1, buf, sizeof(buf))
+	       == PROTOCOL_ECODE_INVALID_LEN);
+	/* Extra on the end. */
+	assert(bad_headers(peer, 0, &blen, sizeof(blen))
+	       == PROTOCOL_ECODE_INVALID_LEN);
+	assert(num_header_blocks == 0);
+
+	/* No more than PROTOCOL_MAX_HEADERS at a time... */
+	create_chain(state, named("a-4"), "d", &dummy,
+		     PROTOCOL_INITIAL_SHARD_ORDER,
+		     PROTOCOL_MAX_HEADERS + 10, true);
+	gpkt = get_headers_pkt(peer, named("a-4"));
+	get_headers(peer, gpkt, named("a-4"), PROTOCOL_MAX_HEADERS);
+
+	/* ... and no more than fits in a packet: these are over 2MB. */
+	name = tal_fmt(state, "d-%u", PROTOCOL_MAX_HEADERS + 9);
+	create_chain(state, named(name), "big", &dummy,
+		     PROTOCOL_MAX_SHARD_ORDER, 3, true);
+	assert(marshal_block_len(named("big-0")->bi.hdr)
+	       > PROTOCOL_MAX_PACKET_LEN / 2);
+	gpkt = get_headers_pkt(peer, named(name));
+	get_headers(peer, gpkt, named(name), 1);
+	gpkt = get_headers_pkt(peer, named("big-1"));
+	get_headers(peer, gpkt, named("big-1"), 1);
+	gpkt = get_headers_pkt(peer, named("big-2"));
+	get_headers(peer, gpkt, named("big-2"), 0);
+
+	tal_free(sent);
+	strmap_clear(&blockmap);
+	tal_free(state);
+	return 0;
+}
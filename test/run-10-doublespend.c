@@ -17,11 +17,13 @@ static struct timeabs fake_time_now(void)
 #include "../chain.c"
 #include "../state.c"
 #include "../timeout.c"
+#include "../loop.c"
 #include "../block.c"
 #include "../pseudorand.c"
 #include "../base58.c"
 #include "../log.c"
 #include "../log_helper.c"
+#include "../hex.c"
 #include "../pkt_names.c"
 #include "../difficulty.c"
 #include "../block_shard.c"
@@ -52,6 +54,12 @@ static struct timeabs fake_time_now(void)
 #include "../gateways.c"
 #include "../tx.c"
 #include "../horizon.c"
+#include "../utxo.c"
+#include "../addrhash.c"
+#include "../json.c"
+#include "../json_add_tx.c"
+#include "../listtransactions.c"
+#include "../tx_cmp.c"
 #include "easy_genesis.c"
 #include "helper_key.h"
 #include "helper_gateway_key.h"
@@ -145,66 +153,14 @@ void complain_misorder(struct state *state,
 void create_proof(struct protocol_proof *proof,
 		  const struct block *block, u16 shard, u8 txoff)
 { fprintf(stderr, "create_proof called!\n"); abort(); }
-/* Generated stub for from_hex */
-bool from_hex(const char *str, size_t slen, void *buf, size_t bufsize)
-{ fprintf(stderr, "from_hex called!\n"); abort(); }
 /* Generated stub for have_detached_block */
-bool have_detached_block(const struct state *state, 
+bool have_detached_block(const struct state *state,
 			 const struct protocol_block_id *sha)
 { fprintf(stderr, "have_detached_block called!\n"); abort(); }
 /* Could not find declaration for helper_addr */
 /* Could not find declaration for helper_gateway_key */
 /* Could not find declaration for helper_gateway_public_key */
 /* Could not find declaration for helper_private_key */
-/* Generated stub for json_add_address */
-void json_add_address(struct json_result *result, const char *fieldname,
-		      bool test_net,  const struct protocol_address *addr)
-{ fprintf(stderr, "json_add_address called!\n"); abort(); }
-/* Generated stub for json_add_block_id */
-void json_add_block_id(struct json_result *result, const char *fieldname,
-		       const struct protocol_block_id *id)
-{ fprintf(stderr, "json_add_block_id called!\n"); abort(); }
-/* Generated stub for json_add_double_sha */
-void json_add_double_sha(struct json_result *result, const char *fieldname,
-			 const struct protocol_double_sha *sha)
-{ fprintf(stderr, "json_add_double_sha called!\n"); abort(); }
-/* Generated stub for json_add_hex */
-void json_add_hex(struct json_result *result, const char *fieldname,
-		  const void *data, size_t len)
-{ fprintf(stderr, "json_add_hex called!\n"); abort(); }
-/* Generated stub for json_add_num */
-void json_add_num(struct json_result *result, const char *fieldname,
-		  unsigned int value)
-{ fprintf(stderr, "json_add_num called!\n"); abort(); }
-/* Generated stub for json_add_tx_id */
-void json_add_tx_id(struct json_result *result, const char *fieldname,
-		    const struct protocol_tx_id *id)
-{ fprintf(stderr, "json_add_tx_id called!\n"); abort(); }
-/* Generated stub for json_array_end */
-void json_array_end(struct json_result *ptr)
-{ fprintf(stderr, "json_array_end called!\n"); abort(); }
-/* Generated stub for json_array_start */
-void json_array_start(struct json_result *ptr, const char *fieldname)
-{ fprintf(stderr, "json_array_start called!\n"); abort(); }
-/* Generated stub for json_get_params */
-void json_get_params(const char *buffer, const jsmntok_t param[], ...)
-{ fprintf(stderr, "json_get_params called!\n"); abort(); }
-/* Generated stub for json_object_end */
-void json_object_end(struct json_result *ptr)
-{ fprintf(stderr, "json_object_end called!\n"); abort(); }
-/* Generated stub for json_object_start */
-void json_object_start(struct json_result *ptr, const char *fieldname)
-{ fprintf(stderr, "json_object_start called!\n"); abort(); }
-/* Generated stub for json_tok_contents */
-const char *json_tok_contents(const char *buffer, const jsmntok_t *t)
-{ fprintf(stderr, "json_tok_contents called!\n"); abort(); }
-/* Generated stub for json_tok_len */
-int json_tok_len(const jsmntok_t *t)
-{ fprintf(stderr, "json_tok_len called!\n"); abort(); }
-/* Generated stub for json_tok_number */
-bool json_tok_number(const char *buffer, const jsmntok_t *tok,
-		     unsigned int *num)
-{ fprintf(stderr, "json_tok_number called!\n"); abort(); }
 /* Generated stub for refresh_peer_cache */
 void refresh_peer_cache(struct state *state)
 { fprintf(stderr, "refresh_peer_cache called!\n"); abort(); }
@@ -261,19 +217,13 @@ void todo_forget_about_block(struct state *state,
 /* Generated stub for todo_for_peer */
 void todo_for_peer(struct peer *peer, void *pkt)
 { fprintf(stderr, "todo_for_peer called!\n"); abort(); }
-/* Generated stub for to_hex */
-char *to_hex(const tal_t *ctx, const void *buf, size_t bufsize)
-{ fprintf(stderr, "to_hex called!\n"); abort(); }
-/* Generated stub for to_hex_direct */
-size_t to_hex_direct(char *dest, size_t destlen,
-		     const void *buf, size_t bufsize)
-{ fprintf(stderr, "to_hex_direct called!\n"); abort(); }
-/* Generated stub for tx_cmp */
-int tx_cmp(const union protocol_tx *a, const union protocol_tx *b)
-{ fprintf(stderr, "tx_cmp called!\n"); abort(); }
 /* Generated stub for wake_peers */
 void wake_peers(struct state *state)
 { fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* Generated stub for watch_tx_ */
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{ fprintf(stderr, "watch_tx_ called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
 
 int generate_main(int argc, char *argv[]);
@@ -345,12 +295,27 @@ static const struct block *solve_pending(struct state *state)
 	if (!recv_block_from_generator(state, state->log, block_pkt, shard_pkt))
 		abort();
 
+	/* Re-adding pending happens from the loop: run it now. */
+	while (!list_empty(&state->work))
+		do_work(state);
+
 	/* Get block we just created. */
 	assert(state->longest_chains[0] == state->preferred_chain);
 	assert(state->longest_knowns[0] == state->preferred_chain);
 	return state->preferred_chain;
 }
 
+/* The only tx in b. */
+static const union protocol_tx *block_tx(const struct block *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < block_num_shards(&b->bi); i++)
+		if (block_num_txs(&b->bi, i))
+			return tx_for(b->shard[i], 0);
+	abort();
+}
+
 static u32 num_txs(const struct block *b)
 {
 	unsigned int i;
@@ -381,22 +346,91 @@ static void dump_inputhash(struct state *state, struct inputhash *inputhash)
 	log_unusual(state->log, "Input hash end\n");
 }
 
+static unsigned int num_addr_txs(struct state *state,
+				 const struct protocol_address *addr,
+				 enum tx_status status)
+{
+	struct addrhash_elem *ae;
+	struct addrhash_iter it;
+	unsigned int n = 0;
+
+	for (ae = addrhash_firstval(&state->addrhash, addr, &it);
+	     ae;
+	     ae = addrhash_nextval(&state->addrhash, addr, &it))
+		n += (ae->te->status == status);
+	return n;
+}
+
+/* The walk pastes in each tx's JSON, so its whitespace differs. */
+static const char *squash(const tal_t *ctx, const char *str)
+{
+	char *out = tal_arr(ctx, char, strlen(str) + 1), *p = out;
+
+	for (; *str; str++)
+		if (!cisspace(*str))
+			*(p++) = *str;
+	*p = '\0';
+	return out;
+}
+
+static const char *listtransactions(struct state *state,
+				    const struct protocol_address *addr,
+				    unsigned int minconf, bool indexed)
+{
+	struct json_connection *jcon = talz(state, struct json_connection);
+	struct json_result *response = new_json_result(jcon);
+	const jsmntok_t *toks;
+	bool valid;
+
+	jcon->state = state;
+	jcon->buffer = tal_fmt(jcon, "[ \"%s\", %u ]",
+			       pettycoin_to_base58(jcon, state->test_net,
+						   addr, false),
+			       minconf);
+	toks = json_parse_input(jcon->buffer, strlen(jcon->buffer), &valid);
+	assert(toks && valid);
+
+	state->index_addresses = indexed;
+	assert(!json_list_transactions(jcon, toks, response));
+	state->index_addresses = true;
+	return squash(state, json_result_string(response));
+}
+
+/* The address index gives the same answer as walking the chain. */
+static void check_listtransactions(struct state *state,
+				   const struct protocol_address *addr,
+				   unsigned int expect_confirmed,
+				   unsigned int expect_total)
+{
+	const char *confirmed, *all;
+
+	confirmed = listtransactions(state, addr, 1, true);
+	assert(streq(confirmed, listtransactions(state, addr, 1, false)));
+	assert(strcount(confirmed, "\"txid\"") == expect_confirmed);
+
+	all = listtransactions(state, addr, 0, true);
+	assert(streq(all, listtransactions(state, addr, 0, false)));
+	assert(strcount(all, "\"txid\"") == expect_total);
+}
+
 int main(void)
 {
 	struct state *state;
-	union protocol_tx *t, *t2;
+	union protocol_tx *t, *t2, *t3;
 	struct protocol_gateway_payment payment;
 	u8 *prev_txhashes;
 	enum input_ecode e;
-	struct protocol_tx_id txid;
-	unsigned int bad_input;
+	struct protocol_tx_id txid, t2id;
+	unsigned int bad_input, shard, i;
 	bool too_old, already_known;
 	const struct block *b;
 	struct protocol_block_id prevs[PROTOCOL_NUM_PREV_IDS];
 	struct protocol_input inputs[1];
+	struct txhash_elem *te;
 	
 	pseudorand_init();
 	state = new_state(true);
+	state->index_addresses = true;
 
 	prev_txhashes = make_prev_txhashes(state, &genesis, helper_addr(1));
 	memset(prevs, 0, sizeof(prevs));
@@ -424,7 +458,19 @@ int main(void)
 	assert(state->pending->num_unknown == 0);
 	assert(num_pending_known(state) == 1);
 
+	/* And another, so listtransactions has two from one block. */
+	payment.send_amount = cpu_to_le32(2000);
+	t3 = create_from_gateway_tx(state, helper_gateway_public_key(),
+				    1, &payment, false,
+				    helper_gateway_key(state));
+	hash_tx(t3, &txid);
+	e = add_pending_tx(state, t3, &txid, &bad_input,
+			   &too_old, &already_known);
+	assert(e == ECODE_INPUT_OK);
+	assert(num_pending_known(state) == 2);
+
 	b = solve_pending(state);
+	assert(num_txs(b) == 2);
 
 	/* Now we can spend it. */
 	prev_txhashes = make_prev_txhashes(state, b, helper_addr(1));
@@ -440,11 +486,22 @@ int main(void)
 	inputs[0].output = 0;
 	inputs[0].unused = 0;
 
+	/* Preferred chain knows nothing spent it yet. */
+	assert(state->utxo.tip == b);
+	assert(utxo_find_spend(&state->utxo, b, NULL, &inputs[0], &te));
+	assert(!te);
+
+	/* Gateway txs paid addr 0. */
+	assert(num_addr_txs(state, helper_addr(0), TX_IN_BLOCK) == 2);
+	assert(num_addr_txs(state, helper_addr(0), TX_PENDING) == 0);
+	assert(num_addr_txs(state, helper_addr(1), TX_IN_BLOCK) == 0);
+
 	t2 = t = create_normal_tx(state, helper_addr(1),
 				  500, 500 - PROTOCOL_FEE(500), 1, true, inputs,
 				  helper_private_key(state, 0));
 	
 	hash_tx(t, &txid);
+	t2id = txid;
 	e = add_pending_tx(state, t, &txid, &bad_input,
 			   &too_old, &already_known);
 	assert(e == ECODE_INPUT_OK);
@@ -452,9 +509,56 @@ int main(void)
 	assert(state->pending->num_unknown == 0);
 	assert(num_pending_known(state) == 1);
 
+	/* Input and change are both addr 0, but it's only indexed once. */
+	assert(num_addr_txs(state, helper_addr(0), TX_PENDING) == 1);
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 1);
+	check_listtransactions(state, helper_addr(0), 2, 3);
+	check_listtransactions(state, helper_addr(1), 0, 1);
+
 	log_unusual(state->log, "Normal tx is ");
 	log_add_struct(state->log, struct protocol_tx_id, &txid);
 
+	/* A recheck after the tip moves leaves it in the hashes... */
+	state->pending->tip = NULL;
+	state->pending->needs_recheck = true;
+	recheck_pending_txs(state);
+	assert(num_pending_known(state) == 0);
+	assert(tal_count(state->pending->recheck) == 1);
+	assert(txhash_get_pending_tx(state, &txid));
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 1);
+	check_listtransactions(state, helper_addr(0), 2, 3);
+	check_listtransactions(state, helper_addr(1), 0, 1);
+
+	/* ... so we know it, and won't take a doublespend meanwhile. */
+	e = add_pending_tx(state, t, &txid, &bad_input,
+			   &too_old, &already_known);
+	assert(e == ECODE_INPUT_OK);
+	assert(already_known);
+
+	t = create_normal_tx(state, helper_addr(2),
+			     300, 700 - PROTOCOL_FEE(300), 1, true, inputs,
+			     helper_private_key(state, 0));
+	hash_tx(t, &txid);
+	e = add_pending_tx(state, t, &txid, &bad_input,
+			   &too_old, &already_known);
+	assert(e == ECODE_INPUT_DOUBLESPEND);
+	assert(tal_count(state->pending->recheck) == 1);
+
+	/* The generator restarts, and gets it back with new refs. */
+	w = new_working_block(state, block_difficulty(&b->bi),
+			      prev_txhashes, tal_count(prev_txhashes),
+			      block_height(&b->bi) + 1,
+			      next_shard_order(b),
+			      prevs, helper_addr(1));
+	while (!list_empty(&state->work))
+		do_work(state);
+	assert(!state->pending->recheck);
+	assert(state->pending->tip == b);
+	assert(num_pending_known(state) == 1);
+	assert(memcmp(state->pending->pend[0][0]->tx, t2, tx_len(t2)) == 0);
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 1);
+	assert(num_addr_txs(state, helper_addr(2), TX_PENDING) == 0);
+
 	/* Should recognize double spend */
 	t = create_normal_tx(state, helper_addr(2),
 			     300, 700 - PROTOCOL_FEE(300), 1, true, inputs,
@@ -473,10 +577,39 @@ int main(void)
 	/* The first should be included. */
 	assert(num_txs(b) == 1);
 
+	/* ... and preferred chain knows it spent the gateway output. */
+	assert(state->utxo.tip == b);
+	assert(utxo_find_spend(&state->utxo, b, NULL, &inputs[0], &te));
+	assert(te);
+	assert(memcmp(txhash_tx(te), t2, tx_len(t2)) == 0);
+
+	/* Address index followed it from pending into the block. */
+	assert(num_addr_txs(state, helper_addr(0), TX_IN_BLOCK) == 3);
+	assert(num_addr_txs(state, helper_addr(0), TX_PENDING) == 0);
+	assert(num_addr_txs(state, helper_addr(1), TX_IN_BLOCK) == 1);
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 0);
+	assert(num_addr_txs(state, helper_addr(2), TX_PENDING) == 0);
+	check_listtransactions(state, helper_addr(0), 2, 2);
+	check_listtransactions(state, helper_addr(1), 1, 1);
+
 	/* There should be nothing left. */ 
 	assert(state->pending->num_unknown == 0);
 	assert(num_pending_known(state) == 0);
 
+	/* A reorg whose new chain still has it: we drop our copy, not b's. */
+	block_to_pending(state, b);
+	assert(state->pending->num_unknown == 1);
+	assert(txhash_get_pending_tx(state, &t2id) != block_tx(b));
+	recheck_pending_txs(state);
+	while (!list_empty(&state->work))
+		do_work(state);
+	assert(state->pending->num_unknown == 0);
+	assert(num_pending_known(state) == 0);
+	assert(!txhash_get_pending_tx(state, &t2id));
+	assert(memcmp(block_tx(b), t2, tx_len(t2)) == 0);
+	assert(num_addr_txs(state, helper_addr(1), TX_IN_BLOCK) == 1);
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 0);
+
 	/* Now retry double spend. */
 	t = create_normal_tx(state, helper_addr(2),
 			     300, 700 - PROTOCOL_FEE(300), 1, true, inputs,
@@ -489,6 +622,31 @@ int main(void)
 	assert(!too_old);
 	assert(!already_known);
 
+	/* A complaint about b salvages its tx, as complaint_on_all() does. */
+	w = new_working_block(state, block_difficulty(&b->bi),
+			      prev_txhashes, tal_count(prev_txhashes),
+			      block_height(&b->bi) + 1,
+			      next_shard_order(b),
+			      prevs, helper_addr(1));
+	block_to_pending(state, b);
+	for (shard = 0; shard < block_num_shards(&b->bi); shard++)
+		for (i = 0; i < block_num_txs(&b->bi, shard); i++)
+			remove_tx_from_hashes(state, (struct block *)b,
+					      shard, i);
+	recheck_pending_txs(state);
+	while (!list_empty(&state->work))
+		do_work(state);
+	assert(num_pending_known(state) == 1);
+	assert(txhash_get_pending_tx(state, &t2id));
+	assert(num_addr_txs(state, helper_addr(1), TX_PENDING) == 1);
+
+	/* So someone sending it again is told we know it. */
+	e = add_pending_tx(state, t2, &t2id, &bad_input,
+			   &too_old, &already_known);
+	assert(e == ECODE_INPUT_OK);
+	assert(already_known);
+	assert(num_pending_known(state) == 1);
+
 	/* Clear inputhash manually. */
 	inputhash_del_tx(&state->inputhash, t2);
 
@@ -0,0 +1,397 @@
+#include <ccan/time/time.h>
+
+/* Override time_now in timestamp.h: make sure it always progresses. */
+static time_t fake_time;
+static struct timeabs fake_time_now(void)
+{
+	struct timeabs now;
+
+	now.ts.tv_sec = fake_time++;
+	now.ts.tv_nsec = 0;
+
+	return now;
+}
+#undef time_now
+#define time_now fake_time_now
+
+#include "../chain.c"
+#include "../state.c"
+#include "../timeout.c"
+#include "../loop.c"
+#include "../block.c"
+#include "../pseudorand.c"
+#include "../base58.c"
+#include "../log.c"
+#include "../log_helper.c"
+#include "../hex.c"
+#include "../pkt_names.c"
+#include "../difficulty.c"
+#include "../block_shard.c"
+#include "../pending.c"
+#include "../prev_txhashes.c"
+#include "../prev_blocks.c"
+#include "../check_block.c"
+#include "../create_tx.c"
+#include "../marshal.c"
+#include "../inputhash.c"
+#include "../tx_in_hashes.c"
+#include "../shadouble.c"
+#include "../merkle_hashes.c"
+#include "../merkle_recurse.c"
+#include "../merkle_txs.c"
+#include "../signature.c"
+#include "../hash_tx.c"
+#include "../txhash.c"
+#include "../check_tx.c"
+#include "../shard.c"
+#include "../create_refs.c"
+#include "../tal_packet.c"
+#include "../recv_block.c"
+#include "../ecode_names.c"
+#include "../hash_block.c"
+#include "../timestamp.c"
+#include "../features.c"
+#include "../gateways.c"
+#include "../tx.c"
+#include "../horizon.c"
+#include "../utxo.c"
+#include "../addrhash.c"
+#include "../watch.c"
+#include "../json.c"
+#include "../json_add_tx.c"
+#include "easy_genesis.c"
+#include "helper_key.h"
+#include "helper_gateway_key.h"
+#include <ccan/strmap/strmap.h>
+#include <ccan/tal/str/str.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for add_detached_block */
+void add_detached_block(struct state *state,
+			const tal_t *pkt_ctx,
+			const struct protocol_block_id *sha,
+			const struct block_info *bi)
+{ fprintf(stderr, "add_detached_block called!\n"); abort(); }
+/* Generated stub for check_proof */
+bool check_proof(const struct protocol_proof *proof,
+		 const struct block *b,
+		 const union protocol_tx *tx,
+		 const struct protocol_input_ref *refs)
+{ fprintf(stderr, "check_proof called!\n"); abort(); }
+/* Generated stub for check_tx_refs */
+enum ref_ecode check_tx_refs(struct state *state,
+			     const struct block *block,
+			     const union protocol_tx *tx,
+			     const struct protocol_input_ref *refs,
+			     unsigned int *bad_ref,
+			     struct block **block_referred_to)
+{ fprintf(stderr, "check_tx_refs called!\n"); abort(); }
+/* Generated stub for complain_bad_amount */
+void complain_bad_amount(struct state *state,
+			 struct block *block,
+			 const struct protocol_proof *proof,
+			 const union protocol_tx *tx,
+			 const struct protocol_input_ref *refs,
+			 const union protocol_tx *intx[])
+{ fprintf(stderr, "complain_bad_amount called!\n"); abort(); }
+/* Generated stub for complain_bad_claim */
+void complain_bad_claim(struct state *state,
+			struct block *claim_block,
+			const struct protocol_proof *claim_proof,
+			const union protocol_tx *claim_tx,
+			const struct protocol_input_ref *claim_refs,
+			const struct block *reward_block,
+			u16 reward_shard, u8 reward_txoff)
+{ fprintf(stderr, "complain_bad_claim called!\n"); abort(); }
+/* Generated stub for complain_bad_input */
+void complain_bad_input(struct state *state,
+			struct block *block,
+			const struct protocol_proof *proof,
+			const union protocol_tx *tx,
+			const struct protocol_input_ref *refs,
+			unsigned int bad_input,
+			const union protocol_tx *intx)
+{ fprintf(stderr, "complain_bad_input called!\n"); abort(); }
+/* Generated stub for complain_bad_input_ref */
+void complain_bad_input_ref(struct state *state,
+			    struct block *block,
+			    const struct protocol_proof *proof,
+			    const union protocol_tx *tx,
+			    const struct protocol_input_ref *refs,
+			    unsigned int bad_refnum,
+			    const struct block *block_referred_to)
+{ fprintf(stderr, "complain_bad_input_ref called!\n"); abort(); }
+/* Generated stub for complain_bad_prev_txhashes */
+void complain_bad_prev_txhashes(struct state *state,
+				struct block *block,
+				const struct block *bad_prev,
+				u16 bad_prev_shard)
+{ fprintf(stderr, "complain_bad_prev_txhashes called!\n"); abort(); }
+/* Generated stub for complain_doublespend */
+void complain_doublespend(struct state *state,
+			  struct block *block1,
+			  u32 input1,
+			  const struct protocol_proof *proof1,
+			  const union protocol_tx *tx1,
+			  const struct protocol_input_ref *refs1,
+			  struct block *block2,
+			  u32 input2,
+			  const struct protocol_proof *proof2,
+			  const union protocol_tx *tx2,
+			  const struct protocol_input_ref *refs2)
+{ fprintf(stderr, "complain_doublespend called!\n"); abort(); }
+/* Generated stub for complain_misorder */
+void complain_misorder(struct state *state,
+		       struct block *block,
+		       const struct protocol_proof *proof,
+		       const union protocol_tx *tx,
+		       const struct protocol_input_ref *refs,
+		       unsigned int conflict_txoff)
+{ fprintf(stderr, "complain_misorder called!\n"); abort(); }
+/* Generated stub for create_proof */
+void create_proof(struct protocol_proof *proof,
+		  const struct block *block, u16 shard, u8 txoff)
+{ fprintf(stderr, "create_proof called!\n"); abort(); }
+/* Generated stub for have_detached_block */
+bool have_detached_block(const struct state *state,
+			 const struct protocol_block_id *sha)
+{ fprintf(stderr, "have_detached_block called!\n"); abort(); }
+/* Could not find declaration for helper_addr */
+/* Could not find declaration for helper_gateway_key */
+/* Could not find declaration for helper_gateway_public_key */
+/* Could not find declaration for helper_private_key */
+/* Generated stub for refresh_peer_cache */
+void refresh_peer_cache(struct state *state)
+{ fprintf(stderr, "refresh_peer_cache called!\n"); abort(); }
+/* Generated stub for reward_amount */
+u32 reward_amount(const struct block *reward_block,
+		  const union protocol_tx *tx)
+{ fprintf(stderr, "reward_amount called!\n"); abort(); }
+/* Generated stub for reward_get_tx */
+bool reward_get_tx(struct state *state,
+		   const struct block *reward_block,
+		   const struct block *claim_block,
+		   u16 *shardnum, u8 *txoff)
+{ fprintf(stderr, "reward_get_tx called!\n"); abort(); }
+/* Generated stub for todo_add_get_block */
+void todo_add_get_block(struct state *state,
+			const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_block called!\n"); abort(); }
+/* Generated stub for todo_add_get_children */
+void todo_add_get_children(struct state *state,
+			   const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_add_get_children called!\n"); abort(); }
+/* Generated stub for todo_add_get_shard */
+void todo_add_get_shard(struct state *state,
+			const struct protocol_block_id *block,
+			u16 shardnum)
+{ fprintf(stderr, "todo_add_get_shard called!\n"); abort(); }
+/* Generated stub for todo_add_get_tx */
+void todo_add_get_tx(struct state *state, const struct protocol_tx_id *tx)
+{ fprintf(stderr, "todo_add_get_tx called!\n"); abort(); }
+/* Generated stub for todo_add_get_tx_in_block */
+void todo_add_get_tx_in_block(struct state *state,
+			      const struct protocol_block_id *block,
+			      u16 shardnum, u8 txoff)
+{ fprintf(stderr, "todo_add_get_tx_in_block called!\n"); abort(); }
+/* Generated stub for todo_add_get_txmap */
+void todo_add_get_txmap(struct state *state,
+			const struct protocol_block_id *block,
+			u16 shardnum)
+{ fprintf(stderr, "todo_add_get_txmap called!\n"); abort(); }
+/* Generated stub for todo_done_get_block */
+void todo_done_get_block(struct peer *peer,
+			 const struct protocol_block_id *block,
+			 bool success)
+{ fprintf(stderr, "todo_done_get_block called!\n"); abort(); }
+/* Generated stub for todo_done_get_shard */
+void todo_done_get_shard(struct peer *peer,
+			 const struct protocol_block_id *block,
+			 u16 shardnum, bool success)
+{ fprintf(stderr, "todo_done_get_shard called!\n"); abort(); }
+/* Generated stub for todo_forget_about_block */
+void todo_forget_about_block(struct state *state,
+			     const struct protocol_block_id *block)
+{ fprintf(stderr, "todo_forget_about_block called!\n"); abort(); }
+/* Generated stub for todo_for_peer */
+void todo_for_peer(struct peer *peer, void *pkt)
+{ fprintf(stderr, "todo_for_peer called!\n"); abort(); }
+/* Generated stub for tx_cmp */
+int tx_cmp(const union protocol_tx *a, const union protocol_tx *b)
+{ fprintf(stderr, "tx_cmp called!\n"); abort(); }
+/* Generated stub for wake_peers */
+void wake_peers(struct state *state)
+{ fprintf(stderr, "wake_peers called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+int generate_main(int argc, char *argv[]);
+#define main generate_main
+#include "../pettycoin-generate.c"
+#undef main
+
+/* Dummy functions */
+void save_block(struct state *state, struct block *new)
+{
+}
+
+void save_tx(struct state *state, struct block *block, u16 shard, u8 txoff)
+{
+}
+
+void seek_detached_blocks(struct state *state, const struct block *block)
+{
+}
+
+void send_block_to_peers(struct state *state,
+			 struct peer *exclude,
+			 const struct block *block)
+{
+}
+
+void send_tx_in_block_to_peers(struct state *state, const struct peer *exclude,
+			       struct block *block, u16 shard, u8 txoff)
+{
+}
+
+/* Generated stub for restart_generating */
+void restart_generating(struct state *state)
+{
+}
+
+/* Events we've been told about, in order. */
+static char *events;
+
+void json_notify(struct json_connection *jcon, const char *result)
+{
+	const char *ev = strstr(result, "\"event\" : \"");
+
+	assert(ev);
+	ev += strlen("\"event\" : \"");
+	tal_append_fmt(&events, "%.*s ", (int)strcspn(ev, "\""), ev);
+}
+
+
+static struct working_block *w;
+
+void tell_generator_new_pending(struct state *state, u32 shard, u32 txoff)
+{
+	struct pending_tx *t = state->pending->pend[shard][txoff];
+	struct gen_update update;
+
+	update.features = t->tx->hdr.features;
+	update.shard = shard;
+	update.txoff = txoff;
+	update.unused = 0;
+	hash_tx_and_refs(t->tx, t->refs, &update.hashes);
+
+	assert(add_tx(w, &update));
+}
+
+static const struct block *mine(struct state *state,
+				const struct block *prev,
+				const union protocol_tx *tx)
+{
+	unsigned int i;
+	u8 *prev_txhashes;
+	struct protocol_block_id prevs[PROTOCOL_NUM_PREV_IDS];
+	struct protocol_pkt_shard **shard_pkt;
+	struct protocol_pkt_block *block_pkt;
+
+	prev_txhashes = make_prev_txhashes(state, prev, helper_addr(1));
+	make_prev_blocks(prev, prevs);
+	w = new_working_block(state, block_difficulty(&prev->bi),
+			      prev_txhashes, tal_count(prev_txhashes),
+			      block_height(&prev->bi) + 1,
+			      next_shard_order(prev),
+			      prevs, helper_addr(1));
+
+	if (tx) {
+		struct protocol_tx_id txid;
+		unsigned int bad_input;
+		bool too_old, already_known;
+
+		hash_tx(tx, &txid);
+		assert(add_pending_tx(state, tx, &txid, &bad_input,
+				      &too_old, &already_known)
+		       == ECODE_INPUT_OK);
+	}
+
+	for (i = 0; !solve_block(w); i++);
+
+	block_pkt = marshal_block(w, &w->bi);
+	shard_pkt = tal_arr(w, struct protocol_pkt_shard *, w->num_shards);
+	for (i = 0; i < w->num_shards; i++)
+		shard_pkt[i] = make_shard_pkt(w, i);
+
+	if (!recv_block_from_generator(state, state->log, block_pkt, shard_pkt))
+		abort();
+
+	while (!list_empty(&state->work))
+		do_work(state);
+
+	/* It's the newest child of prev. */
+	return list_tail(&prev->children, struct block, sibling);
+}
+
+int main(void)
+{
+	struct state *state;
+	union protocol_tx *t, *t2;
+	struct protocol_gateway_payment payment;
+	const struct block *g1, *b2, *b3, *a2;
+	struct protocol_input inputs[1];
+	struct json_connection *jcon;
+	struct watch *watch;
+
+	pseudorand_init();
+	state = new_state(true);
+	events = tal_strdup(state, "");
+
+	/* Watch address 1, like watchaddress would. */
+	jcon = tal(state, struct json_connection);
+	jcon->state = state;
+	watch = tal(jcon, struct watch);
+	watch->addr = *helper_addr(1);
+	watch->jcon = jcon;
+	list_add_tail(&state->watches, &watch->list);
+	tal_add_destructor(watch, destroy_watch);
+
+	/* Gateway tx pays address 0: nothing to tell. */
+	payment.send_amount = cpu_to_le32(1000);
+	payment.output_addr = *helper_addr(0);
+	t = create_from_gateway_tx(state, helper_gateway_public_key(),
+				   1, &payment, false, helper_gateway_key(state));
+	g1 = mine(state, &genesis, t);
+	assert(streq(events, ""));
+
+	/* Paying address 1 goes pending, then into a block. */
+	hash_tx(t, &inputs[0].input);
+	inputs[0].output = 0;
+	inputs[0].unused = 0;
+	t2 = create_normal_tx(state, helper_addr(1),
+			      500, 500 - PROTOCOL_FEE(500), 1, true, inputs,
+			      helper_private_key(state, 0));
+	b2 = mine(state, g1, t2);
+	assert(state->utxo.tip == b2);
+	assert(streq(events, "pending block "));
+
+	/* Side chain doesn't matter until it overtakes. */
+	a2 = mine(state, g1, NULL);
+	assert(streq(events, "pending block "));
+	mine(state, a2, NULL);
+	assert(state->utxo.tip != b2);
+	assert(streq(events, "pending block unblock "));
+
+	/* Back again. */
+	b3 = mine(state, b2, NULL);
+	mine(state, b3, NULL);
+	assert(utxo_in_chain(&state->utxo, b2));
+	assert(streq(events, "pending block unblock block "));
+
+	/* Unwatching takes it off the list. */
+	tal_free(watch);
+	assert(list_empty(&state->watches));
+
+	tal_free(state);
+	return 0;
+}
@@ -148,6 +148,7 @@ static void new_todo_request_(struct state *state,
 	 * we want valgrind to tell us if we don't initialize some fields. */
 	zero_unused(state, t);
 	list_add_tail(&state->todo, &t->list);
+	state->metrics.todo_added++;
 
 	/* In case a peer is waiting for something to do. */
 	wake_peers(state);
@@ -297,9 +298,10 @@ static void finish_todo(struct peer *peer,
 		log_add(peer->log, ":%u(%u)", shardnum, txoff);
 	}
 
-	if (success)
+	if (success) {
 		delete_todo(peer->state, todo);
-	else if (!status) {
+		peer->state->metrics.todo_done++;
+	} else if (!status) {
 		bitmap_set_bit(todo->peers_failed, peer->peer_num);
 		request_done(peer);
 	}
@@ -222,3 +222,29 @@ size_t tx_len(const union protocol_tx *tx)
 	}
 	abort();
 }
+
+struct protocol_address *tx_addresses(const tal_t *ctx,
+				      const union protocol_tx *tx)
+{
+	struct protocol_address *addrs;
+	unsigned int i, j, num = 0;
+	u32 amount;
+
+	addrs = tal_arr(ctx, struct protocol_address, 1 + num_outputs(tx));
+	if (tx_type(tx) != TX_FROM_GATEWAY)
+		get_tx_input_address(tx, &addrs[num++]);
+
+	for (i = 0; i < num_outputs(tx); i++) {
+		/* This must succeed, as i < num_outputs(tx) */
+		if (!find_output(tx, i, &addrs[num], &amount))
+			abort();
+
+		for (j = 0; j < num; j++)
+			if (structeq(&addrs[j], &addrs[num]))
+				break;
+		if (j == num)
+			num++;
+	}
+	tal_resize(&addrs, num);
+	return addrs;
+}
@@ -3,6 +3,7 @@
 #include "config.h"
 #include "addr.h"
 #include "protocol.h"
+#include <ccan/tal/tal.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -37,6 +38,10 @@ u32 tx_amount_sent(const union protocol_tx *tx);
 bool find_output(const union protocol_tx *trans, u16 output_num,
 		 struct protocol_address *addr, u32 *amount);
 
+/* Every address tx touches (input first, if any), without duplicates. */
+struct protocol_address *tx_addresses(const tal_t *ctx,
+				      const union protocol_tx *tx);
+
 /* We know tx duplicated inp, but which one? */
 u32 find_matching_input(const union protocol_tx *tx,
 			const struct protocol_input *inp);
@@ -1,18 +1,21 @@
+#include "addrhash.h"
 #include "block.h"
 #include "chain.h"
 #include "state.h"
 #include "tx_in_hashes.h"
+#include "utxo.h"
 
-void add_txhash_to_hashes(struct state *state,
-			  const tal_t *ctx,
-			  struct block *block, u16 shard, u8 txoff,
-			  const struct protocol_tx_id *txhash)
+struct txhash_elem *add_txhash_to_hashes(struct state *state,
+					 const tal_t *ctx,
+					 struct block *block,
+					 u16 shard, u8 txoff,
+					 const struct protocol_tx_id *txhash)
 {
 	union txhash_block_or_tx u;
 
 	u.block = block;
-	txhash_add_tx(&state->txhash, ctx, u, shard, txoff, TX_IN_BLOCK,
-		      txhash);
+	return txhash_add_tx(&state->txhash, ctx, u, shard, txoff,
+			     TX_IN_BLOCK, txhash);
 }
 
 void add_tx_to_hashes(struct state *state,
@@ -21,6 +24,7 @@ void add_tx_to_hashes(struct state *state,
 		      const union protocol_tx *tx)
 {
 	struct protocol_tx_id txhash;
+	struct txhash_elem *te;
 
 	hash_tx(tx, &txhash);
 
@@ -28,7 +32,11 @@ void add_tx_to_hashes(struct state *state,
 	if (!txhash_gettx(&state->txhash, &txhash, TX_PENDING))
 		inputhash_add_tx(state, &state->inputhash, tx);
 
-	add_txhash_to_hashes(state, ctx, block, shard, txoff, &txhash);
+	te = add_txhash_to_hashes(state, ctx, block, shard, txoff, &txhash);
+
+	/* If it's in preferred chain, it spends those outputs. */
+	utxo_add_tx(state, te, tx);
+	addrhash_add_tx(state, te, tx);
 }
 
 void remove_tx_from_hashes(struct state *state,
@@ -50,6 +58,17 @@ void remove_tx_from_hashes(struct state *state,
 		tx = NULL;
 	}
 
+	if (tx) {
+		struct txhash_iter iter;
+		struct txhash_elem *te;
+
+		utxo_del_tx(state, block, shard, txoff, tx);
+		te = txhash_find_tx(&state->txhash, u, shard, txoff,
+				    TX_IN_BLOCK, txhash, &iter);
+		if (te)
+			addrhash_del_tx(state, te, tx);
+	}
+
 	txhash_del_tx(&state->txhash, u, shard, txoff, TX_IN_BLOCK, txhash);
 
 	/* If this tx is no longer known at *all*, we can remove from
@@ -61,12 +80,30 @@ void remove_tx_from_hashes(struct state *state,
 /* This is called *before* we turn txrefhash into tx pointer, so
  * txhash_gettx won't return this entry. */
 void upgrade_tx_in_hashes(struct state *state,
+			  const struct block *block, u16 shard, u8 txoff,
 			  const struct protocol_tx_id *sha,
 			  const union protocol_tx *tx)
 {
+	struct txhash_iter iter;
+	struct txhash_elem *te;
+
 	/* If we didn't know about full tx before, add inputs to hash. */
 	if (!txhash_gettx(&state->txhash, sha, TX_PENDING))
 		inputhash_add_tx(state, &state->inputhash, tx);
+
+	/* Now we know what it spends, if it's in preferred chain. */
+	for (te = txhash_firstval(&state->txhash, sha, &iter);
+	     te;
+	     te = txhash_nextval(&state->txhash, sha, &iter)) {
+		if (te->status == TX_IN_BLOCK
+		    && te->u.block == block
+		    && te->shardnum == shard
+		    && te->txoff == txoff) {
+			utxo_add_tx(state, te, tx);
+			addrhash_add_tx(state, te, tx);
+			break;
+		}
+	}
 }
 
 void add_pending_tx_to_hashes(struct state *state,
@@ -75,6 +112,7 @@ void add_pending_tx_to_hashes(struct state *state,
 {
 	struct protocol_tx_id txhash;
 	union txhash_block_or_tx u;
+	struct txhash_elem *te;
 
 	hash_tx(tx, &txhash);
 
@@ -85,7 +123,8 @@ void add_pending_tx_to_hashes(struct state *state,
 		inputhash_add_tx(state, &state->inputhash, tx);
 
 	u.tx = tx;
-	txhash_add_tx(&state->txhash, ctx, u, 0, 0, TX_PENDING, &txhash);
+	te = txhash_add_tx(&state->txhash, ctx, u, 0, 0, TX_PENDING, &txhash);
+	addrhash_add_tx(state, te, tx);
 }
 
 void remove_pending_tx_from_hashes(struct state *state,
@@ -93,9 +132,15 @@ void remove_pending_tx_from_hashes(struct state *state,
 {
 	struct protocol_tx_id txhash;
 	union txhash_block_or_tx u;
+	struct txhash_iter iter;
+	struct txhash_elem *te;
 
 	hash_tx(tx, &txhash);
 	u.tx = tx;
+	te = txhash_find_tx(&state->txhash, u, 0, 0, TX_PENDING, &txhash,
+			    &iter);
+	if (te)
+		addrhash_del_tx(state, te, tx);
 	txhash_del_tx(&state->txhash, u, 0, 0, TX_PENDING, &txhash);
 
 	/* If this tx is no longer known at *all*, we can remove from
@@ -8,10 +8,11 @@ struct block;
 struct txhash;
 struct protocol_tx_id;
 
-void add_txhash_to_hashes(struct state *state,
-			  const tal_t *ctx,
-			  struct block *block, u16 shard, u8 txoff,
-			  const struct protocol_tx_id *txhash);
+struct txhash_elem *add_txhash_to_hashes(struct state *state,
+					 const tal_t *ctx,
+					 struct block *block,
+					 u16 shard, u8 txoff,
+					 const struct protocol_tx_id *txhash);
 
 void add_tx_to_hashes(struct state *state,
 		      const tal_t *ctx,
@@ -27,6 +28,7 @@ void remove_pending_tx_from_hashes(struct state *state,
 
 /* It was a hash, now we found the tx. */
 void upgrade_tx_in_hashes(struct state *state,
+			  const struct block *block, u16 shard, u8 txoff,
 			  const struct protocol_tx_id *sha,
 			  const union protocol_tx *tx);
 
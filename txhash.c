@@ -71,19 +71,19 @@ const union protocol_tx *txhash_gettx(struct txhash *txhash,
 	return NULL;
 }
 
-void txhash_del_tx(struct txhash *txhash,
-		   union txhash_block_or_tx block_or_tx,
-		   u16 shard,
-		   u8 txoff,
-		   enum tx_status status,
-		   const struct protocol_tx_id *sha)
+struct txhash_elem *txhash_find_tx(struct txhash *txhash,
+				   union txhash_block_or_tx block_or_tx,
+				   u16 shard,
+				   u8 txoff,
+				   enum tx_status status,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i)
 {
-	struct txhash_iter i;
 	struct txhash_elem *te;
 
-	for (te = txhash_firstval(txhash, sha, &i);
+	for (te = txhash_firstval(txhash, sha, i);
 	     te;
-	     te = txhash_nextval(txhash, sha, &i)) {
+	     te = txhash_nextval(txhash, sha, i)) {
 		if (te->shardnum != shard
 		    || te->txoff != txoff
 		    || te->status != status)
@@ -104,19 +104,35 @@ void txhash_del_tx(struct txhash *txhash,
 				continue;
 			break;
 		}
-		htable_delval(&txhash->raw, &i.i);
-		tal_free(te);
 		break;
 	}
+	return te;
 }
 
-void txhash_add_tx(struct txhash *txhash,
-		   const tal_t *ctx,
+void txhash_del_tx(struct txhash *txhash,
 		   union txhash_block_or_tx block_or_tx,
 		   u16 shard,
 		   u8 txoff,
 		   enum tx_status status,
 		   const struct protocol_tx_id *sha)
+{
+	struct txhash_iter i;
+	struct txhash_elem *te;
+
+	te = txhash_find_tx(txhash, block_or_tx, shard, txoff, status, sha, &i);
+	if (te) {
+		htable_delval(&txhash->raw, &i.i);
+		tal_free(te);
+	}
+}
+
+struct txhash_elem *txhash_add_tx(struct txhash *txhash,
+				  const tal_t *ctx,
+				  union txhash_block_or_tx block_or_tx,
+				  u16 shard,
+				  u8 txoff,
+				  enum tx_status status,
+				  const struct protocol_tx_id *sha)
 {
 	struct txhash_elem *te;
 
@@ -128,4 +144,5 @@ void txhash_add_tx(struct txhash *txhash,
 	te->u = block_or_tx;
 	te->sha = *sha;
 	txhash_add(txhash, te);
+	return te;
 }
@@ -66,13 +66,22 @@ const union protocol_tx *txhash_gettx(struct txhash *txhash,
 				      const struct protocol_tx_id *sha,
 				      enum tx_status in_block);
 
-void txhash_add_tx(struct txhash *txhash,
-		   const tal_t *ctx,
-		   union txhash_block_or_tx block_or_tx,
-		   u16 shard,
-		   u8 txoff,
-		   enum tx_status status,
-		   const struct protocol_tx_id *sha);
+struct txhash_elem *txhash_add_tx(struct txhash *txhash,
+				  const tal_t *ctx,
+				  union txhash_block_or_tx block_or_tx,
+				  u16 shard,
+				  u8 txoff,
+				  enum tx_status status,
+				  const struct protocol_tx_id *sha);
+
+/* Find the entry for this exact block position (or pending tx). */
+struct txhash_elem *txhash_find_tx(struct txhash *txhash,
+				   union txhash_block_or_tx block_or_tx,
+				   u16 shard,
+				   u8 txoff,
+				   enum tx_status status,
+				   const struct protocol_tx_id *sha,
+				   struct txhash_iter *i);
 
 void txhash_del_tx(struct txhash *txhash,
 		   union txhash_block_or_tx block_or_tx,
@@ -0,0 +1,284 @@
+#include "block.h"
+#include "chain.h"
+#include "shard.h"
+#include "state.h"
+#include "tx.h"
+#include "txhash.h"
+#include "utxo.h"
+#include "watch.h"
+#include <assert.h>
+#include <ccan/structeq/structeq.h>
+
+const struct inputhash_key *utxo_spend_keyof(const struct utxo_spend *us)
+{
+	return &us->output;
+}
+
+bool utxo_spend_eq(const struct utxo_spend *us,
+		   const struct inputhash_key *output)
+{
+	return output->output_num == us->output.output_num
+		&& structeq(&output->tx, &us->output.tx);
+}
+
+void utxo_init(struct utxo *utxo, const tal_t *ctx, const struct block *tip)
+{
+	const struct block *b;
+
+	utxo->tip = tip;
+	utxo_spendhash_init(&utxo->spent);
+	utxo->chain = tal_arr(ctx, const struct block *,
+			      block_height(&tip->bi) + 1);
+	for (b = tip; b; b = b->prev)
+		utxo->chain[block_height(&b->bi)] = b;
+	utxo->forked = false;
+}
+
+bool utxo_in_chain(const struct utxo *utxo, const struct block *block)
+{
+	u32 height = block_height(&block->bi);
+
+	return height < tal_count(utxo->chain) && utxo->chain[height] == block;
+}
+
+/* If b isn't the tip, one of its children is off our chain. */
+static void note_fork(struct utxo *utxo, const struct block *b)
+{
+	if (list_top(&b->children, struct block, sibling)
+	    == list_tail(&b->children, struct block, sibling))
+		return;
+
+	if (!utxo->forked || block_height(&b->bi) > utxo->fork_height) {
+		utxo->forked = true;
+		utxo->fork_height = block_height(&b->bi);
+	}
+}
+
+void utxo_add_block(struct state *state, const struct block *block)
+{
+	/* We check the tip's children on demand. */
+	if (block->prev != state->utxo.tip
+	    && utxo_in_chain(&state->utxo, block->prev))
+		note_fork(&state->utxo, block->prev);
+}
+
+static bool same_position(const struct txhash_elem *a,
+			  const struct txhash_elem *b)
+{
+	return a->u.block == b->u.block
+		&& a->shardnum == b->shardnum
+		&& a->txoff == b->txoff;
+}
+
+static void add_spends(struct state *state, struct txhash_elem *te,
+		       const union protocol_tx *tx)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_inputs(tx); i++) {
+		struct utxo_spend *us;
+		const struct protocol_input *inp = tx_input(tx, i);
+
+		/* Like inputhash, we allocate off state. */
+		us = tal(state, struct utxo_spend);
+		us->output.tx = inp->input;
+		us->output.output_num = le16_to_cpu(inp->output);
+		us->te = te;
+		utxo_spendhash_add(&state->utxo.spent, us);
+	}
+}
+
+static void del_spends(struct state *state,
+		       const struct block *block, u16 shardnum, u8 txoff,
+		       const union protocol_tx *tx)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_inputs(tx); i++) {
+		const struct protocol_input *inp = tx_input(tx, i);
+		struct inputhash_key key;
+		struct htable_iter it;
+		struct utxo_spend *us;
+		size_t h;
+
+		key.tx = inp->input;
+		key.output_num = le16_to_cpu(inp->output);
+		h = inputhash_hashfn(&key);
+
+		/* It may already be gone (eg. complaint removed it). */
+		for (us = htable_firstval(&state->utxo.spent.raw, &it, h);
+		     us;
+		     us = htable_nextval(&state->utxo.spent.raw, &it, h)) {
+			if (!utxo_spend_eq(us, &key))
+				continue;
+			if (us->te->u.block != block
+			    || us->te->shardnum != shardnum
+			    || us->te->txoff != txoff)
+				continue;
+			htable_delval(&state->utxo.spent.raw, &it);
+			tal_free(us);
+			break;
+		}
+	}
+}
+
+void utxo_add_tx(struct state *state, struct txhash_elem *te,
+		 const union protocol_tx *tx)
+{
+	assert(te->status == TX_IN_BLOCK);
+
+	if (utxo_in_chain(&state->utxo, te->u.block)) {
+		add_spends(state, te, tx);
+		watch_tx(state, tx, te->u.block, WATCH_BLOCK);
+	}
+}
+
+void utxo_del_tx(struct state *state,
+		 const struct block *block, u16 shardnum, u8 txoff,
+		 const union protocol_tx *tx)
+{
+	if (utxo_in_chain(&state->utxo, block))
+		del_spends(state, block, shardnum, txoff, tx);
+}
+
+/* Find the txhash entry for this position in the block. */
+static struct txhash_elem *find_te(struct state *state,
+				   const struct block *block,
+				   u16 shardnum, u8 txoff,
+				   const union protocol_tx *tx)
+{
+	struct protocol_tx_id sha;
+	struct txhash_iter iter;
+	struct txhash_elem *te;
+
+	hash_tx(tx, &sha);
+	for (te = txhash_firstval(&state->txhash, &sha, &iter);
+	     te;
+	     te = txhash_nextval(&state->txhash, &sha, &iter)) {
+		if (te->status != TX_IN_BLOCK)
+			continue;
+		if (te->u.block == block
+		    && te->shardnum == shardnum
+		    && te->txoff == txoff)
+			return te;
+	}
+	return NULL;
+}
+
+static void connect_block(struct state *state, const struct block *block)
+{
+	unsigned int shard, txoff;
+
+	/* We never move onto a chain with a complaint. */
+	assert(!block->complaint);
+
+	for (shard = 0; shard < num_shards(block->bi.hdr); shard++) {
+		const struct block_shard *s = block->shard[shard];
+
+		for (txoff = 0; txoff < s->size; txoff++) {
+			const union protocol_tx *tx = tx_for(s, txoff);
+			struct txhash_elem *te;
+
+			if (!tx)
+				continue;
+
+			te = find_te(state, block, shard, txoff, tx);
+			/* Everything in a block is in the txhash. */
+			assert(te);
+			add_spends(state, te, tx);
+			watch_tx(state, tx, block, WATCH_BLOCK);
+		}
+	}
+}
+
+static void disconnect_block(struct state *state, const struct block *block)
+{
+	unsigned int shard, txoff;
+
+	for (shard = 0; shard < num_shards(block->bi.hdr); shard++) {
+		const struct block_shard *s = block->shard[shard];
+
+		for (txoff = 0; txoff < s->size; txoff++) {
+			const union protocol_tx *tx = tx_for(s, txoff);
+
+			if (!tx)
+				continue;
+			del_spends(state, block, shard, txoff, tx);
+			watch_tx(state, tx, block, WATCH_UNBLOCK);
+		}
+	}
+}
+
+void utxo_set_tip(struct state *state, const struct block *tip)
+{
+	struct utxo *utxo = &state->utxo;
+	const struct block *old = utxo->tip, *new = tip, *b;
+
+	/* Unwind the old chain and wind on the new one until they meet.
+	 * Order of connection doesn't matter: it's just a set. */
+	while (old != new) {
+		if (block_height(&old->bi) >= block_height(&new->bi)) {
+			disconnect_block(state, old);
+			old = old->prev;
+			/* Where they meet now has two children. */
+			utxo->forked = true;
+			utxo->fork_height = block_height(&old->bi);
+		} else {
+			connect_block(state, new);
+			new = new->prev;
+		}
+	}
+
+	tal_resize(&utxo->chain, block_height(&tip->bi) + 1);
+	for (b = tip; b != old; b = b->prev) {
+		utxo->chain[block_height(&b->bi)] = b;
+		note_fork(utxo, b->prev);
+	}
+	utxo->tip = tip;
+}
+
+bool utxo_find_spend(const struct utxo *utxo,
+		     const struct block *block,
+		     const struct txhash_elem *me,
+		     const struct protocol_input *inp,
+		     struct txhash_elem **te)
+{
+	struct inputhash_key key;
+	struct htable_iter it;
+	struct utxo_spend *us;
+	const struct block *child;
+	size_t h;
+
+	if (!utxo_in_chain(utxo, block))
+		return false;
+
+	key.tx = inp->input;
+	key.output_num = le16_to_cpu(inp->output);
+	h = inputhash_hashfn(&key);
+
+	/* Anything in our chain counts, either before or after block. */
+	for (us = htable_firstval(&utxo->spent.raw, &it, h);
+	     us;
+	     us = htable_nextval(&utxo->spent.raw, &it, h)) {
+		if (!utxo_spend_eq(us, &key))
+			continue;
+		if (me && same_position(us->te, me))
+			continue;
+		*te = us->te;
+		return true;
+	}
+
+	/* Not found: but a descendent of block off our chain could
+	 * spend it, so we can only say it's unspent if there aren't any. */
+	if (utxo->forked && block_height(&block->bi) <= utxo->fork_height)
+		return false;
+
+	list_for_each(&utxo->tip->children, child, sibling) {
+		/* Blocks with complaints have no txs in the hashes. */
+		if (!child->complaint)
+			return false;
+	}
+
+	*te = NULL;
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef PETTYCOIN_UTXO_H
+#define PETTYCOIN_UTXO_H
+#include "config.h"
+#include "inputhash.h"
+#include <ccan/htable/htable_type.h>
+#include <ccan/short_types/short_types.h>
+#include <ccan/tal/tal.h>
+#include <stdbool.h>
+
+struct block;
+struct state;
+struct txhash_elem;
+struct protocol_input;
+union protocol_tx;
+
+/* An output spent by a tx in one of the blocks of our chain. */
+struct utxo_spend {
+	struct inputhash_key output;
+
+	/* The (TX_IN_BLOCK) tx which spent it. */
+	struct txhash_elem *te;
+};
+
+const struct inputhash_key *utxo_spend_keyof(const struct utxo_spend *us);
+bool utxo_spend_eq(const struct utxo_spend *us,
+		   const struct inputhash_key *output);
+
+HTABLE_DEFINE_TYPE(struct utxo_spend,
+		   utxo_spend_keyof, inputhash_hashfn, utxo_spend_eq,
+		   utxo_spendhash);
+
+/* Every output spent by a known tx in tip or any of its ancestors. */
+struct utxo {
+	const struct block *tip;
+	struct utxo_spendhash spent;
+
+	/* chain[height] is our chain's block at that height. */
+	const struct block **chain;
+
+	/* Highest block below tip in chain with more than one child. */
+	bool forked;
+	u32 fork_height;
+};
+
+void utxo_init(struct utxo *utxo, const tal_t *ctx, const struct block *tip);
+
+/* Is block in our chain? */
+bool utxo_in_chain(const struct utxo *utxo, const struct block *block);
+
+/* block just got added to the tree: it might fork our chain. */
+void utxo_add_block(struct state *state, const struct block *block);
+
+/* te (which is tx) just got into a block: add it if it's in our chain. */
+void utxo_add_tx(struct state *state, struct txhash_elem *te,
+		 const union protocol_tx *tx);
+
+/* tx in block is about to leave the txhash: forget anything it spent. */
+void utxo_del_tx(struct state *state,
+		 const struct block *block, u16 shardnum, u8 txoff,
+		 const union protocol_tx *tx);
+
+/* Move the tip (disconnecting and connecting blocks as required). */
+void utxo_set_tip(struct state *state, const struct block *tip);
+
+/* Can we answer for block?  If block is in our chain, any spend in the
+ * chain counts (before or after block); if there's none, we can only
+ * say so if block has no other descendents which might spend it.
+ * Otherwise returns false, and caller has to search. */
+bool utxo_find_spend(const struct utxo *utxo,
+		     const struct block *block,
+		     const struct txhash_elem *me,
+		     const struct protocol_input *inp,
+		     struct txhash_elem **te);
+#endif /* PETTYCOIN_UTXO_H */
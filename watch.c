@@ -0,0 +1,166 @@
+#include "base58.h"
+#include "block.h"
+#include "chain.h"
+#include "json_add_tx.h"
+#include "jsonrpc.h"
+#include "state.h"
+#include "tx.h"
+#include "watch.h"
+#include <ccan/structeq/structeq.h>
+#include <ccan/tal/str/str.h>
+
+static const char *event_name(enum watch_event event)
+{
+	switch (event) {
+	case WATCH_PENDING:
+		return "pending";
+	case WATCH_BLOCK:
+		return "block";
+	case WATCH_UNBLOCK:
+		return "unblock";
+	}
+	abort();
+}
+
+static void notify_watch(struct state *state, const struct watch *w,
+			 const union protocol_tx *tx,
+			 const struct block *block, enum watch_event event)
+{
+	struct json_result *response = new_json_result(w->jcon);
+	unsigned int confirms = 0;
+
+	if (event == WATCH_BLOCK
+	    && block_preceeds(block, state->preferred_chain))
+		confirms = block_height(&state->preferred_chain->bi)
+			- block_height(&block->bi) + 1;
+
+	json_object_start(response, NULL);
+	json_add_string(response, "event", event_name(event));
+	json_add_address(response, "address", state->test_net, &w->addr);
+	json_add_tx(response, "tx", state, tx, block, confirms);
+	json_object_end(response);
+
+	json_notify(w->jcon, json_result_string(response));
+	tal_free(response);
+}
+
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event)
+{
+	struct protocol_address *addrs = tx_addresses(state, tx);
+	const struct watch *w;
+	unsigned int i;
+
+	list_for_each(&state->watches, w, list) {
+		for (i = 0; i < tal_count(addrs); i++) {
+			if (structeq(&addrs[i], &w->addr)) {
+				notify_watch(state, w, tx, block, event);
+				break;
+			}
+		}
+	}
+	tal_free(addrs);
+}
+
+static void destroy_watch(struct watch *w)
+{
+	list_del(&w->list);
+}
+
+static struct watch *find_watch(struct json_connection *jcon,
+				const struct protocol_address *addr)
+{
+	struct watch *w;
+
+	list_for_each(&jcon->state->watches, w, list)
+		if (w->jcon == jcon && structeq(&w->addr, addr))
+			return w;
+	return NULL;
+}
+
+static char *get_address(struct json_connection *jcon,
+			 const jsmntok_t *params,
+			 struct protocol_address *address)
+{
+	const jsmntok_t *addr;
+	bool test_net;
+
+	json_get_params(jcon->buffer, params, "address", &addr, NULL);
+	if (!addr)
+		return tal_fmt(jcon, "Needs 'address'");
+
+	if (addr->type != JSMN_STRING
+	    || !pettycoin_from_base58(&test_net, address,
+				      jcon->buffer + addr->start,
+				      addr->end - addr->start)) {
+		return tal_fmt(jcon, "address %.*s not valid",
+			       json_tok_len(addr),
+			       json_tok_contents(jcon->buffer, addr));
+	}
+
+	if (test_net != jcon->state->test_net)
+		return tal_fmt(jcon, "address %.*s %s test net",
+			       json_tok_len(addr),
+			       json_tok_contents(jcon->buffer, addr),
+			       test_net ? "on" : "not on");
+	return NULL;
+}
+
+static char *json_watchaddress(struct json_connection *jcon,
+			       const jsmntok_t *params,
+			       struct json_result *response)
+{
+	struct protocol_address address;
+	struct watch *w;
+	char *err;
+
+	err = get_address(jcon, params, &address);
+	if (err)
+		return err;
+
+	if (find_watch(jcon, &address))
+		return tal_fmt(jcon, "Already watching that address");
+
+	/* Goes away when jcon does. */
+	w = tal(jcon, struct watch);
+	w->addr = address;
+	w->jcon = jcon;
+	list_add_tail(&jcon->state->watches, &w->list);
+	tal_add_destructor(w, destroy_watch);
+
+	json_add_address(response, NULL, jcon->state->test_net, &address);
+	return NULL;
+}
+
+const struct json_command watchaddress_command = {
+	"watchaddress", json_watchaddress,
+	"notify about transactions to/from a given address",
+	"<address> - send a notification on this connection whenever a transaction touching <address> becomes pending, gets into a block on the preferred chain (\"block\"), or that block leaves the preferred chain (\"unblock\")."
+};
+
+static char *json_unwatchaddress(struct json_connection *jcon,
+				 const jsmntok_t *params,
+				 struct json_result *response)
+{
+	struct protocol_address address;
+	struct watch *w;
+	char *err;
+
+	err = get_address(jcon, params, &address);
+	if (err)
+		return err;
+
+	w = find_watch(jcon, &address);
+	if (!w)
+		return tal_fmt(jcon, "Not watching that address");
+	tal_free(w);
+
+	json_add_address(response, NULL, jcon->state->test_net, &address);
+	return NULL;
+}
+
+const struct json_command unwatchaddress_command = {
+	"unwatchaddress", json_unwatchaddress,
+	"stop notifying about a given address",
+	"<address> - stop the notifications started by watchaddress <address>."
+};
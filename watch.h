@@ -0,0 +1,40 @@
+#ifndef PETTYCOIN_WATCH_H
+#define PETTYCOIN_WATCH_H
+#include "config.h"
+#include "protocol.h"
+#include "state.h"
+#include <ccan/list/list.h>
+
+struct block;
+struct json_connection;
+union protocol_tx;
+
+/* A JSON connection which wants to hear about an address. */
+struct watch {
+	/* In state->watches. */
+	struct list_node list;
+	struct protocol_address addr;
+	struct json_connection *jcon;
+};
+
+enum watch_event {
+	/* Accepted into pending. */
+	WATCH_PENDING,
+	/* In a block in preferred_chain. */
+	WATCH_BLOCK,
+	/* Block left preferred_chain (reorg or complaint). */
+	WATCH_UNBLOCK
+};
+
+void watch_tx_(struct state *state, const union protocol_tx *tx,
+	       const struct block *block, enum watch_event event);
+
+/* Tell any connections watching addresses tx touches. */
+static inline void watch_tx(struct state *state, const union protocol_tx *tx,
+			    const struct block *block, enum watch_event event)
+{
+	/* Usually nobody is watching. */
+	if (!list_empty(&state->watches))
+		watch_tx_(state, tx, block, event);
+}
+#endif /* PETTYCOIN_WATCH_H */
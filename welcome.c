@@ -19,6 +19,7 @@ struct protocol_pkt_welcome *make_welcome(const tal_t *ctx,
 	strncpy(w->moniker, "ICBINB! " VERSION, sizeof(w->moniker));
 	w->uuid = state->uuid;
 	w->you = *a;
+	w->you.unused = cpu_to_le16(PROTOCOL_NET_CAP_HEADERS);
 	w->listen_port = cpu_to_le16(state->listen_port);
 	memcpy(w->interests, state->interests, sizeof(w->interests));
 